@@ -15,19 +15,21 @@ LModelAudioProcessorEditor::LModelAudioProcessorEditor(LModelAudioProcessor& p)
 {
 	// Make sure that before the constructor has finished, you've set the
 	// editor's size to whatever you need it to be.
-	setResizable(true, true); // ڵС
+	setResizable(true, true); // 允许窗口调整大小
 
-	setOpaque(false);  // ڱ߿
+	setOpaque(false);  // 允许在边框外面绘制
 
-	//setResizeLimits(64 * 11, 64 * 5, 10000, 10000); // СΪ300x200Ϊ800x600
+	//setResizeLimits(64 * 11, 64 * 5, 10000, 10000); // 设置最小宽高为300x200，最大宽高为800x600
 	setSize(64 * 10, 64 * 5);
 	setResizeLimits(64 * 7, 64 * 4, 64 * 20, 64 * 10);
 
-	//constrainer.setFixedAspectRatio(11.0 / 4.0);  // Ϊ16:9
-	//setConstrainer(&constrainer);  // 󶨴ڵĿ
+	//constrainer.setFixedAspectRatio(11.0 / 4.0);  // 设置为16:9比例
+	//setConstrainer(&constrainer);  // 绑定窗口的宽高限制
 
 	//addAndMakeVisible(spectrumUI);
 	addAndMakeVisible(equi);
+	equi.setZoomAnalyzer(&p.zoom);
+	equi.setBandMeters(&p.meters);
 
 	startTimerHz(30);
 
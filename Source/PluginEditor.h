@@ -26,7 +26,7 @@ public:
 	//==============================================================================
 	void paint(juce::Graphics&) override;
 	void resized() override;
-	void timerCallback() override;//ע⣬治ڻfft
+	void timerCallback() override;//注意，这里面不定期会给fft填东西。
 
 private:
 	// This reference is provided as a quick way for your editor to
@@ -36,7 +36,7 @@ private:
 	EqualizerUI equi;
 	//SpectrumUI spectrumUI;
 
-	juce::ComponentBoundsConstrainer constrainer;  // ÿ߱
+	juce::ComponentBoundsConstrainer constrainer;  // 用于设置宽高比例
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LModelAudioProcessorEditor)
 };
 
@@ -17,24 +17,195 @@ LModelAudioProcessor::LModelAudioProcessor()
 #if ! JucePlugin_IsMidiEffect
 #if ! JucePlugin_IsSynth
 		.withInput("Input", juce::AudioChannelSet::stereo(), true)
+		.withInput("Sidechain", juce::AudioChannelSet::stereo(), false)
 #endif
 		.withOutput("Output", juce::AudioChannelSet::stereo(), true)
+		.withOutput("Band 1", juce::AudioChannelSet::stereo(), false)
+		.withOutput("Band 2", juce::AudioChannelSet::stereo(), false)
+		.withOutput("Band 3", juce::AudioChannelSet::stereo(), false)
+		.withOutput("Band 4", juce::AudioChannelSet::stereo(), false)
+		.withOutput("Band 5", juce::AudioChannelSet::stereo(), false)
 #endif
 	)
 #endif
 {
-
+	for (int band = 0; band < NumBandParams; ++band)
+	{
+		for (int field = 0; field < NumBandFields; ++field)
+		{
+			juce::String id = getBandParamId(band, field);
+			bandParams[band][field] = Params.getParameter(id);
+			bandValues[band][field] = Params.getRawParameterValue(id);
+			bandShown[band][field] = bandValues[band][field]->load();
+			Params.addParameterListener(id, this);
+		}
+	}
+	startTimerHz(30);
 }
 
 
+juce::String LModelAudioProcessor::getBandParamId(int band, int field)
+{
+	static const char* suffixes[] = { "_on", "_type", "_freq", "_q", "_gain" };
+	return "band" + juce::String(band) + suffixes[field];
+}
+
 juce::AudioProcessorValueTreeState::ParameterLayout LModelAudioProcessor::createParameterLayout()
 {
 	juce::AudioProcessorValueTreeState::ParameterLayout layout;
+
+	// 频率和Q按对数映射, 范围和界面一致
+	auto logRange = [](float start, float end) {
+		return juce::NormalisableRange<float>(start, end,
+			[](float a, float b, float t) { return a * std::pow(b / a, t); },
+			[](float a, float b, float v) { return std::log(v / a) / std::log(b / a); });
+	};
+	juce::StringArray modes;
+	for (int i = 0; i < Equalizer::GetNumFilterModes(); ++i)
+		modes.add(Equalizer::GetFilterModeName(i));
+
+	for (int band = 0; band < NumBandParams; ++band)
+	{
+		juce::String name = "Band " + juce::String(band + 1);
+		layout.add(std::make_unique<juce::AudioParameterBool>(getBandParamId(band, BAND_ACTIVE), name + " On", false));
+		layout.add(std::make_unique<juce::AudioParameterChoice>(getBandParamId(band, BAND_MODE), name + " Type", modes, MODE_PEAKING));
+		layout.add(std::make_unique<juce::AudioParameterFloat>(getBandParamId(band, BAND_CUTOFF), name + " Freq",
+			logRange(10.0f, 24000.0f), 1000.0f));
+		layout.add(std::make_unique<juce::AudioParameterFloat>(getBandParamId(band, BAND_Q), name + " Q",
+			logRange(0.1f, 20.0f), 1.0f));
+		layout.add(std::make_unique<juce::AudioParameterFloat>(getBandParamId(band, BAND_GAIN), name + " Gain",
+			juce::NormalisableRange<float>(-30.0f, 30.0f), 0.0f));
+	}
 	return layout;
 }
 
 LModelAudioProcessor::~LModelAudioProcessor()
 {
+	stopTimer();
+	for (int band = 0; band < NumBandParams; ++band)
+		for (int field = 0; field < NumBandFields; ++field)
+			Params.removeParameterListener(getBandParamId(band, field), this);
+}
+
+void LModelAudioProcessor::timerCallback()
+{
+	eq.SyncAutomation();
+	for (int band = 0; band < NumBandParams; ++band)
+		if (bandToggled[band].exchange(false)) applyBandParams(band);
+	syncBandParams();
+	analyzer.syncBus();
+}
+
+void LModelAudioProcessor::parameterChanged(const juce::String& parameterID, float newValue)
+{
+	juce::ignoreUnused(newValue);
+	int band = (parameterID.getCharPointer() + 4).getIntValue32();//"band<n>_...", 音频线程上不分配字符串
+	if (band < 0 || band >= NumBandParams) return;
+	if (!juce::MessageManager::existsAndIsCurrentThread())
+	{
+		if (parameterID.endsWith("_on")) bandToggled[band] = true;
+		bandDirty[band] = true;
+		return;
+	}
+	if (!syncingParams) applyBandParams(band);
+}
+
+void LModelAudioProcessor::scheduleAutomation(int numSamples)
+{
+	// JUCE只把每个参数在本块里的最后一个值交过来, 不带块内位置: 事件记在块尾, eq从上一个事件点线性逼近过来
+	for (int band = 0; band < NumBandParams; ++band)
+	{
+		if (!bandDirty[band].exchange(false)) continue;
+		if (bandValues[band][BAND_ACTIVE]->load() < 0.5f) continue;//关掉的段由消息线程删掉
+		eq.ScheduleNodeChange(numSamples - 1, band, (int)bandValues[band][BAND_MODE]->load(),
+			bandValues[band][BAND_CUTOFF]->load(), bandValues[band][BAND_Q]->load(), bandValues[band][BAND_GAIN]->load());
+	}
+}
+
+void LModelAudioProcessor::applyBandParams(int band)
+{
+	if (bandValues[band][BAND_ACTIVE]->load() < 0.5f)
+	{
+		if (eq.IsNodeActive(band)) eq.DeleteNode(band);
+		return;
+	}
+	int mode = (int)bandValues[band][BAND_MODE]->load();
+	float cutoff = bandValues[band][BAND_CUTOFF]->load();
+	float q = bandValues[band][BAND_Q]->load();
+	float gainDB = bandValues[band][BAND_GAIN]->load();
+	if (eq.IsNodeActive(band))
+	{
+		const FilterNode& n = eq.GetNode(band);
+		if (n.mode == mode && n.cutoff == cutoff && n.q == q && n.gainDB == gainDB) return;
+	}
+	eq.SetNode(band, mode, cutoff, q, gainDB);
+}
+
+void LModelAudioProcessor::syncBandParams()
+{
+	// 只在节点离开上次对上的值时写参数; 节点没动而参数变了是宿主的值还在路上, 不能拿节点盖回去
+	syncingParams = true;
+	for (int band = 0; band < NumBandParams; ++band)
+	{
+		float values[NumBandFields];
+		for (int field = 0; field < NumBandFields; ++field) values[field] = bandShown[band][field];
+		values[BAND_ACTIVE] = eq.IsNodeActive(band) ? 1.0f : 0.0f;
+		if (eq.IsNodeActive(band))
+		{
+			const FilterNode& n = eq.GetNode(band);
+			values[BAND_MODE] = (float)n.mode;
+			values[BAND_CUTOFF] = n.cutoff;
+			values[BAND_Q] = n.q;
+			values[BAND_GAIN] = n.gainDB;
+		}
+		for (int field = 0; field < NumBandFields; ++field)
+		{
+			if (values[field] == bandShown[band][field]) continue;
+			bandShown[band][field] = values[field];
+			juce::RangedAudioParameter* param = bandParams[band][field];
+			float normalised = param->convertTo0to1(values[field]);
+			if (std::abs(normalised - param->getValue()) < 1.0e-5f) continue;
+			param->beginChangeGesture();
+			param->setValueNotifyingHost(normalised);
+			param->endChangeGesture();
+		}
+	}
+	syncingParams = false;
+}
+
+void LModelAudioProcessor::syncTransport()
+{
+	double bpm = 120.0, ppq = -1.0;
+	bool playing = false;
+	if (auto* playHead = getPlayHead())
+	{
+		if (auto position = playHead->getPosition())
+		{
+			bpm = position->getBpm().orFallback(120.0);
+			ppq = position->getPpqPosition().orFallback(-1.0);
+			playing = position->getIsPlaying();
+		}
+	}
+	eq.SetTransport(bpm, ppq, playing);
+}
+
+void LModelAudioProcessor::scheduleMidi(const juce::MidiBuffer& midiMessages)
+{
+	for (const auto metadata : midiMessages)
+	{
+		const auto msg = metadata.getMessage();
+		if (msg.isNoteOn())
+			eq.ScheduleNote(metadata.samplePosition, msg.getNoteNumber(), true);
+		else if (msg.isNoteOff())
+			eq.ScheduleNote(metadata.samplePosition, msg.getNoteNumber(), false);
+		else if (msg.isAllNotesOff() || msg.isAllSoundOff())
+			eq.ScheduleNote(metadata.samplePosition, -1, false);
+	}
+}
+
+void LModelAudioProcessor::updateTrackProperties(const TrackProperties& properties)
+{
+	analyzer.setBusName(properties.name.value_or(juce::String()));
 }
 
 //==============================================================================
@@ -103,7 +274,13 @@ void LModelAudioProcessor::changeProgramName(int index, const juce::String& newN
 //==============================================================================
 void LModelAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-	eq.SetSampleRate(sampleRate);
+	eq.Prepare(sampleRate, samplesPerBlock);
+	analyzer.setSampleRate(sampleRate);
+	zoom.SetSampleRate(sampleRate);
+	meters.SetSampleRate(sampleRate);
+	monoRightF.setSize(1, samplesPerBlock);
+	monoRightD.setSize(1, samplesPerBlock);
+	setLatencySamples(eq.GetLatencySamples());
 }
 
 void LModelAudioProcessor::releaseResources()
@@ -131,8 +308,22 @@ bool LModelAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts) co
 #if ! JucePlugin_IsSynth
 	if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
 		return false;
+
+	// 侧链可以关掉, 开着时单声道或立体声
+	auto sidechain = layouts.getChannelSet(true, 1);
+	if (!sidechain.isDisabled() && sidechain != juce::AudioChannelSet::mono()
+		&& sidechain != juce::AudioChannelSet::stereo())
+		return false;
 #endif
 
+	// 分频的各段输出可以关掉, 开着时立体声
+	for (int bus = 1; bus < layouts.outputBuses.size(); ++bus)
+	{
+		auto band = layouts.getChannelSet(false, bus);
+		if (!band.isDisabled() && band != juce::AudioChannelSet::stereo())
+			return false;
+	}
+
 	return true;
 #endif
 }
@@ -141,33 +332,65 @@ bool LModelAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts) co
 
 void LModelAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-	int isMidiUpdata = 0;
-	juce::MidiMessage MidiMsg;//ȴmidi¼
-	int MidiTime;
-	juce::MidiBuffer::Iterator MidiBuf(midiMessages);
-	while (MidiBuf.getNextEvent(MidiMsg, MidiTime))
-	{
-		if (MidiMsg.isNoteOn())
-		{
-			int note = MidiMsg.getNoteNumber() - 24;
-		}
-		if (MidiMsg.isNoteOff())
-		{
-			int note = MidiMsg.getNoteNumber() - 24;
-		}
-	}
+	scheduleMidi(midiMessages);//先处理midi事件
 	midiMessages.clear();
+	scheduleAutomation(buffer.getNumSamples());
 
 	const int numSamples = buffer.getNumSamples();
-	float* wavbufl = buffer.getWritePointer(0);
-	float* wavbufr = buffer.getWritePointer(1);
-	const float* recbufl = buffer.getReadPointer(0);
-	const float* recbufr = buffer.getReadPointer(1);
+	float* wavbufl = nullptr;
+	float* wavbufr = nullptr;
+	const float* recbufl = nullptr;
+	const float* recbufr = nullptr;
+	getMainBus(buffer, monoRightF, recbufl, recbufr, wavbufl, wavbufr);
+
+	const float* keybufl = nullptr;
+	const float* keybufr = nullptr;
+	getSidechain(buffer, keybufl, keybufr);
 
 	float SampleRate = getSampleRate();
 
-	eq.ProcessBlock(recbufl, recbufr, wavbufl, wavbufr, numSamples);
-	analyzer.processBlock(recbufl, recbufr, numSamples);
+	// 线性相位模式切换后通知宿主新的延迟
+	int latency = eq.GetLatencySamples();
+	if (latency != getLatencySamples())
+		setLatencySamples(latency);
+
+	syncTransport();
+	meters.ProcessInput(recbufl, recbufr, numSamples);
+	eq.ProcessBlock(recbufl, recbufr, wavbufl, wavbufr, numSamples, keybufl, keybufr);
+	meters.ProcessOutput(wavbufl, wavbufr, numSamples);
+	analyzer.processBlock(recbufl, recbufr, keybufl, keybufr, numSamples);
+	zoom.ProcessBlock(recbufl, recbufr, numSamples);
+	processCrossover(buffer, wavbufl, wavbufr);//分频输出和侧链输入共用通道, 放在最后
+}
+
+void LModelAudioProcessor::processBlock(juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+	scheduleMidi(midiMessages);
+	midiMessages.clear();
+	scheduleAutomation(buffer.getNumSamples());
+
+	const int numSamples = buffer.getNumSamples();
+	double* wavbufl = nullptr;
+	double* wavbufr = nullptr;
+	const double* recbufl = nullptr;
+	const double* recbufr = nullptr;
+	getMainBus(buffer, monoRightD, recbufl, recbufr, wavbufl, wavbufr);
+
+	const double* keybufl = nullptr;
+	const double* keybufr = nullptr;
+	getSidechain(buffer, keybufl, keybufr);
+
+	int latency = eq.GetLatencySamples();
+	if (latency != getLatencySamples())
+		setLatencySamples(latency);
+
+	syncTransport();
+	meters.ProcessInput(recbufl, recbufr, numSamples);
+	eq.ProcessBlock(recbufl, recbufr, wavbufl, wavbufr, numSamples, keybufl, keybufr);
+	meters.ProcessOutput(wavbufl, wavbufr, numSamples);
+	analyzer.processBlock(recbufl, recbufr, keybufl, keybufr, numSamples);
+	zoom.ProcessBlock(recbufl, recbufr, numSamples);
+	processCrossover(buffer, wavbufl, wavbufr);//分频输出和侧链输入共用通道, 放在最后
 }
 
 //==============================================================================
@@ -180,60 +403,22 @@ juce::AudioProcessorEditor* LModelAudioProcessor::createEditor()
 {
 	return new LModelAudioProcessorEditor(*this);
 
-	//return new juce::GenericAudioProcessorEditor(*this);//Զ()
+	//return new juce::GenericAudioProcessorEditor(*this);//自动绘制(调试)
 }
 
 //==============================================================================
 void LModelAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
 {
-	// ValueTree洢в״̬
-	juce::ValueTree state("EqualizerPlugin");
-
-	// 2ʹValueTreeṹ洢Ƽ
-	juce::ValueTree eqState("Equalizer");
-	eqState.setProperty("sampleRate", eq.GetSampleRate(), nullptr);
-
-	auto activeIds = eq.GetActiveNodeIds();
-	eqState.setProperty("nodeCount", static_cast<int>(activeIds.size()), nullptr);
-
-	for (int i = 0; i < activeIds.size(); ++i) {
-		int nodeId = activeIds[i];
-		const auto& node = eq.GetNode(nodeId);
-
-		juce::ValueTree nodeTree("Node" + juce::String(i));
-		nodeTree.setProperty("mode", node.mode, nullptr);
-		nodeTree.setProperty("cutoff", node.cutoff, nullptr);
-		nodeTree.setProperty("q", node.q, nullptr);
-		nodeTree.setProperty("gainDB", node.gainDB, nullptr);
-		nodeTree.setProperty("active", node.active, nullptr);
-
-		eqState.appendChild(nodeTree, nullptr);
-	}
-
-	state.appendChild(eqState, nullptr);
-
-	// Ҳ
-	// 磺
-	// if (auto* params = getParameters())
-	// {
-	//     for (auto* param : *params)
-	//     {
-	//         if (auto* p = dynamic_cast<juce::AudioParameterFloat*>(param))
-	//         {
-	//             state.setProperty(p->getParameterID(), p->get(), nullptr);
-	//         }
-	//     }
-	// }
-
-	// ValueTreeдMemoryBlock
-	std::unique_ptr<juce::XmlElement> xml(state.createXml());
-	copyXmlToBinary(*xml, destData);
+	// 二进制定长记录, 附带已经设计好的系数, 格式见Equalizer::SerializeToBinary
+	eq.SerializeToBinary(destData);
 }
 
 void LModelAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
 {
+	if (eq.DeserializeFromBinary(data, sizeInBytes))
+		return;
 
-	// MemoryBlockȡXML
+	// 旧版本保存的XML
 	std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
 
 	if (xmlState != nullptr)
@@ -242,52 +427,45 @@ void LModelAudioProcessor::setStateInformation(const void* data, int sizeInBytes
 		{
 			juce::ValueTree state = juce::ValueTree::fromXml(*xmlState);
 
-			// 2ValueTreeṹȡƼ
 			juce::ValueTree eqState = state.getChildWithName("Equalizer");
 			if (eqState.isValid())
 			{
-				float sampleRate = eqState.getProperty("sampleRate", 48000.0f);
+				// 保存时的采样率(sampleRate属性)不用: 节点按正在运行的采样率设计
 				int nodeCount = eqState.getProperty("nodeCount", 0);
 
-				// EQ
-				eq.Clear();
-				eq.SetSampleRate(sampleRate);
+				// 子节点按Node0, Node1...的顺序保存, 顺序遍历一遍即可
+				auto readNode = [](const juce::ValueTree& nodeTree) -> FilterNode {
+					return { nodeTree.getProperty("mode", MODE_PEAKING), nodeTree.getProperty("cutoff", 1000.0f),
+						nodeTree.getProperty("q", 0.707f), nodeTree.getProperty("gainDB", 0.0f),
+						nodeTree.getProperty("active", true) };
+				};
+				std::vector<FilterNode> nodes;
+				nodes.reserve(nodeCount);
+				for (int i = 0; i < eqState.getNumChildren() && (int)nodes.size() < nodeCount; ++i)
+				{
+					juce::ValueTree nodeTree = eqState.getChild(i);
+					if (!nodeTree.getType().toString().startsWith("Node")) continue;
+					FilterNode node = readNode(nodeTree);
+					if (node.active) nodes.push_back(node);
+				}
+
+				eq.SetPhaseMode(eqState.getProperty("phaseMode", PHASE_MINIMUM));
+				eq.SetAutoEngine(eqState.getProperty("autoEngine", true));
+				eq.LoadNodes(nodes);
 
-				// ؽнڵ
-				for (int i = 0; i < nodeCount; ++i)
+				juce::ValueTree snapshot = eqState.getChildWithName("Snapshot");
+				if (snapshot.isValid())
 				{
-					juce::ValueTree nodeTree = eqState.getChildWithName("Node" + juce::String(i));
-					if (nodeTree.isValid())
-					{
-						int mode = nodeTree.getProperty("mode", MODE_PEAKING);
-						float cutoff = nodeTree.getProperty("cutoff", 1000.0f);
-						float q = nodeTree.getProperty("q", 0.707f);
-						float gainDB = nodeTree.getProperty("gainDB", 0.0f);
-						bool active = nodeTree.getProperty("active", false);
-
-						if (active)
-						{
-							eq.AddNode(mode, cutoff, q, gainDB);
-						}
-					}
+					std::vector<FilterNode> otherNodes;
+					for (int i = 0; i < snapshot.getNumChildren(); ++i)
+						otherNodes.push_back(readNode(snapshot.getChild(i)));
+					eq.SetOtherSnapshot(otherNodes);
+				}
+				else
+				{
+					eq.EndCompare();
 				}
 			}
-
-			// Ҳָ
-			// 磺
-			// if (auto* params = getParameters())
-			// {
-			//     for (auto* param : *params)
-			//     {
-			//         if (auto* p = dynamic_cast<juce::AudioParameterFloat*>(param))
-			//         {
-			//             if (state.hasProperty(p->getParameterID()))
-			//             {
-			//                 *p = state.getProperty(p->getParameterID());
-			//             }
-			//         }
-			//     }
-			// }
 		}
 	}
 
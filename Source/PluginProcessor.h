@@ -11,11 +11,13 @@
 #include <JuceHeader.h>
 #include "dsp/equalizer.h"
 #include "dsp/spectrum1d.h"
+#include "dsp/zoomfft.h"
+#include "dsp/bandmeter.h"
 
 //==============================================================================
 /**
 */
-class LModelAudioProcessor : public juce::AudioProcessor
+class LModelAudioProcessor : public juce::AudioProcessor, juce::Timer, juce::AudioProcessorValueTreeState::Listener
 {
 public:
 
@@ -33,6 +35,8 @@ public:
 #endif
 
 	void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+	void processBlock(juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+	bool supportsDoublePrecisionProcessing() const override { return true; }
 
 	//==============================================================================
 	juce::AudioProcessorEditor* createEditor() override;
@@ -57,6 +61,8 @@ public:
 	void getStateInformation(juce::MemoryBlock& destData) override;
 	void setStateInformation(const void* data, int sizeInBytes) override;
 
+	void updateTrackProperties(const TrackProperties& properties) override;//轨道名用于频谱总线
+
 	//==============================================================================
 	juce::AudioProcessorValueTreeState& GetParams()
 	{
@@ -65,10 +71,96 @@ public:
 
 	Equalizer eq;
 	Spectrum1d analyzer;
+	ZoomAnalyzer zoom;//选中节点附近的放大频谱
+	BandMeterBank meters;//每个节点附近EQ前后的电平
 
 private:
 	//Synth Param
 	static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+	void timerCallback() override;//自动化后的节点值写回节点和参数, 音频线程原地换不了的系数在这里重新发布
+	void syncTransport();//宿主的速度和位置交给调制的同步LFO
+	void scheduleMidi(const juce::MidiBuffer& midiMessages);//音符按时间点交给音高跟踪
+
+	// 宿主自动化: 前NumBandParams个节点各有一组参数, 段号就是节点id
+	// 音频线程来的变化只记下是哪一段, 下一块开头作为事件交给eq, 在eq里切子块逼近
+	// 消息线程来的变化(通用编辑器, 停止时的宿主)直接写进节点; 界面改了节点由定时器写回参数
+	static constexpr int NumBandParams = 32;
+	enum BandField {
+		BAND_ACTIVE = 0,
+		BAND_MODE,
+		BAND_CUTOFF,
+		BAND_Q,
+		BAND_GAIN,
+		NumBandFields
+	};
+	static juce::String getBandParamId(int band, int field);
+	void parameterChanged(const juce::String& parameterID, float newValue) override;
+	void scheduleAutomation(int numSamples);//音频线程: 本块改过的段交给eq
+	void applyBandParams(int band);//消息线程: 一段的参数写进节点
+	void syncBandParams();//消息线程: 节点变了(界面或自动化写回)就更新参数
+
+	juce::RangedAudioParameter* bandParams[NumBandParams][NumBandFields] = {};
+	std::atomic<float>* bandValues[NumBandParams][NumBandFields] = {};
+	std::atomic<bool> bandDirty[NumBandParams] = {};//音频线程改过, 下一块交给eq
+	std::atomic<bool> bandToggled[NumBandParams] = {};//音频线程开关过, 由消息线程增删节点
+	float bandShown[NumBandParams][NumBandFields] = {};//消息线程: 节点和参数上次对上时的值
+	bool syncingParams = false;//消息线程正在把节点写回参数, 不再反过来写节点
+
+	// 主总线的左右声道, 按总线取, 不按缓冲区的通道号取(单声道主总线时通道1属于侧链或分频输出)
+	// 单声道时右声道是monoRight里的一份输入拷贝, 照立体声处理后丢掉; eq的左右声道不能是同一块内存
+	template <typename T>
+	void getMainBus(juce::AudioBuffer<T>& buffer, juce::AudioBuffer<T>& monoRight,
+		const T*& inL, const T*& inR, T*& outL, T*& outR)
+	{
+		auto input = getBusBuffer(buffer, true, 0);
+		auto output = getBusBuffer(buffer, false, 0);
+		inL = input.getReadPointer(0);
+		outL = output.getWritePointer(0);
+		if (output.getNumChannels() > 1)
+		{
+			inR = input.getReadPointer(input.getNumChannels() > 1 ? 1 : 0);
+			outR = output.getWritePointer(1);
+			return;
+		}
+		int numSamples = buffer.getNumSamples();
+		monoRight.setSize(1, numSamples, false, false, true);//prepareToPlay已分配, 宿主给的块更长时才重新分配
+		monoRight.copyFrom(0, 0, input, 0, 0, numSamples);
+		inR = outR = monoRight.getWritePointer(0);
+	}
+
+	// 侧链总线开着时取出它的左右声道(单声道时两边相同), 否则为空
+	template <typename T>
+	void getSidechain(juce::AudioBuffer<T>& buffer, const T*& keyL, const T*& keyR)
+	{
+		keyL = keyR = nullptr;
+		if (getBusCount(true) < 2 || getChannelCountOfBus(true, 1) == 0) return;
+		auto sidechain = getBusBuffer(buffer, true, 1);
+		keyL = sidechain.getReadPointer(0);
+		keyR = sidechain.getReadPointer(sidechain.getNumChannels() > 1 ? 1 : 0);
+	}
+
+	// 开着的分频输出总线(第k + 1条输出是第k段)交给eq写入, 都关着时不做分频
+	// 单声道主总线时outR是monoRight, 不会和分频输出(也不会和侧链输入)占同一个通道
+	template <typename T>
+	void processCrossover(juce::AudioBuffer<T>& buffer, const T* outL, const T* outR)
+	{
+		T* bandL[Crossover::MaxBands] = {};
+		T* bandR[Crossover::MaxBands] = {};
+		int numOutputs = 0;
+		for (int k = 0; k < Crossover::MaxBands && k + 1 < getBusCount(false); ++k)
+		{
+			if (getChannelCountOfBus(false, k + 1) < 2) continue;
+			auto band = getBusBuffer(buffer, false, k + 1);
+			bandL[k] = band.getWritePointer(0);
+			bandR[k] = band.getWritePointer(1);
+			numOutputs = k + 1;
+		}
+		if (numOutputs > 0) eq.ProcessCrossover(outL, outR, bandL, bandR, numOutputs, buffer.getNumSamples());
+	}
+
+	juce::AudioBuffer<float> monoRightF;//单声道主总线时的右声道
+	juce::AudioBuffer<double> monoRightD;
+
 	juce::AudioProcessorValueTreeState Params{ *this, nullptr, "Parameters", createParameterLayout() };
 
 
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include "fft.h"
+
+// 进程内所有实例共用的分析线程池: 线程数跟着CPU核数走, 不跟实例数走
+// 音频线程只把待分析的帧放进各自的队列(满了就丢), 工作线程轮询所有实例,
+// 按优先级取帧, 把同样长度的帧凑成一批做FFT, 结果交回实例累加和出帧
+class AnalysisClient
+{
+public:
+	virtual ~AnalysisClient() = default;
+
+	virtual int GetFFTSize() const = 0;
+	// 数值大的先处理: 交互中的放大分析 > 自己的界面在看 > 只有别的实例在看
+	virtual int GetPriority() const = 0;
+	virtual int GetNumPending() const = 0;
+	// 工作线程: 把第k个待处理帧(加好窗)写进re/im, 实信号的im填0
+	virtual void FillFrame(int k, float* re, float* im) = 0;
+	// 工作线程: 前count个帧的FFT结果, 按顺序处理后出队
+	virtual void ConsumeFrames(int count, float* const* re, float* const* im) = 0;
+
+private:
+	friend class AnalysisPool;
+	std::atomic<bool> busy{ false };//同一个实例同时只交给一个工作线程
+};
+
+class AnalysisPool
+{
+public:
+	static constexpr int BatchSize = 4;//一批最多几个帧, 和FFT的通道数一致
+	static constexpr int MaxWorkers = 4;
+	static constexpr int PollIntervalMs = 4;//音频线程不发信号, 工作线程空闲时按这个间隔轮询
+
+	AnalysisPool() = default;
+
+	~AnalysisPool()
+	{
+		for (auto& w : workers)
+			w->stopThread(1000);
+	}
+
+	// 消息线程: 第一次登记时才启动线程
+	void Register(AnalysisClient* client)
+	{
+		{
+			juce::ScopedLock lock(clientsLock);
+			clients.push_back(client);
+		}
+		StartWorkers();
+	}
+
+	// 消息线程: 返回后工作线程不会再碰这个实例
+	void Unregister(AnalysisClient* client)
+	{
+		{
+			juce::ScopedLock lock(clientsLock);
+			clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+		}
+		while (client->busy.load(std::memory_order_acquire))
+			juce::Thread::yield();
+	}
+
+	int GetNumWorkers() const { return (int)workers.size(); }
+
+	// 分析的线程数: 核数的四分之一, 至少一个
+	static int GetWorkerCountForCpus(int numCpus)
+	{
+		return juce::jlimit(1, MaxWorkers, numCpus / 4);
+	}
+
+private:
+	class Worker : public juce::Thread
+	{
+	public:
+		Worker(AnalysisPool& p) : juce::Thread("LMEQ Analysis"), pool(p) {}
+		~Worker() override { stopThread(1000); }
+		void run() override { pool.RunWorker(*this); }
+
+	private:
+		AnalysisPool& pool;
+	};
+
+	struct BatchItem
+	{
+		AnalysisClient* client;
+		int count;
+	};
+
+	void StartWorkers()
+	{
+		juce::ScopedLock lock(workersLock);
+		if (!workers.empty()) return;
+		int n = GetWorkerCountForCpus(juce::SystemStats::getNumCpus());
+		for (int i = 0; i < n; ++i)
+		{
+			workers.push_back(std::make_unique<Worker>(*this));
+			workers.back()->startThread(juce::Thread::Priority::low);
+		}
+	}
+
+	// 在锁内挑一批: 先按优先级, 同优先级从上次的位置往后轮, 只凑同样长度的帧
+	int GatherBatch(std::vector<BatchItem>& batch, int& fftSize)
+	{
+		juce::ScopedLock lock(clientsLock);
+		batch.clear();
+		fftSize = 0;
+		int lanes = 0;
+		int n = (int)clients.size();
+		if (n == 0) return 0;
+		int start = (int)(nextClient++ % (unsigned int)n);
+
+		int topPriority = -1;
+		for (auto* c : clients)
+			if (!c->busy.load(std::memory_order_relaxed) && c->GetNumPending() > 0)
+				topPriority = std::max(topPriority, c->GetPriority());
+
+		for (int priority = topPriority; priority >= 0 && lanes < BatchSize; --priority)
+		{
+			for (int i = 0; i < n && lanes < BatchSize; ++i)
+			{
+				AnalysisClient* c = clients[(start + i) % n];
+				if (c->GetPriority() != priority) continue;
+				int pending = c->GetNumPending();
+				if (pending <= 0) continue;
+				if (fftSize != 0 && c->GetFFTSize() != fftSize) continue;
+				bool expected = false;
+				if (!c->busy.compare_exchange_strong(expected, true, std::memory_order_acquire)) continue;
+				fftSize = c->GetFFTSize();
+				int take = std::min(pending, BatchSize - lanes);
+				batch.push_back({ c, take });
+				lanes += take;
+			}
+		}
+		return lanes;
+	}
+
+	void RunWorker(juce::Thread& thread)
+	{
+		std::vector<BatchItem> batch;
+		std::vector<float> re[BatchSize], im[BatchSize];
+		float* rePtr[BatchSize];
+		float* imPtr[BatchSize];
+		FFT<FloatLanes<BatchSize>> fft;
+
+		while (!thread.threadShouldExit())
+		{
+			int fftSize = 0;
+			int lanes = GatherBatch(batch, fftSize);
+			if (lanes == 0)
+			{
+				thread.wait(PollIntervalMs);
+				continue;
+			}
+
+			for (int l = 0; l < BatchSize; ++l)
+			{
+				if ((int)re[l].size() < fftSize)
+				{
+					re[l].resize(fftSize);
+					im[l].resize(fftSize);
+				}
+				rePtr[l] = re[l].data();
+				imPtr[l] = im[l].data();
+			}
+
+			int lane = 0;
+			for (auto& item : batch)
+			{
+				for (int k = 0; k < item.count; ++k, ++lane)
+				{
+					item.client->FillFrame(k, rePtr[lane], imPtr[lane]);
+				}
+			}
+
+			// 只有一帧时打包不划算, 直接做标量变换
+			if (lanes == 1) fft_f32(rePtr[0], imPtr[0], fftSize, 1);
+			else fft.fft_batch(rePtr, imPtr, lanes, fftSize, 1);
+
+			lane = 0;
+			for (auto& item : batch)
+			{
+				item.client->ConsumeFrames(item.count, rePtr + lane, imPtr + lane);
+				lane += item.count;
+				item.client->busy.store(false, std::memory_order_release);
+			}
+		}
+	}
+
+	juce::CriticalSection clientsLock;
+	std::vector<AnalysisClient*> clients;
+	unsigned int nextClient = 0;
+
+	juce::CriticalSection workersLock;
+	std::vector<std::unique_ptr<Worker>> workers;
+};
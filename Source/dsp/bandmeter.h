@@ -0,0 +1,211 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include "mailbox.h"
+
+// 每个节点附近的能量表: 在节点的cutoff上放一个复数单极点谐振器(指数窗的滑动DFT), 带宽取cutoff / q
+// y[n] = r * e^(jw) * y[n-1] + x[n], 正弦幅度 ≈ 2 * (1 - r) * |y|
+// 所有频带按结构数组排开, 逐样本的内层循环跨频带, 编译器直接向量化; 只算少数几个频率时比整个FFT便宜得多
+// 同时测EQ前(pre)和EQ后(post)
+class BandMeterBank
+{
+public:
+	static constexpr int MaxBands = 64;
+	static constexpr int LaneAlign = 8;
+	static constexpr float MinBandwidth = 1.0f;
+	static constexpr float FloorDB = -120.0f;
+
+	struct Band
+	{
+		int id;
+		float cutoff;
+		float q;
+
+		bool operator==(const Band& o) const { return id == o.id && cutoff == o.cutoff && q == o.q; }
+	};
+
+	BandMeterBank()
+	{
+		for (int i = 0; i < MaxBands; ++i)
+		{
+			preDB[i].store(FloorDB);
+			postDB[i].store(FloorDB);
+		}
+	}
+
+	// prepareToPlay调用
+	void SetSampleRate(double sr)
+	{
+		sampleRate = (float)sr;
+		std::vector<Band> list = bands;
+		bands.clear();
+		SetBands(list);
+	}
+
+	// 消息线程: 频带列表变了才重新发布, 返回这组频带的编号, 读电平时对照用
+	int SetBands(const std::vector<Band>& list)
+	{
+		if (list == bands) return generation;
+		bands = list;
+		if ((int)bands.size() > MaxBands) bands.resize(MaxBands);
+
+		auto* set = new MeterSet();
+		set->generation = ++generation;
+		set->numBands = (int)bands.size();
+		int padded = (set->numBands + LaneAlign - 1) / LaneAlign * LaneAlign;
+		set->Allocate(padded);
+		for (int i = 0; i < set->numBands; ++i)
+		{
+			float bw = juce::jlimit(MinBandwidth, sampleRate * 0.25f, bands[i].cutoff / std::max(bands[i].q, 0.01f));
+			float r = std::exp(-juce::MathConstants<float>::pi * bw / sampleRate);
+			float w = 2.0f * juce::MathConstants<float>::pi * bands[i].cutoff / sampleRate;
+			set->cr[i] = r * std::cos(w);
+			set->ci[i] = r * std::sin(w);
+			set->norm[i] = 2.0f * (1.0f - r);
+		}
+		sets.Publish(set);
+		return generation;
+	}
+
+	// 消息线程: 界面可见时才测
+	void SetActive(bool shouldRun) { active.store(shouldRun); }
+	bool IsActive() const { return active.load(); }
+
+	// 音频线程: EQ处理之前调用, 顺便接管新的频带设置
+	template <typename T>
+	void ProcessInput(const T* inL, const T* inR, int numSamples)
+	{
+		if (MeterSet* next = sets.Take())
+		{
+			sets.Retire(current);
+			current = next;
+			for (int i = 0; i < MaxBands; ++i)
+			{
+				preDB[i].store(FloorDB, std::memory_order_relaxed);
+				postDB[i].store(FloorDB, std::memory_order_relaxed);
+			}
+			adopted.store(current->generation, std::memory_order_release);
+		}
+		if (IsRunning(numSamples))
+			Measure(*current, current->pre, preDB, inL, inR, numSamples);
+	}
+
+	// 音频线程: EQ处理之后调用(EQ是原地处理的, 输入已经被覆盖)
+	template <typename T>
+	void ProcessOutput(const T* outL, const T* outR, int numSamples)
+	{
+		if (IsRunning(numSamples))
+			Measure(*current, current->post, postDB, outL, outR, numSamples);
+	}
+
+	// 消息线程: 读出上次读取以来的最大电平(正弦幅度的dB), 频带编号对不上时返回false
+	bool ReadLevels(int expectedGeneration, std::vector<float>& pre, std::vector<float>& post)
+	{
+		if (adopted.load(std::memory_order_acquire) != expectedGeneration) return false;
+		int n = (int)bands.size();
+		pre.resize(n);
+		post.resize(n);
+		for (int i = 0; i < n; ++i)
+		{
+			pre[i] = preDB[i].exchange(FloorDB, std::memory_order_relaxed);
+			post[i] = postDB[i].exchange(FloorDB, std::memory_order_relaxed);
+		}
+		return true;
+	}
+
+	// 音频线程不运行时调用
+	void Release()
+	{
+		sets.Clear();
+		delete current;
+		current = nullptr;
+	}
+
+	~BandMeterBank() { Release(); }
+
+private:
+	// 谐振器状态和这一块的能量累加
+	struct Resonators
+	{
+		std::vector<float> re, im, acc;
+	};
+
+	struct MeterSet
+	{
+		int generation = 0;
+		int numBands = 0;
+		int padded = 0;
+		std::vector<float> cr, ci, norm;
+		Resonators pre, post;
+
+		void Allocate(int n)
+		{
+			padded = n;
+			for (auto* v : { &cr, &ci, &norm, &pre.re, &pre.im, &pre.acc, &post.re, &post.im, &post.acc })
+				v->assign(n, 0.0f);
+		}
+	};
+
+	bool IsRunning(int numSamples) const
+	{
+		return current != nullptr && current->numBands > 0 && numSamples > 0 && active.load(std::memory_order_relaxed);
+	}
+
+	template <typename T>
+	static void Measure(MeterSet& s, Resonators& res, std::atomic<float>* levels, const T* inL, const T* inR, int numSamples)
+	{
+		std::fill(res.acc.begin(), res.acc.end(), 0.0f);
+		for (int t = 0; t < numSamples; ++t)
+		{
+			// 加一点点直流, 静音时谐振器状态和它的平方都不会掉进非规格化数
+			float x = (float)(inL[t] + inR[t]) * 0.5f + 1e-15f;
+			Resonate(s.cr.data(), s.ci.data(), res.re.data(), res.im.data(), res.acc.data(), x, s.padded);
+		}
+
+		// 一块出一个电平, 界面两次读之间保留最大值
+		float invN = 1.0f / (float)numSamples;
+		for (int i = 0; i < s.numBands; ++i)
+			StoreMax(levels[i], ToDB(s.norm[i] * std::sqrt(res.acc[i] * invN)));
+	}
+
+	// 跨频带的一步递推, n是LaneAlign的整数倍
+	static void Resonate(const float* cr, const float* ci, float* re, float* im, float* acc, float x, int n)
+	{
+		for (int b = 0; b < n; ++b)
+		{
+			float nr = cr[b] * re[b] - ci[b] * im[b] + x;
+			float ni = cr[b] * im[b] + ci[b] * re[b];
+			re[b] = nr;
+			im[b] = ni;
+			acc[b] += nr * nr + ni * ni;
+		}
+	}
+
+	static float ToDB(float amplitude)
+	{
+		return amplitude > 1e-6f ? 20.0f * std::log10(amplitude) : FloorDB;
+	}
+
+	static void StoreMax(std::atomic<float>& level, float value)
+	{
+		if (value > level.load(std::memory_order_relaxed))
+			level.store(value, std::memory_order_relaxed);
+	}
+
+	// 消息线程
+	float sampleRate = 48000.0f;
+	std::vector<Band> bands;
+	int generation = 0;
+
+	LatestMailbox<MeterSet> sets;
+	std::atomic<bool> active{ false };
+	std::atomic<int> adopted{ 0 };
+	std::atomic<float> preDB[MaxBands];
+	std::atomic<float> postDB[MaxBands];
+
+	// 音频线程
+	MeterSet* current = nullptr;
+};
@@ -3,6 +3,7 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <utility>
+#include <complex>
 
 #define MaxBiquadStages 24 //最多12+1个Biquad串联
 struct BiquadCoeffs
@@ -65,23 +66,54 @@ struct BiquadCoeffs
 	}
 };
 
+// 直接II型转置(TDF2), 包括附加级
 class Biquad
 {
 private:
 	BiquadCoeffs coeffs;
-	float z1 = 0.0f, z2 = 0.0f;
+	float s1 = 0.0f, s2 = 0.0f;
+	float s1s[MaxBiquadStages] = {}, s2s[MaxBiquadStages] = {};
 public:
+	// 单级TDF2, StageBank的直接型内核也用它
+	static inline float Tick(float in, float b0, float b1, float b2, float a1, float a2, float& s1, float& s2)
+	{
+		float out = b0 * in + s1;
+		s1 = b1 * in - a1 * out + s2;
+		s2 = b2 * in - a2 * out;
+		return out;
+	}
 	Biquad() {}
 	void SetCoeffs(const BiquadCoeffs& c) { coeffs = c; }
 	float ProcessSample(float in)
 	{
-		float out = coeffs.b0 * in + coeffs.b1 * z1 + coeffs.b2 * z2 - coeffs.a1 * z1 - coeffs.a2 * z2;
-		z2 = z1;
-		z1 = out;
+		float out = Tick(in, coeffs.b0, coeffs.b1, coeffs.b2, coeffs.a1, coeffs.a2, s1, s2);
+		for (int i = 0; i < coeffs.numStages; ++i)
+			out = Tick(out, coeffs.b0s[i], coeffs.b1s[i], coeffs.b2s[i], coeffs.a1s[i], coeffs.a2s[i], s1s[i], s2s[i]);
 		return out;
 	}
 };
 
+// 整条级联的频率响应, w为归一化频率(1.0 = 奈奎斯特)
+static inline std::complex<float> BiquadTransferFunction(const BiquadCoeffs& coeffs, float w)
+{
+	w *= M_PI;
+	std::complex<double> z{ cosf(w), sinf(w) };
+	std::complex<double> z2 = z * z;
+	std::complex<double> numerator = (double)coeffs.b0 + (double)coeffs.b1 * z + (double)coeffs.b2 * z2;
+	std::complex<double> denominator = 1.0 + (double)coeffs.a1 * z + (double)coeffs.a2 * z2;
+	std::complex<double> hnum = numerator;
+	std::complex<double> hden = denominator;
+	for (int i = 0; i < coeffs.numStages; ++i)
+	{
+		numerator = (double)coeffs.b0s[i] + (double)coeffs.b1s[i] * z + (double)coeffs.b2s[i] * z2;
+		denominator = 1.0 + (double)coeffs.a1s[i] * z + (double)coeffs.a2s[i] * z2;
+		hnum *= numerator;
+		hden *= denominator;
+	}
+	hnum = hnum / hden;
+	return { (float)hnum.real(),(float)hnum.imag() };
+}
+
 class BiquadDesigner
 {
 private:
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string.h>
+#include "biquad.h"
+
+// 进程内所有实例共享的系数缓存, 同一个(模式, 频率, Q, 增益, 采样率)只设计、只存一份
+// 各实例只持有句柄, 滤波器状态仍在各自的级联里
+// 固定大小的开放寻址表, 条目预先分配且不释放, 所以查找时读条目不会碰到已释放的内存
+// 条目的引用计数: >0 有人在用; 0 空闲但内容仍可命中; -1 正在改写. 查找和改写都只用CAS
+struct CoeffKey
+{
+	int mode;
+	float cutoff, q, gainDB, sampleRate;
+
+	bool operator==(const CoeffKey& o) const
+	{
+		return mode == o.mode && cutoff == o.cutoff && q == o.q && gainDB == o.gainDB && sampleRate == o.sampleRate;
+	}
+};
+
+class CoeffHandle;
+
+class CoeffCache
+{
+public:
+	static constexpr int NumSlots = 2048;//2048 * 约520字节, 整个进程共用
+	static constexpr int MaxProbe = 16;
+
+	struct Entry
+	{
+		std::atomic<int> refs{ 0 };
+		bool used = false;
+		CoeffKey key{};
+		BiquadCoeffs coeffs;
+	};
+
+	CoeffCache() : slots(NumSlots) {}
+
+	// 命中直接共享; 没命中就调用design设计, 再放进空闲条目(表满时句柄自己持有一份)
+	template <typename Fn>
+	CoeffHandle Get(const CoeffKey& key, Fn&& design);
+
+	// 已经有系数(比如从保存的状态读出)时登记进缓存, 相同的键已存在就共享已有的那份
+	CoeffHandle Intern(const CoeffKey& key, const BiquadCoeffs& coeffs);
+
+	// 命中/设计次数, 调试和界面显示用
+	int GetNumHits() const { return hits; }
+	int GetNumDesigns() const { return designs; }
+
+private:
+	std::vector<Entry> slots;
+	std::atomic<int> hits{ 0 };
+	std::atomic<int> designs{ 0 };
+
+	static unsigned int Hash(const CoeffKey& key)
+	{
+		// FNV-1a, 对-0.0和0.0区分不影响正确性, 只是多存一份
+		unsigned int h = 2166136261u;
+		const float fields[4] = { key.cutoff, key.q, key.gainDB, key.sampleRate };
+		unsigned int words[5];
+		words[0] = (unsigned int)key.mode;
+		memcpy(words + 1, fields, sizeof(fields));
+		for (unsigned int w : words)
+		{
+			for (int b = 0; b < 4; ++b)
+			{
+				h ^= (w >> (b * 8)) & 0xffu;
+				h *= 16777619u;
+			}
+		}
+		return h;
+	}
+
+	// 引用计数>=0时加一把条目钉住, 钉住之后key和系数不会被改写
+	static bool Pin(Entry& e)
+	{
+		int r = e.refs.load(std::memory_order_acquire);
+		while (r >= 0)
+		{
+			if (e.refs.compare_exchange_weak(r, r + 1, std::memory_order_acquire)) return true;
+		}
+		return false;
+	}
+
+	Entry* Find(const CoeffKey& key)
+	{
+		unsigned int h = Hash(key);
+		for (int p = 0; p < MaxProbe; ++p)
+		{
+			Entry& e = slots[(h + p) & (NumSlots - 1)];
+			if (!Pin(e)) continue;
+			if (e.used && e.key == key) return &e;
+			e.refs.fetch_sub(1, std::memory_order_release);
+		}
+		return nullptr;
+	}
+
+	// 在探测范围内找一个没人用的条目改写; 同时有人放进了相同的键就直接用那份
+	Entry* Insert(const CoeffKey& key, const BiquadCoeffs& coeffs)
+	{
+		unsigned int h = Hash(key);
+		for (int p = 0; p < MaxProbe; ++p)
+		{
+			Entry& e = slots[(h + p) & (NumSlots - 1)];
+			int expected = 0;
+			if (!e.refs.compare_exchange_strong(expected, -1, std::memory_order_acquire)) continue;
+			if (!(e.used && e.key == key))
+			{
+				e.key = key;
+				e.coeffs = coeffs;
+				e.used = true;
+			}
+			e.refs.store(1, std::memory_order_release);
+			return &e;
+		}
+		return nullptr;
+	}
+
+	friend class CoeffHandle;
+};
+
+// 指向缓存条目(或表满时自己持有的一份)的只读句柄, 空句柄表示直通
+class CoeffHandle
+{
+public:
+	CoeffHandle() = default;
+	explicit CoeffHandle(const BiquadCoeffs& c) : own(std::make_shared<const BiquadCoeffs>(c)) {}
+	CoeffHandle(const CoeffHandle& o) : entry(o.entry), own(o.own)
+	{
+		if (entry != nullptr) entry->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+	CoeffHandle(CoeffHandle&& o) noexcept : entry(o.entry), own(std::move(o.own)) { o.entry = nullptr; }
+	CoeffHandle& operator=(CoeffHandle o) noexcept
+	{
+		std::swap(entry, o.entry);
+		std::swap(own, o.own);
+		return *this;
+	}
+	~CoeffHandle()
+	{
+		if (entry != nullptr) entry->refs.fetch_sub(1, std::memory_order_release);
+	}
+
+	explicit operator bool() const { return entry != nullptr || own != nullptr; }
+	const BiquadCoeffs& operator*() const
+	{
+		static const BiquadCoeffs identity(1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+		if (entry != nullptr) return entry->coeffs;
+		return own != nullptr ? *own : identity;
+	}
+	const BiquadCoeffs* operator->() const { return &**this; }
+	bool IsShared() const { return entry != nullptr; }
+
+private:
+	friend class CoeffCache;
+	explicit CoeffHandle(CoeffCache::Entry* e) : entry(e) {}
+
+	CoeffCache::Entry* entry = nullptr;
+	std::shared_ptr<const BiquadCoeffs> own;
+};
+
+template <typename Fn>
+inline CoeffHandle CoeffCache::Get(const CoeffKey& key, Fn&& design)
+{
+	if (Entry* e = Find(key))
+	{
+		++hits;
+		return CoeffHandle(e);
+	}
+	++designs;
+	BiquadCoeffs c = design();
+	if (Entry* e = Insert(key, c)) return CoeffHandle(e);
+	return CoeffHandle(c);
+}
+
+inline CoeffHandle CoeffCache::Intern(const CoeffKey& key, const BiquadCoeffs& coeffs)
+{
+	if (Entry* e = Find(key))
+	{
+		++hits;
+		return CoeffHandle(e);
+	}
+	if (Entry* e = Insert(key, coeffs)) return CoeffHandle(e);
+	return CoeffHandle(coeffs);
+}
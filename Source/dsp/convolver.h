@@ -0,0 +1,605 @@
+#pragma once
+
+//Non-uniform partitioned convolution
+//W. G. Gardner, "Efficient Convolution without Input-Output Delay", JAES 1995
+//F. Wefers, "Partitioned convolution algorithms for real-time auralization", 2015
+//D. H. Bailey, "FFTs in External or Hierarchical Memory", 1990 (four-step FFT)
+
+#include <vector>
+#include <atomic>
+#include <string.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "fft.h"
+
+// 分块布局: 第0级用小分块(延迟 = headSize), 之后每级分块长度×4
+// 第k级(k>=1)的起始偏移是自己分块长度的2倍, 留出一个分块周期的余量:
+// 这一级的变换不在块边界上一次算完, 而是分摊到这个周期内的每个头分块边界上(时间分摊的非均匀分块)
+// start > 0 时核的前start个点由时域直接卷积负责, 第0级从start开始, 整体零延迟
+struct ConvolutionLevel
+{
+	int blockSize;
+	int offset;
+	int numPartitions;
+};
+
+static inline void MakeConvolutionLayout(int headSize, int maxBlockSize, int kernelLength,
+	std::vector<ConvolutionLevel>& levels, int start = 0)
+{
+	levels.clear();
+	int offset = start;
+	int size = headSize;
+	while (offset < kernelLength)
+	{
+		int end = size * 8;//下一级从它分块长度的2倍开始
+		if (size >= maxBlockSize) end = kernelLength;//最后一级吃掉剩下的全部
+		int count = (std::min(end, kernelLength) - offset + size - 1) / size;
+		levels.push_back({ size, offset, count });
+		offset += count * size;
+		if (size < maxBlockSize) size *= 4;
+	}
+}
+
+// 已经变换好的卷积核(每个分块的频谱), 在后台线程构造, 音频线程只读
+class ConvolutionKernel
+{
+public:
+	std::vector<ConvolutionLevel> levels;
+	std::vector<std::vector<float>> re;//[level][partition * 2 * blockSize + bin]
+	std::vector<std::vector<float>> im;
+	std::vector<float> direct;//直接卷积部分, 反序存放方便和输入窗口做点积
+
+	void Build(const float* taps, int numTaps, const std::vector<ConvolutionLevel>& layout,
+		int directLength = 0)
+	{
+		direct.assign(directLength, 0.0f);
+		for (int i = 0; i < directLength && i < numTaps; ++i)
+			direct[directLength - 1 - i] = taps[i];
+
+		levels = layout;
+		re.resize(levels.size());
+		im.resize(levels.size());
+		for (size_t l = 0; l < levels.size(); ++l)
+		{
+			const ConvolutionLevel& lv = levels[l];
+			int n = lv.blockSize * 2;
+			re[l].assign((size_t)n * lv.numPartitions, 0.0f);
+			im[l].assign((size_t)n * lv.numPartitions, 0.0f);
+			for (int p = 0; p < lv.numPartitions; ++p)
+			{
+				float* pre = re[l].data() + (size_t)p * n;
+				float* pim = im[l].data() + (size_t)p * n;
+				int start = lv.offset + p * lv.blockSize;
+				for (int i = 0; i < lv.blockSize; ++i)
+				{
+					int k = start + i;
+					pre[i] = k < numTaps ? taps[k] : 0.0f;
+				}
+				fft_f32(pre, pim, n, -1);
+				// 逆变换的1/N归一化提前乘进卷积核
+				float norm = 1.0f / n;
+				for (int i = 0; i < n; ++i)
+				{
+					pre[i] *= norm;
+					pim[i] *= norm;
+				}
+			}
+		}
+	}
+};
+
+// 立体声非均匀分块卷积器
+// 左右声道分别放进实部和虚部, 因为卷积核是实数, 一次复数FFT就能同时算两个声道
+// 换核时新旧两个核共享输入频谱延迟线, 新核的输出预热完成后再交叉淡化
+class PartitionedConvolver
+{
+private:
+	struct LevelState
+	{
+		std::vector<float> fdlRe, fdlIm;//频域延迟线
+		std::vector<float> bufRe, bufIm;
+		std::vector<float> accRe, accIm;
+		int fdlPos = 0;
+
+		// 分摊计算: 2B点的FFT拆成rows×cols(四步法), 每个小FFT、每段频点的乘加都是一个任务
+		int steps = 1;//分摊到几个头分块边界上, 1为在块边界上同步算完
+		int rows = 0, cols = 0;//rows个长cols的列变换, 再cols个长rows的行变换
+		int chunks = 0;//乘加按频点分成几段
+		std::vector<float> workRe, workIm;//[col * rows + row]
+		std::vector<float> lineRe, lineIm;
+		std::vector<float> twRe, twIm;//[row * cols + col] = exp(-2πi·row·col / 2B)
+		bool busy = false;
+		long long jobEnd = 0;
+		int jobStep = 0;
+		int jobTask = 0;
+		float jobDone = 0.0f;
+		float jobCost = 0.0f;
+		const ConvolutionKernel* jobKernels[2] = { nullptr, nullptr };//开始时的两个核, 按物理槽位
+	};
+
+	std::vector<ConvolutionLevel> layout;
+	std::vector<LevelState> states;
+	int headSize = 0;
+	int maxBlock = 0;
+	int warmupLength = 0;//换核后等多少个样本再开始淡化
+	int latency = 0;
+	int directLength = 0;//零延迟模式下直接卷积的长度(= headSize)
+
+	std::vector<float> histL, histR;//输入历史, 长度为2的幂
+	int histMask = 0;
+	std::vector<float> dirL, dirR;//直接卷积的输入窗口, 存两遍避免回绕
+	int dirPos = 0;
+	std::vector<float> outL[2], outR[2];//输出累加环形缓冲, [0]/[1]对应两个核
+	int outMask = 0;
+	long long pos = 0;//已输入的样本数
+
+	const ConvolutionKernel* kernels[2] = { nullptr, nullptr };
+	int active = 0;
+	int warmup = 0;//新核还需预热的样本数
+	int fade = 0;//交叉淡化已进行的样本数
+	int fadeLength = 2048;
+	bool prepared = false;
+
+	static inline void DirectConvolve(const ConvolutionKernel* kernel, const float* wl, const float* wr,
+		int length, float& yl, float& yr)
+	{
+		const float* h = kernel->direct.data();
+		float sl = 0.0f, sr = 0.0f;
+		for (int i = 0; i < length; ++i)
+		{
+			sl += h[i] * wl[i];
+			sr += h[i] * wr[i];
+		}
+		yl += sl;
+		yr += sr;
+	}
+
+	// 同步计算一级(第0级, 或余量不够分摊的级)
+	void ComputeLevel(int l, long long blockEnd)
+	{
+		const ConvolutionLevel& lv = layout[l];
+		LevelState& st = states[l];
+		int n = lv.blockSize * 2;
+
+		// 最近2B个输入样本做FFT
+		for (int i = 0; i < n; ++i)
+		{
+			int idx = (int)((blockEnd - n + i) & histMask);
+			st.bufRe[i] = histL[idx];
+			st.bufIm[i] = histR[idx];
+		}
+		fft_f32(st.bufRe.data(), st.bufIm.data(), n, -1);
+
+		st.fdlPos = (st.fdlPos + 1) % lv.numPartitions;
+		memcpy(st.fdlRe.data() + (size_t)st.fdlPos * n, st.bufRe.data(), n * sizeof(float));
+		memcpy(st.fdlIm.data() + (size_t)st.fdlPos * n, st.bufIm.data(), n * sizeof(float));
+
+		for (int k = 0; k < 2; ++k)
+		{
+			const ConvolutionKernel* kernel = kernels[k ^ active];
+			if (kernel == nullptr) continue;
+
+			memset(st.accRe.data(), 0, n * sizeof(float));
+			memset(st.accIm.data(), 0, n * sizeof(float));
+			for (int p = 0; p < lv.numPartitions; ++p)
+			{
+				int slot = st.fdlPos - p;
+				if (slot < 0) slot += lv.numPartitions;
+				const float* xr = st.fdlRe.data() + (size_t)slot * n;
+				const float* xi = st.fdlIm.data() + (size_t)slot * n;
+				const float* hr = kernel->re[l].data() + (size_t)p * n;
+				const float* hi = kernel->im[l].data() + (size_t)p * n;
+				float* ar = st.accRe.data();
+				float* ai = st.accIm.data();
+				for (int i = 0; i < n; ++i)
+				{
+					ar[i] += xr[i] * hr[i] - xi[i] * hi[i];
+					ai[i] += xr[i] * hi[i] + xi[i] * hr[i];
+				}
+			}
+			fft_f32(st.accRe.data(), st.accIm.data(), n, 1);
+
+			// overlap-save: 后半段有效, 加到输出时间 blockEnd - B + offset 起
+			float* yl = outL[k ^ active].data();
+			float* yr = outR[k ^ active].data();
+			long long t0 = blockEnd - lv.blockSize + lv.offset;
+			for (int i = 0; i < lv.blockSize; ++i)
+			{
+				int idx = (int)((t0 + i) & outMask);
+				yl[idx] += st.accRe[lv.blockSize + i];
+				yr[idx] += st.accIm[lv.blockSize + i];
+			}
+		}
+	}
+
+	// 四步法的一趟: 列变换(乘旋转因子)或行变换, 正变换inv = -1, 逆变换inv = 1
+	// 列变换: src[row + rows * i]的cols点FFT, 乘旋转因子后放进work的第row行
+	void ColumnPass(LevelState& st, const float* srcRe, const float* srcIm, int row, int inv)
+	{
+		float* lr = st.lineRe.data();
+		float* li = st.lineIm.data();
+		for (int i = 0; i < st.cols; ++i)
+		{
+			lr[i] = srcRe[row + st.rows * i];
+			li[i] = srcIm[row + st.rows * i];
+		}
+		fft_f32(lr, li, st.cols, inv);
+		const float* tr = st.twRe.data() + (size_t)row * st.cols;
+		const float* ti = st.twIm.data() + (size_t)row * st.cols;
+		float sign = (float)-inv;
+		for (int k = 0; k < st.cols; ++k)
+		{
+			float wr = tr[k], wi = ti[k] * sign;
+			st.workRe[(size_t)k * st.rows + row] = lr[k] * wr - li[k] * wi;
+			st.workIm[(size_t)k * st.rows + row] = lr[k] * wi + li[k] * wr;
+		}
+	}
+
+	// 行变换: work第col列(连续存放)的rows点FFT, 结果是自然顺序的第col + cols * k个频点
+	float* RowPass(LevelState& st, int col, int inv)
+	{
+		float* wr = st.workRe.data() + (size_t)col * st.rows;
+		float* wi = st.workIm.data() + (size_t)col * st.rows;
+		fft_f32(wr, wi, st.rows, inv);
+		return wr;
+	}
+
+	// 一个小FFT连同搬移/旋转因子的运算量
+	static float PassCost(int n)
+	{
+		return 5.0f * n * log2f((float)n) + 8.0f * n;
+	}
+
+	// 任务顺序: 取输入, 正变换(列, 行), 然后每个核: 乘加(分段), 逆变换(列, 行, 加进输出)
+	int NumTasks(const LevelState& st) const { return 1 + st.rows + st.cols + 2 * (st.chunks + st.rows + st.cols); }
+
+	float TaskCost(const LevelState& st, const ConvolutionLevel& lv, int t) const
+	{
+		int n = lv.blockSize * 2;
+		if (t == 0) return (float)n;
+		t -= 1;
+		if (t < st.rows) return PassCost(st.cols);
+		t -= st.rows;
+		if (t < st.cols) return PassCost(st.rows);
+		t -= st.cols;
+		int per = st.chunks + st.rows + st.cols;
+		if (st.jobKernels[t / per] == nullptr) return 0.0f;
+		t %= per;
+		if (t < st.chunks) return 8.0f * (n / st.chunks) * lv.numPartitions;
+		t -= st.chunks;
+		return t < st.rows ? PassCost(st.cols) : PassCost(st.rows);
+	}
+
+	void RunTask(int l, int t)
+	{
+		const ConvolutionLevel& lv = layout[l];
+		LevelState& st = states[l];
+		int n = lv.blockSize * 2;
+		if (t == 0)
+		{
+			// 最近2B个输入样本, 新的一格频域延迟线
+			for (int i = 0; i < n; ++i)
+			{
+				int idx = (int)((st.jobEnd - n + i) & histMask);
+				st.bufRe[i] = histL[idx];
+				st.bufIm[i] = histR[idx];
+			}
+			st.fdlPos = (st.fdlPos + 1) % lv.numPartitions;
+			return;
+		}
+		t -= 1;
+		if (t < st.rows)
+		{
+			ColumnPass(st, st.bufRe.data(), st.bufIm.data(), t, -1);
+			return;
+		}
+		t -= st.rows;
+		if (t < st.cols)
+		{
+			float* wr = RowPass(st, t, -1);
+			float* wi = st.workIm.data() + (size_t)t * st.rows;
+			float* dr = st.fdlRe.data() + (size_t)st.fdlPos * n;
+			float* di = st.fdlIm.data() + (size_t)st.fdlPos * n;
+			for (int k = 0; k < st.rows; ++k)
+			{
+				dr[t + st.cols * k] = wr[k];
+				di[t + st.cols * k] = wi[k];
+			}
+			return;
+		}
+		t -= st.cols;
+		int per = st.chunks + st.rows + st.cols;
+		int b = t / per;
+		const ConvolutionKernel* kernel = st.jobKernels[b];
+		if (kernel == nullptr) return;
+		t %= per;
+		if (t < st.chunks)
+		{
+			int len = n / st.chunks;
+			int first = t * len;
+			float* ar = st.accRe.data() + first;
+			float* ai = st.accIm.data() + first;
+			memset(ar, 0, len * sizeof(float));
+			memset(ai, 0, len * sizeof(float));
+			for (int p = 0; p < lv.numPartitions; ++p)
+			{
+				int slot = st.fdlPos - p;
+				if (slot < 0) slot += lv.numPartitions;
+				const float* xr = st.fdlRe.data() + (size_t)slot * n + first;
+				const float* xi = st.fdlIm.data() + (size_t)slot * n + first;
+				const float* hr = kernel->re[l].data() + (size_t)p * n + first;
+				const float* hi = kernel->im[l].data() + (size_t)p * n + first;
+				for (int i = 0; i < len; ++i)
+				{
+					ar[i] += xr[i] * hr[i] - xi[i] * hi[i];
+					ai[i] += xr[i] * hi[i] + xi[i] * hr[i];
+				}
+			}
+			return;
+		}
+		t -= st.chunks;
+		if (t < st.rows)
+		{
+			ColumnPass(st, st.accRe.data(), st.accIm.data(), t, 1);
+			return;
+		}
+		t -= st.rows;
+		// overlap-save: 后半段有效, 加到输出时间 jobEnd - B + offset 起
+		float* wr = RowPass(st, t, 1);
+		float* wi = st.workIm.data() + (size_t)t * st.rows;
+		float* yl = outL[b].data();
+		float* yr = outR[b].data();
+		long long t0 = st.jobEnd - lv.blockSize + lv.offset;
+		for (int k = 0; k < st.rows; ++k)
+		{
+			int i = t + st.cols * k;
+			if (i < lv.blockSize) continue;
+			int idx = (int)((t0 + i - lv.blockSize) & outMask);
+			yl[idx] += wr[k];
+			yr[idx] += wi[k];
+		}
+	}
+
+	void StartJob(int l, long long blockEnd)
+	{
+		LevelState& st = states[l];
+		while (st.busy) AdvanceJob(l);//不会发生: 上一次的最后一步在这个边界之前
+		st.busy = true;
+		st.jobEnd = blockEnd;
+		st.jobStep = 0;
+		st.jobTask = 0;
+		st.jobDone = 0.0f;
+		st.jobKernels[0] = kernels[0];
+		st.jobKernels[1] = kernels[1];
+		st.jobCost = 0.0f;
+		for (int t = 0, n = NumTasks(st); t < n; ++t)
+			st.jobCost += TaskCost(st, layout[l], t);
+	}
+
+	// 每个头分块边界走一步, 做到总开销的(step + 1) / steps, 最后一步做完剩下的
+	void AdvanceJob(int l)
+	{
+		LevelState& st = states[l];
+		int total = NumTasks(st);
+		float target = st.jobStep + 1 >= st.steps ? FLT_MAX : st.jobCost * (st.jobStep + 1) / st.steps;
+		while (st.jobTask < total && st.jobDone < target)
+		{
+			st.jobDone += TaskCost(st, layout[l], st.jobTask);
+			RunTask(l, st.jobTask++);
+		}
+		++st.jobStep;
+		if (st.jobTask >= total) st.busy = false;
+	}
+
+public:
+	// 非实时线程调用, 分配全部内存
+	// zeroLatency: 核的前head个点直接卷积(Gardner的做法), 输出不再延迟一个头分块
+	void Prepare(int head, int maxBlockSize, int kernelLength, bool zeroLatency = false)
+	{
+		headSize = head;
+		maxBlock = maxBlockSize;
+		latency = zeroLatency ? 0 : headSize;
+		directLength = zeroLatency ? headSize : 0;
+		MakeConvolutionLayout(headSize, maxBlock, kernelLength, layout, directLength);
+		dirL.assign(directLength * 2, 0.0f);
+		dirR.assign(directLength * 2, 0.0f);
+		dirPos = 0;
+
+		int biggest = headSize;
+		warmupLength = 0;
+		states.assign(layout.size(), LevelState());
+		for (size_t l = 0; l < layout.size(); ++l)
+		{
+			int n = layout[l].blockSize * 2;
+			states[l].fdlRe.assign((size_t)n * layout[l].numPartitions, 0.0f);
+			states[l].fdlIm.assign((size_t)n * layout[l].numPartitions, 0.0f);
+			states[l].bufRe.assign(n, 0.0f);
+			states[l].bufIm.assign(n, 0.0f);
+			states[l].accRe.assign(n, 0.0f);
+			states[l].accIm.assign(n, 0.0f);
+			biggest = std::max(biggest, layout[l].blockSize);
+			warmupLength = std::max(warmupLength, layout[l].offset + layout[l].blockSize + headSize * 2);
+
+			// 结果要在输出时间offset - B + latency之前算完, 下一块开始前也要算完
+			LevelState& st = states[l];
+			const ConvolutionLevel& lv = layout[l];
+			st.steps = std::max(1, std::min(lv.blockSize / headSize, (lv.offset - lv.blockSize + latency) / headSize + 1));
+			if (st.steps == 1) continue;
+			int bits = 0;
+			while ((1 << bits) < n) ++bits;
+			st.rows = 1 << (bits / 2);
+			st.cols = n / st.rows;
+			st.chunks = st.rows;
+			st.workRe.assign(n, 0.0f);
+			st.workIm.assign(n, 0.0f);
+			st.lineRe.assign(st.cols, 0.0f);
+			st.lineIm.assign(st.cols, 0.0f);
+			st.twRe.resize(n);
+			st.twIm.resize(n);
+			for (int r = 0; r < st.rows; ++r)
+			{
+				for (int c = 0; c < st.cols; ++c)
+				{
+					double a = -2.0 * M_PI * r * c / n;
+					st.twRe[(size_t)r * st.cols + c] = (float)cos(a);
+					st.twIm[(size_t)r * st.cols + c] = (float)sin(a);
+				}
+			}
+		}
+
+		int histSize = 1;
+		while (histSize < biggest * 2) histSize <<= 1;
+		histL.assign(histSize, 0.0f);
+		histR.assign(histSize, 0.0f);
+		histMask = histSize - 1;
+
+		int outSize = 1;
+		while (outSize < biggest * 4 + headSize) outSize <<= 1;
+		for (int k = 0; k < 2; ++k)
+		{
+			outL[k].assign(outSize, 0.0f);
+			outR[k].assign(outSize, 0.0f);
+		}
+		outMask = outSize - 1;
+
+		pos = 0;
+		kernels[0] = kernels[1] = nullptr;
+		active = 0;
+		warmup = fade = 0;
+		prepared = true;
+	}
+
+	const std::vector<ConvolutionLevel>& GetLayout() const { return layout; }
+	int GetLatencySamples() const { return latency; }
+	int GetDirectLength() const { return directLength; }
+	bool IsPrepared() const { return prepared; }
+	// 第l级分摊到几个头分块边界上
+	int GetLevelSteps(int l) const { return states[l].steps; }
+	// 正在换核时不接受新核
+	bool IsFading() const { return kernels[active ^ 1] != nullptr; }
+	const ConvolutionKernel* GetActiveKernel() const { return kernels[active]; }
+	const ConvolutionKernel* GetFadingKernel() const { return kernels[active ^ 1]; }
+
+	// 第一个核直接生效, 之后的核先预热再淡化
+	void SetKernel(const ConvolutionKernel* kernel)
+	{
+		if (kernels[active] == nullptr)
+		{
+			kernels[active] = kernel;
+			return;
+		}
+		kernels[active ^ 1] = kernel;
+		// 新核对输出时间t的所有分量都来自换核之后开始的计算, 分摊的级在开始时就定好了用哪些核
+		warmup = warmupLength;
+		fade = 0;
+	}
+
+	// 淡化完成时返回旧核, 调用者负责把它交还给非实时线程释放
+	const ConvolutionKernel* Process(const float* inL, const float* inR, float* oL, float* oR, int numSamples)
+	{
+		const ConvolutionKernel* retired = nullptr;
+		int i = 0;
+		while (i < numSamples)
+		{
+			int todo = std::min(numSamples - i, headSize - (int)(pos % headSize));
+
+			for (int j = 0; j < todo; ++j)
+			{
+				long long n = pos + j;
+				histL[(int)(n & histMask)] = inL[i + j];
+				histR[(int)(n & histMask)] = inR[i + j];
+
+				int idx = (int)((n - latency) & outMask);
+				float al = outL[active][idx], ar = outR[active][idx];
+				outL[active][idx] = outR[active][idx] = 0.0f;
+				const float* wl = nullptr;
+				const float* wr = nullptr;
+				if (directLength > 0)
+				{
+					dirL[dirPos] = dirL[dirPos + directLength] = inL[i + j];
+					dirR[dirPos] = dirR[dirPos + directLength] = inR[i + j];
+					if (++dirPos == directLength) dirPos = 0;
+					wl = dirL.data() + dirPos;//最近directLength个输入, 旧的在前
+					wr = dirR.data() + dirPos;
+					DirectConvolve(kernels[active], wl, wr, directLength, al, ar);
+				}
+				if (kernels[active ^ 1] != nullptr)
+				{
+					float bl = outL[active ^ 1][idx], br = outR[active ^ 1][idx];
+					outL[active ^ 1][idx] = outR[active ^ 1][idx] = 0.0f;
+					if (directLength > 0)
+						DirectConvolve(kernels[active ^ 1], wl, wr, directLength, bl, br);
+					if (warmup > 0)
+					{
+						--warmup;
+					}
+					else
+					{
+						float g = (float)fade / fadeLength;
+						al += (bl - al) * g;
+						ar += (br - ar) * g;
+						++fade;
+					}
+				}
+				oL[i + j] = al;
+				oR[i + j] = ar;
+			}
+			pos += todo;
+			i += todo;
+
+			if (kernels[active ^ 1] != nullptr && warmup == 0 && fade >= fadeLength)
+			{
+				// 淡化结束: 旧核的输出缓冲清零后交给下一次换核使用
+				retired = kernels[active];
+				kernels[active] = nullptr;
+				for (auto& st : states)
+				{
+					if (st.jobKernels[active] == retired) st.jobKernels[active] = nullptr;
+				}
+				std::fill(outL[active].begin(), outL[active].end(), 0.0f);
+				std::fill(outR[active].begin(), outR[active].end(), 0.0f);
+				active ^= 1;
+			}
+
+			if (pos % headSize == 0)
+			{
+				for (size_t l = 0; l < layout.size(); ++l)
+				{
+					LevelState& st = states[l];
+					if (st.busy) AdvanceJob((int)l);
+					if (pos % layout[l].blockSize != 0) continue;
+					if (st.steps == 1)
+					{
+						ComputeLevel((int)l, pos);
+						continue;
+					}
+					StartJob((int)l, pos);
+					AdvanceJob((int)l);
+				}
+			}
+		}
+		return retired;
+	}
+
+	void Reset()
+	{
+		std::fill(histL.begin(), histL.end(), 0.0f);
+		std::fill(histR.begin(), histR.end(), 0.0f);
+		for (int k = 0; k < 2; ++k)
+		{
+			std::fill(outL[k].begin(), outL[k].end(), 0.0f);
+			std::fill(outR[k].begin(), outR[k].end(), 0.0f);
+		}
+		for (auto& st : states)
+		{
+			std::fill(st.fdlRe.begin(), st.fdlRe.end(), 0.0f);
+			std::fill(st.fdlIm.begin(), st.fdlIm.end(), 0.0f);
+			st.busy = false;
+		}
+		std::fill(dirL.begin(), dirL.end(), 0.0f);
+		std::fill(dirR.begin(), dirR.end(), 0.0f);
+		dirPos = 0;
+		pos = 0;
+	}
+};
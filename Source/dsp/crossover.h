@@ -0,0 +1,339 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include "mailbox.h"
+#include "stagebank.h"//LMEQ_X86, LMEQ_TARGET
+
+// Linkwitz-Riley分频: 把信号分成最多5段, 各段相加是一串全通, 幅度平坦
+// 树形分频(先在f1分高低, 高的再在f2分...)里第k段 = HP(f1)..HP(fk) * LP(fk+1) * AP(fk+2)..AP(fN-1)
+// 这里每段直接按这个式子排成一串独立的SVF级, 和树形完全等价, 但各段之间没有依赖:
+// 每个lane是一段的一个声道, 所有段按lane一起并行, 走最长那段的级数, 短的段补直通级
+// 分频要求LP + HP严格等于全通, 匹配型的DesignLPF/DesignHPF分子不互补做不到, 这里用同一组极点的双线性巴特沃斯节,
+// 直接写成SVF的闭式(和GainDesign的搁架一样), 低频时不会因为1 + a1 + a2相消损失精度
+class Crossover
+{
+public:
+	static constexpr int MaxBands = 5;
+	static constexpr int MaxSplits = MaxBands - 1;
+	static constexpr int MaxSections = 16;//LR8, 5段: 最高段4个高通各4节
+	static constexpr int MaxLanes = 16;//5段x2声道补齐到两个AVX寄存器
+	static constexpr int MaxChunk = 256;
+	static constexpr float MinFreq = 20.0f;
+	static constexpr float MaxFreq = 20000.0f;
+
+	struct Settings {
+		int numBands = 1;//1为关
+		int order = 4;//4: LR4(24dB/oct), 8: LR8(48dB/oct)
+		float freqs[MaxSplits] = { 120.0f, 1000.0f, 4000.0f, 10000.0f };//分频点, 升序
+	};
+
+	enum Kernel { KERNEL_SCALAR = 0, KERNEL_SSE, KERNEL_AVX2 };
+
+	Crossover()
+	{
+#if LMEQ_X86
+		kernel = juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3() ? KERNEL_AVX2 : KERNEL_SSE;
+#endif
+	}
+
+	~Crossover()
+	{
+		sets.Clear();
+		delete current;
+	}
+
+	// 段数和阶数限在范围内, 用到的分频点排好序
+	static Settings Sanitize(Settings s)
+	{
+		s.numBands = juce::jlimit(1, MaxBands, s.numBands);
+		s.order = s.order == 8 ? 8 : 4;
+		for (float& f : s.freqs) f = juce::jlimit(MinFreq, MaxFreq, std::isfinite(f) ? f : 1000.0f);
+		std::sort(s.freqs, s.freqs + s.numBands - 1);
+		return s;
+	}
+
+	// prepareToPlay调用, 音频线程未运行
+	void Prepare(int maxBlockSize)
+	{
+		blockSize = juce::jlimit(1, MaxChunk, maxBlockSize);//整块在各级之间来回读写, 限在L1里
+		inBuf.assign(blockSize * 2, 0.0f);
+		outBuf.assign(blockSize * MaxLanes, 0.0f);
+	}
+
+	// 消息线程(调用方持锁)
+	void Publish(const Settings& settings, float sampleRate)
+	{
+		Settings s = Sanitize(settings);
+		auto* set = new BandSet();
+		set->numBands = s.numBands;
+		set->order = s.order;
+		if (s.numBands > 1)
+		{
+			int width = kernel == KERNEL_AVX2 ? MaxLanes : kernel == KERNEL_SSE ? 8 : 2;//内核每次走两个寄存器宽
+			set->lanes = (s.numBands * 2 + width - 1) / width * width;
+			Build(*set, s, sampleRate);
+		}
+		sets.Publish(set);
+	}
+
+	const char* GetKernelName() const
+	{
+		switch (kernel) {
+		case KERNEL_AVX2: return "AVX2";
+		case KERNEL_SSE: return "SSE";
+		default: return "Scalar";
+		}
+	}
+
+	// 音频线程: outL/outR[k]为第k段的输出, 为空的跳过; 分频关着或段数不够时输出清零
+	template <typename T>
+	void Process(const T* inL, const T* inR, T* const* outL, T* const* outR, int numOutputs, int numSamples)
+	{
+		Adopt();
+		BandSet* s = current;
+		int active = s != nullptr && s->numBands > 1 ? s->numBands : 0;
+		for (int k = active; k < numOutputs; ++k)
+		{
+			if (outL[k] != nullptr) std::fill(outL[k], outL[k] + numSamples, (T)0);
+			if (outR[k] != nullptr) std::fill(outR[k], outR[k] + numSamples, (T)0);
+		}
+		if (active == 0 || inBuf.empty()) return;
+
+		for (int pos = 0; pos < numSamples; pos += blockSize)
+		{
+			int n = std::min(blockSize, numSamples - pos);
+			for (int t = 0; t < n; ++t)
+			{
+				inBuf[t * 2] = (float)inL[pos + t];
+				inBuf[t * 2 + 1] = (float)inR[pos + t];
+			}
+			RunKernel(*s, n);
+			const int lanes = s->lanes;
+			for (int k = 0; k < std::min(active, numOutputs); ++k)
+			{
+				const float* o = outBuf.data() + k * 2;
+				if (outL[k] != nullptr)
+					for (int t = 0; t < n; ++t) outL[k][pos + t] = (T)o[t * lanes];
+				if (outR[k] != nullptr)
+					for (int t = 0; t < n; ++t) outR[k][pos + t] = (T)o[t * lanes + 1];
+			}
+		}
+	}
+
+private:
+	// 系数和状态, 下标为 级 * lanes + lane, lane = 段 * 2 + 声道
+	struct BandSet
+	{
+		int numBands = 1;
+		int order = 4;
+		int lanes = 0;
+		int numSections = 0;
+		std::vector<float> c1, c2, d0, d1, d2, z1, z2;
+	};
+
+	enum SectionType { SECTION_LP, SECTION_HP, SECTION_AP };
+
+	// 双线性巴特沃斯节的SVF系数, k = 1 - cos(w0), alpha = sin(w0) / 2Q, a0 = 1 + alpha:
+	// c1 = 2(k + alpha)/a0, c2 = k/(k + alpha)
+	// 低通 d0 = k/2a0, d1 = k/(k + alpha), d2 = 1; 高通 d0 = (2 - k)/2a0, d1 = d2 = 0
+	// 全通 d0 = (1 - alpha)/a0, d1 = (k - alpha)/(k + alpha), d2 = 1
+	static void DesignSection(int type, double freq, double Q, double sampleRate, float* svf)
+	{
+		double w0 = 2.0 * M_PI * freq / sampleRate;
+		double sh = sin(0.5 * w0);
+		double k = 2.0 * sh * sh;
+		double alpha = sin(w0) / (2.0 * Q);
+		double a0 = 1.0 + alpha;
+		double d0, d1, d2;
+		if (type == SECTION_LP) { d0 = 0.5 * k / a0; d1 = k / (k + alpha); d2 = 1.0; }
+		else if (type == SECTION_HP) { d0 = 0.5 * (2.0 - k) / a0; d1 = 0.0; d2 = 0.0; }
+		else { d0 = (1.0 - alpha) / a0; d1 = (k - alpha) / (k + alpha); d2 = 1.0; }
+		svf[0] = (float)(2.0 * (k + alpha) / a0);
+		svf[1] = (float)(k / (k + alpha));
+		svf[2] = (float)d0;
+		svf[3] = (float)d1;
+		svf[4] = (float)d2;
+	}
+
+	// LR4是2阶巴特沃斯平方, LR8是4阶巴特沃斯平方; 全通是巴特沃斯本身的极点
+	static void Build(BandSet& set, const Settings& s, float sampleRate)
+	{
+		static constexpr double Q4[] = { 0.70710678 };
+		static constexpr double Q8[] = { 0.54119610, 1.30656296 };
+		const double* qs = s.order == 8 ? Q8 : Q4;
+		const int numQ = s.order == 8 ? 2 : 1;
+		const int numSplits = s.numBands - 1;
+
+		float sections[MaxBands][MaxSections][5];
+		int count[MaxBands] = {};
+		for (int b = 0; b < s.numBands; ++b)
+		{
+			for (int j = 0; j < numSplits; ++j)
+			{
+				double f = std::min((double)s.freqs[j], 0.45 * sampleRate);
+				int type = j < b ? SECTION_HP : j == b ? SECTION_LP : SECTION_AP;
+				int repeat = type == SECTION_AP ? 1 : 2;//LR的低通/高通是同一节重复两次
+				for (int q = 0; q < numQ; ++q)
+					for (int r = 0; r < repeat; ++r)
+						DesignSection(type, f, qs[q], sampleRate, sections[b][count[b]++]);
+			}
+			set.numSections = std::max(set.numSections, count[b]);
+		}
+
+		const int size = set.numSections * set.lanes;
+		for (auto* v : { &set.c1, &set.c2, &set.d1, &set.d2, &set.z1, &set.z2 }) v->assign(size, 0.0f);
+		set.d0.assign(size, 1.0f);//补齐的级和lane是直通
+		for (int b = 0; b < s.numBands; ++b)
+		{
+			for (int k = 0; k < count[b]; ++k)
+			{
+				const float* c = sections[b][k];
+				for (int ch = 0; ch < 2; ++ch)
+				{
+					int i = k * set.lanes + b * 2 + ch;
+					set.c1[i] = c[0]; set.c2[i] = c[1]; set.d0[i] = c[2]; set.d1[i] = c[3]; set.d2[i] = c[4];
+				}
+			}
+		}
+	}
+
+	// 只改了分频点时状态原样接着用(SVF对系数变化表现良好), 段数或阶数变了从零开始
+	void Adopt()
+	{
+		BandSet* next = sets.Take();
+		if (next == nullptr) return;
+		if (current != nullptr && current->numBands == next->numBands && current->order == next->order &&
+			current->lanes == next->lanes && current->numSections == next->numSections)
+		{
+			next->z1 = current->z1;
+			next->z2 = current->z2;
+		}
+		sets.Retire(current);
+		current = next;
+	}
+
+	void RunKernel(BandSet& s, int n)
+	{
+		switch (kernel) {
+#if LMEQ_X86
+		case KERNEL_AVX2: KernelAVX2(s, inBuf.data(), outBuf.data(), n); break;
+		case KERNEL_SSE: KernelSSE(s, inBuf.data(), outBuf.data(), n); break;
+#endif
+		default: KernelScalar(s, inBuf.data(), outBuf.data(), n); break;
+		}
+	}
+
+	// in为交错的LR, out为[样本][lane]
+	// 一级一级地走完整块: 这一级的系数和状态整块都在寄存器里, 块在L1里来回读写
+	// 每次同时走两组互不相关的lane(标量是一段的左右声道, 向量是相邻两个向量), 掩盖级内反馈的延迟
+	static void KernelScalar(BandSet& s, const float* in, float* out, int n)
+	{
+		const int lanes = s.lanes;
+		for (int t = 0; t < n; ++t)
+			for (int lane = 0; lane < lanes; ++lane) out[t * lanes + lane] = in[t * 2 + (lane & 1)];
+		for (int k = 0; k < s.numSections; ++k)
+		{
+			for (int lane = 0; lane < lanes; lane += 2)
+			{
+				const int i = k * lanes + lane;
+				if (s.d0[i] == 1.0f && s.c1[i] == 0.0f) continue;//补齐的直通级
+				const float c1 = s.c1[i], c2 = s.c2[i], d0 = s.d0[i], d1 = s.d1[i], d2 = s.d2[i];
+				float l1 = s.z1[i], l2 = s.z2[i], r1 = s.z1[i + 1], r2 = s.z2[i + 1];
+				for (int t = 0; t < n; ++t)
+				{
+					float* p = out + t * lanes + lane;
+					float xl = p[0] - l1 - l2;
+					float xr = p[1] - r1 - r2;
+					p[0] = d0 * xl + d1 * l1 + d2 * l2;
+					p[1] = d0 * xr + d1 * r1 + d2 * r2;
+					l2 += c2 * l1; l1 += c1 * xl;
+					r2 += c2 * r1; r1 += c1 * xr;
+				}
+				s.z1[i] = l1; s.z2[i] = l2; s.z1[i + 1] = r1; s.z2[i + 1] = r2;
+			}
+		}
+	}
+
+#if LMEQ_X86
+	// 4个lane(两段x两声道)一个向量, 输入的LR对广播到每段
+	static void KernelSSE(BandSet& s, const float* in, float* out, int n)
+	{
+		const int lanes = s.lanes;
+		for (int t = 0; t < n; ++t)
+		{
+			__m128 x0 = _mm_castpd_ps(_mm_load1_pd((const double*)(in + t * 2)));
+			for (int g = 0; g < lanes; g += 4) _mm_storeu_ps(out + t * lanes + g, x0);
+		}
+		for (int k = 0; k < s.numSections; ++k)
+		{
+			for (int g = 0; g < lanes; g += 8)
+			{
+				const int a = k * lanes + g, b = a + 4;
+				const __m128 c1a = _mm_loadu_ps(&s.c1[a]), c2a = _mm_loadu_ps(&s.c2[a]);
+				const __m128 d0a = _mm_loadu_ps(&s.d0[a]), d1a = _mm_loadu_ps(&s.d1[a]), d2a = _mm_loadu_ps(&s.d2[a]);
+				const __m128 c1b = _mm_loadu_ps(&s.c1[b]), c2b = _mm_loadu_ps(&s.c2[b]);
+				const __m128 d0b = _mm_loadu_ps(&s.d0[b]), d1b = _mm_loadu_ps(&s.d1[b]), d2b = _mm_loadu_ps(&s.d2[b]);
+				__m128 z1a = _mm_loadu_ps(&s.z1[a]), z2a = _mm_loadu_ps(&s.z2[a]);
+				__m128 z1b = _mm_loadu_ps(&s.z1[b]), z2b = _mm_loadu_ps(&s.z2[b]);
+				for (int t = 0; t < n; ++t)
+				{
+					float* p = out + t * lanes + g;
+					__m128 xa = _mm_sub_ps(_mm_loadu_ps(p), _mm_add_ps(z1a, z2a));
+					__m128 xb = _mm_sub_ps(_mm_loadu_ps(p + 4), _mm_add_ps(z1b, z2b));
+					_mm_storeu_ps(p, _mm_add_ps(_mm_mul_ps(d0a, xa), _mm_add_ps(_mm_mul_ps(d1a, z1a), _mm_mul_ps(d2a, z2a))));
+					_mm_storeu_ps(p + 4, _mm_add_ps(_mm_mul_ps(d0b, xb), _mm_add_ps(_mm_mul_ps(d1b, z1b), _mm_mul_ps(d2b, z2b))));
+					z2a = _mm_add_ps(z2a, _mm_mul_ps(c2a, z1a)); z1a = _mm_add_ps(z1a, _mm_mul_ps(c1a, xa));
+					z2b = _mm_add_ps(z2b, _mm_mul_ps(c2b, z1b)); z1b = _mm_add_ps(z1b, _mm_mul_ps(c1b, xb));
+				}
+				_mm_storeu_ps(&s.z1[a], z1a); _mm_storeu_ps(&s.z2[a], z2a);
+				_mm_storeu_ps(&s.z1[b], z1b); _mm_storeu_ps(&s.z2[b], z2b);
+			}
+		}
+	}
+
+	// 8个lane一个向量, 固定16个lane正好两组
+	LMEQ_TARGET("avx2,fma")
+	static void KernelAVX2(BandSet& s, const float* in, float* out, int n)
+	{
+		for (int t = 0; t < n; ++t)
+		{
+			__m256 x0 = _mm256_castpd_ps(_mm256_broadcast_sd((const double*)(in + t * 2)));
+			_mm256_storeu_ps(out + t * 16, x0);
+			_mm256_storeu_ps(out + t * 16 + 8, x0);
+		}
+		for (int k = 0; k < s.numSections; ++k)
+		{
+			const int a = k * 16, b = a + 8;
+			const __m256 c1a = _mm256_loadu_ps(&s.c1[a]), c2a = _mm256_loadu_ps(&s.c2[a]);
+			const __m256 d0a = _mm256_loadu_ps(&s.d0[a]), d1a = _mm256_loadu_ps(&s.d1[a]), d2a = _mm256_loadu_ps(&s.d2[a]);
+			const __m256 c1b = _mm256_loadu_ps(&s.c1[b]), c2b = _mm256_loadu_ps(&s.c2[b]);
+			const __m256 d0b = _mm256_loadu_ps(&s.d0[b]), d1b = _mm256_loadu_ps(&s.d1[b]), d2b = _mm256_loadu_ps(&s.d2[b]);
+			__m256 z1a = _mm256_loadu_ps(&s.z1[a]), z2a = _mm256_loadu_ps(&s.z2[a]);
+			__m256 z1b = _mm256_loadu_ps(&s.z1[b]), z2b = _mm256_loadu_ps(&s.z2[b]);
+			for (int t = 0; t < n; ++t)
+			{
+				float* p = out + t * 16;
+				__m256 xa = _mm256_sub_ps(_mm256_loadu_ps(p), _mm256_add_ps(z1a, z2a));
+				__m256 xb = _mm256_sub_ps(_mm256_loadu_ps(p + 8), _mm256_add_ps(z1b, z2b));
+				_mm256_storeu_ps(p, _mm256_fmadd_ps(d0a, xa, _mm256_fmadd_ps(d1a, z1a, _mm256_mul_ps(d2a, z2a))));
+				_mm256_storeu_ps(p + 8, _mm256_fmadd_ps(d0b, xb, _mm256_fmadd_ps(d1b, z1b, _mm256_mul_ps(d2b, z2b))));
+				z2a = _mm256_fmadd_ps(c2a, z1a, z2a); z1a = _mm256_fmadd_ps(c1a, xa, z1a);
+				z2b = _mm256_fmadd_ps(c2b, z1b, z2b); z1b = _mm256_fmadd_ps(c1b, xb, z1b);
+			}
+			_mm256_storeu_ps(&s.z1[a], z1a); _mm256_storeu_ps(&s.z2[a], z2a);
+			_mm256_storeu_ps(&s.z1[b], z1b); _mm256_storeu_ps(&s.z2[b], z2b);
+		}
+	}
+#endif
+
+	int kernel = KERNEL_SCALAR;
+	LatestMailbox<BandSet> sets;
+
+	// 音频线程
+	BandSet* current = nullptr;
+	int blockSize = 0;
+	std::vector<float> inBuf, outBuf;
+};
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include "biquad.h"
+#include "svf.h"
+#include "mailbox.h"
+
+// 节点的动态设置: 频带电平超过阈值后按比例压低增益
+struct DynamicParams {
+	bool enabled = false;
+	float thresholdDB = -24.0f;
+	float ratio = 2.0f;
+	float attackMs = 10.0f;
+	float releaseMs = 120.0f;
+	bool sidechain = false;//用侧链检测, 没有侧链输入时退回主输入
+};
+
+// 动态EQ的检测和控制: 每个动态节点在自己的频率上放一个SVF带通(BiquadDesigner的带通换算过来), 左右声道各一个
+// 逐样本只跑带通和能量累加, 频带按LaneAlign一组整段处理, 内层循环跨频带, 编译器直接向量化
+// 每ControlInterval个样本出一次电平, 按attack/release平滑后算增益, 变化超过GainStepDB才重新设计节点, 从不逐样本设计
+// 设计和换系数由Equalizer通过回调做(和自动化, 界面增益斜坡同一条路径, 级联原地换系数)
+class DynamicBandBank
+{
+public:
+	static constexpr int MaxBands = 64;
+	static constexpr int LaneAlign = 8;
+	static constexpr int ControlInterval = 64;
+	static constexpr float GainStepDB = 0.1f;
+	static constexpr float MaxRangeDB = 24.0f;
+	static constexpr float FloorDB = -120.0f;
+	static constexpr float StateFloor = 1e-12f;//静音后把状态清零, 不掉进非规格化数
+
+	struct Band
+	{
+		int id;
+		int mode;
+		float cutoff;
+		float q;
+		float gainDB;
+		DynamicParams dyn;
+	};
+
+	DynamicBandBank()
+	{
+		for (auto& r : reduction) r.store(0.0f);
+	}
+
+	~DynamicBandBank() { Release(); }
+
+	// 消息线程(调用方持锁): 动态节点列表, 每次发布级联时一起发布
+	void SetBands(const std::vector<Band>& list, float sampleRate)
+	{
+		if (list.empty() && publishedEmpty) return;
+		publishedEmpty = list.empty();
+
+		auto* set = new BandSet();
+		set->sampleRate = sampleRate;
+		set->numBands = std::min((int)list.size(), MaxBands);
+		set->Allocate((set->numBands + LaneAlign - 1) / LaneAlign * LaneAlign);
+		for (int i = 0; i < set->numBands; ++i)
+		{
+			set->bands[i] = list[i];
+			set->slotOf[list[i].id] = i;
+			set->DesignDetector(i);
+			const DynamicParams& d = list[i].dyn;
+			set->key[i] = d.sidechain ? 1.0f : 0.0f;
+			set->attackSamples[i] = std::max(0.1f, d.attackMs) * 0.001f * sampleRate;
+			set->releaseSamples[i] = std::max(1.0f, d.releaseMs) * 0.001f * sampleRate;
+		}
+		sets.Publish(set);
+	}
+
+	// 界面: 节点当前被动态压低了多少dB(<= 0)
+	float GetGainOffset(int id) const
+	{
+		return id >= 0 && id < MaxBands ? reduction[id].load(std::memory_order_relaxed) : 0.0f;
+	}
+
+	// 音频线程: 接管新的频带设置, 检测器状态和包络按节点id延续, 返回是否有动态节点
+	bool Adopt()
+	{
+		if (BandSet* next = sets.Take())
+		{
+			for (int i = 0; i < next->numBands; ++i)
+			{
+				int id = next->bands[i].id;
+				int old = current != nullptr ? current->slotOf[id] : -1;
+				if (old >= 0)
+				{
+					next->zL1[i] = current->zL1[old]; next->zL2[i] = current->zL2[old];
+					next->zR1[i] = current->zR1[old]; next->zR2[i] = current->zR2[old];
+					next->env[i] = current->env[old];
+				}
+				// 级联刚重新发布过(可能是静态增益, 也可能增益已经变了), 下一个控制点一定要重新设计一次
+				next->applied[i] = ForceRedesign;
+			}
+			for (int id = 0; id < MaxBands; ++id)
+				if (next->slotOf[id] < 0) reduction[id].store(0.0f, std::memory_order_relaxed);
+			sets.Retire(current);
+			current = next;
+			sinceControl = 0;
+		}
+		return current != nullptr && current->numBands > 0;
+	}
+
+	// 音频线程: 到下一个控制点还有多少样本
+	int NextControlLength(int remaining) const
+	{
+		return std::min(remaining, ControlInterval - sinceControl);
+	}
+
+	// 音频线程: 检测一段输入, 不超过NextControlLength; key为空时全部用主输入
+	template <typename T>
+	void Detect(const T* inL, const T* inR, const T* keyL, const T* keyR, int numSamples)
+	{
+		BandSet& s = *current;
+		for (int g = 0; g < s.padded; g += LaneAlign)
+			DetectGroup(s, g, inL, inR, keyL != nullptr ? keyL : inL, keyR != nullptr ? keyR : inR, numSamples);
+	}
+
+	// 音频线程: 检测完一段后调用, 到了控制点就更新包络和增益
+	// apply(id, band, gainDB)负责设计并换上系数; canApply为假(FIR在用)时只跟踪包络
+	template <typename Fn>
+	void Control(int numSamples, bool canApply, Fn&& apply)
+	{
+		sinceControl += numSamples;
+		if (sinceControl < ControlInterval) return;
+		BandSet& s = *current;
+		float n = (float)sinceControl;
+		sinceControl = 0;
+
+		for (int i = 0; i < s.numBands; ++i)
+		{
+			// 块内平均 -> 正弦幅度的dB
+			float power = s.acc[i] / n;
+			s.acc[i] = 0.0f;
+			float level = power > 1e-12f ? 10.0f * std::log10(power) : FloorDB;
+			float tau = level > s.env[i] ? s.attackSamples[i] : s.releaseSamples[i];
+			s.env[i] = level + (s.env[i] - level) * std::exp(-n / tau);
+
+			const Band& b = s.bands[i];
+			float ratio = juce::jlimit(1.0f, 100.0f, b.dyn.ratio);
+			float over = s.env[i] - b.dyn.thresholdDB;
+			float offset = over > 0.0f ? std::max(-MaxRangeDB, -over * (1.0f - 1.0f / ratio)) : 0.0f;
+
+			if (!canApply)
+			{
+				s.applied[i] = ForceRedesign;
+				continue;
+			}
+			if (std::abs(offset - s.applied[i]) < GainStepDB && (offset != 0.0f || s.applied[i] == 0.0f))
+				continue;
+			apply(b.id, b, b.gainDB + offset);
+			s.applied[i] = offset;
+			reduction[b.id].store(offset, std::memory_order_relaxed);
+		}
+		FlushStates(s);
+	}
+
+	// 音频线程: 自动化, 界面增益斜坡或音高跟踪改了节点的基础值, 检测器跟着移过去, 返回当前的动态增益偏移
+	float Rebase(int id, int mode, float cutoff, float q, float gainDB)
+	{
+		if (current == nullptr || id < 0 || id >= MaxBands) return 0.0f;
+		int i = current->slotOf[id];
+		if (i < 0) return 0.0f;
+		Band& b = current->bands[i];
+		bool moved = b.cutoff != cutoff || b.q != q;
+		b.mode = mode;
+		b.cutoff = cutoff;
+		b.q = q;
+		b.gainDB = gainDB;
+		if (moved) current->DesignDetector(i);
+		float offset = current->applied[i];
+		return offset == ForceRedesign ? 0.0f : offset;
+	}
+
+	// 音频线程不运行时调用
+	void Release()
+	{
+		sets.Clear();
+		delete current;
+		current = nullptr;
+		publishedEmpty = true;
+	}
+
+private:
+	static constexpr float ForceRedesign = 1e9f;
+
+	struct BandSet
+	{
+		float sampleRate = 48000.0f;
+		int numBands = 0;
+		int padded = 0;
+		Band bands[MaxBands];
+		int slotOf[MaxBands];
+		// 检测器: SVF系数, 选主输入(0)还是侧链(1), 状态和能量累加
+		std::vector<float> d0, d1, d2, c1, c2, key;
+		std::vector<float> zL1, zL2, zR1, zR2, acc;
+		std::vector<float> env, applied, attackSamples, releaseSamples;
+
+		BandSet()
+		{
+			for (auto& s : slotOf) s = -1;
+		}
+
+		void Allocate(int n)
+		{
+			padded = n;
+			for (auto* v : { &d0, &d1, &d2, &c1, &c2, &key, &zL1, &zL2, &zR1, &zR2, &acc,
+				&attackSamples, &releaseSamples })
+				v->assign(n, 0.0f);
+			env.assign(n, FloorDB);
+			applied.assign(n, ForceRedesign);
+		}
+
+		// 带通设计器的"级数"取0, "增益"是Q的dB, 峰值增益为Q, 除掉后通带是0dB
+		void DesignDetector(int i)
+		{
+			BiquadDesigner designer(sampleRate);
+			float q = juce::jlimit(0.1f, 40.0f, bands[i].q);
+			float cutoff = juce::jlimit(10.0f, sampleRate * 0.45f, bands[i].cutoff);
+			BiquadCoeffs c = designer.DesignBPF(cutoff, 0.0f, 20.0f * std::log10(q));
+			BiquadToSVF(c.b0 / q, c.b1 / q, c.b2 / q, c.a1, c.a2, d0[i], d1[i], d2[i], c1[i], c2[i]);
+		}
+	};
+
+	// 一组LaneAlign个频带整段处理, 系数和状态放在局部数组里, 定长的内层循环直接向量化
+	// 每个lane是一个独立的带通(不是级联), 和SVF::ProcessSample的第一级相同
+	template <typename T>
+	static void DetectGroup(BandSet& s, int g, const T* inL, const T* inR, const T* keyL, const T* keyR, int numSamples)
+	{
+		float d0[LaneAlign], d1[LaneAlign], d2[LaneAlign], c1[LaneAlign], c2[LaneAlign], sel[LaneAlign];
+		float zl1[LaneAlign], zl2[LaneAlign], zr1[LaneAlign], zr2[LaneAlign], acc[LaneAlign];
+		for (int b = 0; b < LaneAlign; ++b)
+		{
+			d0[b] = s.d0[g + b]; d1[b] = s.d1[g + b]; d2[b] = s.d2[g + b];
+			c1[b] = s.c1[g + b]; c2[b] = s.c2[g + b]; sel[b] = s.key[g + b];
+			zl1[b] = s.zL1[g + b]; zl2[b] = s.zL2[g + b]; zr1[b] = s.zR1[g + b]; zr2[b] = s.zR2[g + b];
+			acc[b] = s.acc[g + b];
+		}
+		for (int t = 0; t < numSamples; ++t)
+		{
+			float mL = (float)inL[t], mR = (float)inR[t];
+			float dL = (float)keyL[t] - mL, dR = (float)keyR[t] - mR;
+			for (int b = 0; b < LaneAlign; ++b)
+			{
+				float xl = mL + sel[b] * dL - zl1[b] - zl2[b];
+				float xr = mR + sel[b] * dR - zr1[b] - zr2[b];
+				float yl = d0[b] * xl + d1[b] * zl1[b] + d2[b] * zl2[b];
+				float yr = d0[b] * xr + d1[b] * zr1[b] + d2[b] * zr2[b];
+				zl2[b] += c2[b] * zl1[b];
+				zl1[b] += c1[b] * xl;
+				zr2[b] += c2[b] * zr1[b];
+				zr1[b] += c1[b] * xr;
+				acc[b] += yl * yl + yr * yr;//两声道相加: 两边是同一个正弦时正好是幅度的平方
+			}
+		}
+		for (int b = 0; b < LaneAlign; ++b)
+		{
+			s.zL1[g + b] = zl1[b]; s.zL2[g + b] = zl2[b]; s.zR1[g + b] = zr1[b]; s.zR2[g + b] = zr2[b];
+			s.acc[g + b] = acc[b];
+		}
+	}
+
+	static void FlushStates(BandSet& s)
+	{
+		for (auto* v : { &s.zL1, &s.zL2, &s.zR1, &s.zR2 })
+			for (auto& z : *v)
+				if (std::abs(z) < StateFloor) z = 0.0f;
+	}
+
+	// 消息线程
+	bool publishedEmpty = true;
+
+	LatestMailbox<BandSet> sets;
+	std::atomic<float> reduction[MaxBands];
+
+	// 音频线程
+	BandSet* current = nullptr;
+	int sinceControl = 0;
+};
@@ -3,7 +3,15 @@
 #include <vector>
 #include <complex>
 #include "biquad.h"
-#include "svf.h"
+#include "stagebank.h"
+#include "firengine.h"
+#include "coeffcache.h"
+#include "dynamicband.h"
+#include "gaindesign.h"
+#include "modulation.h"
+#include "keytrack.h"
+#include "crossover.h"
+#include "oversampler.h"
 
 enum FilterMode {
 	MODE_LOWPASS = 0,
@@ -15,47 +23,902 @@ enum FilterMode {
 	MODE_TILT
 };
 
+enum PhaseMode {
+	PHASE_MINIMUM = 0,	// IIR, 无延迟
+	PHASE_LINEAR		// 分块卷积FIR, 有延迟
+};
+
+// 最小相位模式下的处理引擎, 按开销自动选择
+enum EngineType {
+	ENGINE_IIR = 0,		// SVF级联, 开销和总级数成正比
+	ENGINE_FIR			// 最小相位FIR零延迟卷积, 开销和节点数无关
+};
+
 struct FilterNode {
 	int mode;
 	float cutoff;
 	float q;
 	float gainDB;
 	bool active;
+	DynamicParams dyn;//动态EQ, 默认关
+	ModParams mod;//调制, 默认关
+	KeyTrackParams key;//音高跟踪, 默认关
+	int route = ROUTE_STEREO;//作用的声道(ChannelRoute), 只在IIR引擎上生效
 };
 
-class Equalizer
+class Equalizer : private juce::Thread
 {
 private:
-	static std::complex<float> TransferFunction(const BiquadCoeffs& coeffs, float w)
+	BiquadDesigner designer;
+	juce::SharedResourcePointer<CoeffCache> coeffCache;//进程内共享, 要比所有句柄活得久
+	std::vector<CoeffHandle> coeffs;
+	StageBank banks[2];          // 所有节点展开后的SVF级联, A/B快照各一条
+	std::vector<FilterNode> nodes;
+	std::vector<int> freeIds;
+	int numNodes = 0;
+
+	// 界面的连续编辑交给后台设计线程: 每个节点一个待设计标记, 值总是nodes里最新的
+	// 线程醒来后把所有待设计的节点一起设计, 整体发布一次, 再歇一帧, 期间的编辑合并
+	static constexpr int DesignIntervalMs = 16;
+	juce::CriticalSection coeffLock;//nodes的结构, coeffs, designPending
+	std::vector<unsigned char> designPending;
+	int designGeneration = 0;//切换快照后作废设计线程手上的结果
+	bool designBusy = false;
+
+	// A/B对比: 不在编辑的那份快照连同系数一起存着, 级联也一直在跑, 状态是热的
+	// 切换时消息线程只交换节点表, 音频线程换一个下标, 再从旧级联等功率淡化到新级联
+	static constexpr int SnapshotFadeLength = 2048;
+	struct Snapshot {
+		std::vector<FilterNode> nodes;
+		std::vector<CoeffHandle> coeffs;
+		std::vector<int> freeIds;
+		int numNodes = 0;
+	};
+	Snapshot other;
+	int editSlot = 0;//消息线程: 正在编辑的快照, 0为A, 1为B
+	std::atomic<int> liveSlot{ 0 };
+	std::atomic<bool> comparing{ false };//另一份快照存在, 两条级联都要跑
+	int audioSlot = 0;//音频线程
+	int snapshotFade = 0;
+	std::vector<float> abL, abR;
+	std::vector<double> abDL, abDR;
+
+	FIREngine fir;
+	std::atomic<int> phaseMode{ PHASE_MINIMUM };//消息线程设置
+	// 相位模式切换: 两种模式延迟不同不能交叉淡化, 旧模式先淡出, 清空新模式的状态, 再淡入
+	static constexpr int PhaseFadeLength = 512;
+	std::atomic<int> phaseAudio{ PHASE_MINIMUM };//音频线程正在输出的模式
+	float phaseGain = 1.0f;//音频线程
+
+	// 最小相位下的IIR/FIR自动切换
+	static constexpr int EngineFadeLength = 1024;
+	static constexpr float EngineHysteresis = 0.8f;//新引擎要便宜20%以上才切换, 避免来回跳
+	FIREngine minFir;
+	std::atomic<bool> autoEngine{ true };
+	std::atomic<int> engineTarget{ ENGINE_IIR };//消息线程按开销决定
+	std::atomic<int> engineCurrent{ ENGINE_IIR };//音频线程实际在用的
+	int engineSwitchTo = -1;//音频线程: 正在切换的目标, <0表示没有在切换
+	int engineWarm = 0;
+	int engineFade = 0;
+	float firBlockCost = 0.0f;
+	int hostBlockSize = 512;
+	std::vector<float> scratchL, scratchR;//切换时新引擎的输出
+	std::vector<float> convL, convR;//64位宿主走FIR时的float中转
+
+	// 原地换系数的节点(宿主自动化, 界面增益斜坡, 调制, 音高跟踪)按子块推动, 只在子块边界重新设计, 每ControlSubBlock个样本更新一次
+	static constexpr int MaxInPlaceNodes = 64;
+	static constexpr int ControlSubBlock = 32;
+
+	// 宿主自动化: 块按事件时间切成子块, 事件点之间按VST3的方式线性逼近(频率和Q取对数)
+	static constexpr int MaxAutomationEvents = 1024;
+	struct AutomationEvent {
+		int offset;
+		int id;
+		FilterNode value;
+	};
+	struct AutomatedNode {
+		bool tracked = false;
+		FilterNode point{};//上一个事件点的值
+		int pointOffset = 0;//上一个事件点在当前块中的位置, 之前的块为负
+		int stamp = 0;
+		bool unsent = false;//还没交给消息线程
+	};
+	std::vector<AutomationEvent> events;//prepareToPlay里分配
+	int numEvents = 0;
+	int automationStamp = 0;
+	AutomatedNode automated[MaxInPlaceNodes];
+	juce::SpinLock automationLock;
+	FilterNode automationShared[MaxInPlaceNodes] = {};
+	bool automationDirty[MaxInPlaceNodes] = {};
+	std::atomic<bool> automationRepublish{ false };//级数变了或FIR在用, 要消息线程重新发布
+
+	// 动态节点: 检测在音频线程按控制率做, 增益变了就像自动化一样原地换系数; 只在IIR引擎上生效
+	DynamicBandBank dynamics;
+
+	// 调制节点: LFO/包络按子块推动频率和增益, 同样原地换系数, 只在IIR引擎上生效
+	ModulationBank modulation;
+
+	// MIDI音符: 按时间点切子块, 跟踪节点只在音符的时间点(和滑音的子块)上换系数
+	// 间隔不到MinNoteSegment的音符并到前一个切点上, 再密的MIDI也不会逐样本换系数
+	static constexpr int MaxNoteEvents = 256;
+	static constexpr int MinNoteSegment = 16;
+	struct NoteEvent {
+		int offset;
+		int note;//<0表示全部松开
+		bool on;
+	};
+	std::vector<NoteEvent> noteEvents;//prepareToPlay里分配
+	int numNoteEvents = 0;
+	KeyTrackBank keytrack;
+
+	// 分频输出: 处理后的信号再按Linkwitz-Riley分成几段送到辅助输出, 主输出不受影响
+	Crossover crossover;
+	Crossover::Settings crossoverSettings;
+
+	// 过采样: 截止频率不低于门限的节点按2x/4x的采样率设计, 放进各快照自己的第二条级联, 只有这条在高采样率上跑
+	// 开着时整条信号都穿过升降采样, 延迟不随节点进出门限变化; 最小相位下只走IIR引擎
+	// 线性相位下不升降采样, FIR直接按过采样节点的设计取幅频, 同样没有奈奎斯特附近的压缩
+	StageBank hiBanks[2];
+	Oversampler<float> oversamplers[2];
+	Oversampler<double> oversamplersD[2];
+	BiquadDesigner osDesigners[2];//2x, 4x
+	std::atomic<int> osFactor{ 1 };//1为关
+	std::atomic<int> osPhase{ OVERSAMPLE_LINEAR };
+	std::atomic<float> osThreshold{ 8000.0f };
+	std::vector<CoeffHandle> hiCoeffs;//正在编辑的快照里过采样节点的系数, 给界面算曲线
+	float hiSampleRate = 0.0f;
+
+	// 音频线程按节点缓存GainDesign, 频率和Q不变时自动化/动态/调制/界面的增益变化都只剩增益相关的几步
+	GainDesign gainDesigns[MaxInPlaceNodes];
+
+	// 界面只改增益的峰值/搁架节点: 不经过设计线程和整组发布, 音频线程在GainSmoothLength个样本内按子块平滑换上
+	// CoeffsChanged每次整组发布前gainEditEpoch加一, 音频线程看到变了就丢掉手上的斜坡和之前的编辑(新的一组里已经是目标值)
+	static constexpr int GainSmoothLength = 512;
+	struct GainEdit {
+		FilterNode node;
+		float fromGainDB;//斜坡起点, 即编辑前的增益
+		int epoch;
+	};
+	struct GainRamp {
+		bool active = false;
+		FilterNode target{};
+		float gainDB = 0.0f;//已经换上的增益
+		float step = 0.0f;//每样本
+	};
+	GainDesign editDesign;//消息线程
+	juce::SpinLock gainEditLock;
+	GainEdit gainEditShared[MaxInPlaceNodes] = {};
+	bool gainEditDirty[MaxInPlaceNodes] = {};
+	std::atomic<int> gainEditEpoch{ 0 };
+	std::atomic<bool> gainEditRepublish{ false };//原地换不了, 要消息线程重新发布
+	std::atomic<bool> dynamicRepublish{ false };//动态节点原地换不了, 同上
+	GainRamp gainRamps[MaxInPlaceNodes];//音频线程
+	int numGainRamps = 0;
+	int rampEpoch = 0;
+
+	// 取出活动节点的系数, id和声道路由, 返回总级数
+	static int CollectActive(const std::vector<FilterNode>& nodeList, const std::vector<CoeffHandle>& coeffList,
+		int count, std::vector<BiquadCoeffs>& active, std::vector<int>& ids, std::vector<int>& routes)
+	{
+		int stages = 0;
+		for (int i = 0; i < count; ++i) {
+			if (nodeList[i].active) {
+				active.push_back(*coeffList[i]);
+				ids.push_back(i);
+				routes.push_back(nodeList[i].route);
+				stages += 1 + coeffList[i]->numStages;
+			}
+		}
+		return stages;
+	}
+
+	// 另一份快照的系数发布到它自己的级联上, redesign为真时先按当前采样率重新设计
+	// 活动节点的空句柄表示还没设计
+	void PublishOther(bool redesign)
+	{
+		for (int i = 0; i < other.numNodes; ++i) {
+			const FilterNode& n = other.nodes[i];
+			if (n.active && (redesign || !other.coeffs[i]))
+				other.coeffs[i] = DesignShared(n.mode, n.cutoff, n.q, n.gainDB);
+		}
+		std::vector<BiquadCoeffs> active;
+		std::vector<int> ids, routes;
+		CollectActive(other.nodes, other.coeffs, other.numNodes, active, ids, routes);
+		PublishStages(editSlot ^ 1, other.nodes, active, ids, routes, nullptr);
+	}
+
+	bool IsOversampled(const FilterNode& n) const { return osFactor > 1 && n.cutoff >= osThreshold; }
+
+	// 级联发布到slot: 过采样的节点按高采样率重新设计(经过缓存)放进高采样率的级联, 其余照旧
+	// hiDesigned不为空时按id记下高采样率的系数(静态增益, 给界面和FIR)
+	// withDynamics为真时动态节点按当前被压低后的增益放进级联, 级的分段(float/宽级)和音频线程正要换上的一致
+	void PublishStages(int slot, const std::vector<FilterNode>& nodeList, const std::vector<BiquadCoeffs>& active,
+		const std::vector<int>& ids, const std::vector<int>& routes, std::vector<CoeffHandle>* hiDesigned,
+		bool withDynamics = false)
+	{
+		std::vector<BiquadCoeffs> low, high;
+		std::vector<int> lowIds, highIds, lowRoutes, highRoutes;
+		BiquadDesigner& d = osDesigners[osFactor == 4 ? 1 : 0];
+		if (hiDesigned != nullptr) hiDesigned->assign(nodeList.size(), CoeffHandle());
+		for (size_t k = 0; k < ids.size(); ++k) {
+			const FilterNode& n = nodeList[ids[k]];
+			float offset = withDynamics && n.dyn.enabled ? dynamics.GetGainOffset(ids[k]) : 0.0f;
+			if (IsOversampled(n)) {
+				CoeffHandle c = DesignShared(*coeffCache, d, n.mode, n.cutoff, n.q, n.gainDB);
+				high.push_back(offset != 0.0f ? *DesignShared(*coeffCache, d, n.mode, n.cutoff, n.q, n.gainDB + offset) : *c);
+				highIds.push_back(ids[k]);
+				highRoutes.push_back(routes[k]);
+				if (hiDesigned != nullptr) (*hiDesigned)[ids[k]] = c;
+			}
+			else {
+				low.push_back(offset != 0.0f ? *DesignShared(n.mode, n.cutoff, n.q, n.gainDB + offset) : active[k]);
+				lowIds.push_back(ids[k]);
+				lowRoutes.push_back(routes[k]);
+			}
+		}
+		banks[slot].SetStages(low, lowIds, lowRoutes);
+		hiBanks[slot].SetStages(high, highIds, highRoutes);
+		if (hiDesigned != nullptr) hiSampleRate = d.GetSampleRate();
+	}
+
+	// 系数改变后重新发布级联, 线性相位模式下再请求重新设计FIR
+	void CoeffsChanged()
+	{
+		const juce::ScopedLock lock(coeffLock);
+		std::vector<BiquadCoeffs> active;
+		std::vector<int> ids, routes;
+		int stages = CollectActive(nodes, coeffs, numNodes, active, ids, routes);
+		++gainEditEpoch;
+		PublishStages(editSlot, nodes, active, ids, routes, &hiCoeffs, true);
+		bool anyDynamic = PublishDynamics();
+		bool anyModulated = PublishModulation();
+		bool anyTracked = PublishKeyTrack();
+		bool anyRouted = std::any_of(routes.begin(), routes.end(), [](int r) { return r != ROUTE_STEREO; });
+
+		// FIR只取幅频, 和界面的曲线一样把过采样的节点换成高采样率的设计
+		std::vector<BiquadCoeffs> firCoeffs = active;
+		std::vector<float> scales(active.size(), 1.0f);
+		for (size_t k = 0; k < ids.size(); ++k) {
+			if (hiCoeffs[ids[k]]) {
+				firCoeffs[k] = *hiCoeffs[ids[k]];
+				scales[k] = designer.GetSampleRate() / hiSampleRate;
+			}
+		}
+		if (phaseMode == PHASE_LINEAR)
+		{
+			fir.RequestDesign(firCoeffs, scales);
+			return;
+		}
+
+		// 每级SVF每声道约10次运算; FIR按分块布局估算, 大分块的FFT分摊到每个头分块上
+		// FIR两个声道共用一个核, 线性相位下单声道/中侧节点按立体声处理, 最小相位下有这种节点就留在IIR
+		// 开着过采样时IIR带着升降采样的延迟, 和零延迟的FIR没法交叉淡化, 也留在IIR(从FIR过来时硬切, 见ProcessEngines)
+		int target = engineTarget;
+		if (!autoEngine || firBlockCost <= 0.0f || anyDynamic || anyModulated || anyTracked || anyRouted || osFactor > 1) {
+			target = ENGINE_IIR;//动态/调制/跟踪节点要在块内换系数, 只有IIR做得到
+		}
+		else {
+			float iirBlockCost = (float)hostBlockSize * stages * 2.0f * 10.0f;
+			if (target == ENGINE_IIR && firBlockCost < iirBlockCost * EngineHysteresis) target = ENGINE_FIR;
+			else if (target == ENGINE_FIR && iirBlockCost < firBlockCost * EngineHysteresis) target = ENGINE_IIR;
+		}
+		engineTarget = target;
+
+		// 切回IIR的淡化过程中FIR仍在输出, 也要跟上最新的曲线
+		if (target == ENGINE_FIR || engineCurrent == ENGINE_FIR)
+			minFir.RequestDesign(firCoeffs, scales);
+	}
+
+	// 动态节点和级联一起发布(级联里是当前的动态增益), 音频线程接管后在下一个控制点再换一次; 返回有没有动态节点
+	bool PublishDynamics()
+	{
+		std::vector<DynamicBandBank::Band> list;
+		for (int i = 0; i < numNodes && i < DynamicBandBank::MaxBands; ++i) {
+			const FilterNode& n = nodes[i];
+			if (n.active && n.dyn.enabled)
+				list.push_back({ i, n.mode, n.cutoff, n.q, n.gainDB, n.dyn });
+		}
+		dynamics.SetBands(list, designer.GetSampleRate());
+		return !list.empty();
+	}
+
+	bool PublishModulation()
+	{
+		std::vector<ModulationBank::Band> list;
+		for (int i = 0; i < numNodes && i < ModulationBank::MaxBands; ++i) {
+			const FilterNode& n = nodes[i];
+			if (n.active && n.mod.source != MOD_OFF)
+				list.push_back({ i, n.mode, n.cutoff, n.q, n.gainDB, n.mod });
+		}
+		modulation.SetBands(list, designer.GetSampleRate());
+		return !list.empty();
+	}
+
+	bool PublishKeyTrack()
+	{
+		std::vector<KeyTrackBank::Band> list;
+		for (int i = 0; i < numNodes && i < KeyTrackBank::MaxBands; ++i) {
+			const FilterNode& n = nodes[i];
+			if (n.active && n.key.enabled)
+				list.push_back({ i, n.mode, n.cutoff, n.q, n.gainDB, n.key });
+		}
+		keytrack.SetBands(list, designer.GetSampleRate());
+		return !list.empty();
+	}
+
+	Oversampler<float>& GetOversampler(int slot, const float*) { return oversamplers[slot]; }
+	Oversampler<double>& GetOversampler(int slot, const double*) { return oversamplersD[slot]; }
+
+	// 一份快照的整条IIR: 先是基本采样率的级联, 再在升降采样中间跑高采样率的级联(没开过采样时它是空的)
+	template <typename T>
+	void ProcessStages(int slot, const T* inL, const T* inR, T* outL, T* outR, int numSamples)
+	{
+		banks[slot].Process(inL, inR, outL, outR, numSamples);
+		StageBank& hi = hiBanks[slot];
+		GetOversampler(slot, outL).Process(outL, outR, numSamples, osFactor, osPhase,
+			[&hi](T* l, T* r, int n) { hi.Process(l, r, l, r, n); });
+	}
+
+	void ResetStages(int slot)
+	{
+		banks[slot].Reset();
+		hiBanks[slot].Reset();
+		oversamplers[slot].Reset();
+		oversamplersD[slot].Reset();
+	}
+
+	// A/B比较期间两条级联都跑, 切换后从旧的等功率淡化到新的
+	template <typename T>
+	void ProcessIIR(const T* inL, const T* inR, T* outL, T* outR, int numSamples,
+		std::vector<T>& idleL, std::vector<T>& idleR)
 	{
-		w *= M_PI;
-		std::complex<double> z{ cosf(w), sinf(w) };
-		std::complex<double> z2 = z * z;
-		std::complex<double> numerator = (double)coeffs.b0 + (double)coeffs.b1 * z + (double)coeffs.b2 * z2;
-		std::complex<double> denominator = 1.0 + (double)coeffs.a1 * z + (double)coeffs.a2 * z2;
-		std::complex<double> hnum = numerator;
-		std::complex<double> hden = denominator;
-		for (int i = 0; i < coeffs.numStages; ++i)
+		int slot = liveSlot;
+		if (slot != audioSlot)
+		{
+			audioSlot = slot;
+			snapshotFade = SnapshotFadeLength;
+		}
+		if (!comparing || idleL.empty())
 		{
-			numerator = (double)coeffs.b0s[i] + (double)coeffs.b1s[i] * z + (double)coeffs.b2s[i] * z2;
-			denominator = 1.0 + (double)coeffs.a1s[i] * z + (double)coeffs.a2s[i] * z2;
-			hnum *= numerator;
-			hden *= denominator;
+			snapshotFade = 0;
+			ProcessStages(audioSlot, inL, inR, outL, outR, numSamples);
+			return;
+		}
+
+		for (int offset = 0; offset < numSamples; offset += (int)idleL.size())
+		{
+			int n = std::min(numSamples - offset, (int)idleL.size());
+			// 先算另一条(输入可能和输出是同一块内存)
+			ProcessStages(audioSlot ^ 1, inL + offset, inR + offset, idleL.data(), idleR.data(), n);
+			ProcessStages(audioSlot, inL + offset, inR + offset, outL + offset, outR + offset, n);
+			for (int s = 0; s < n && snapshotFade > 0; ++s, --snapshotFade)
+			{
+				double p = 0.5 * M_PI * (SnapshotFadeLength - snapshotFade) / SnapshotFadeLength;
+				T gNew = (T)sin(p), gOld = (T)cos(p);
+				outL[offset + s] = outL[offset + s] * gNew + idleL[s] * gOld;
+				outR[offset + s] = outR[offset + s] * gNew + idleR[s] * gOld;
+			}
 		}
-		hnum = hnum / hden;
-		return { (float)hnum.real(),(float)hnum.imag() };
 	}
 
+	void ProcessEngine(int engine, const float* inL, const float* inR, float* outL, float* outR, int numSamples)
+	{
+		if (engine == ENGINE_FIR) minFir.Process(inL, inR, outL, outR, numSamples);
+		else ProcessIIR(inL, inR, outL, outR, numSamples, abL, abR);
+	}
 
-	BiquadDesigner designer;
-	std::vector<BiquadCoeffs> coeffs;
-	std::vector<SVF> svfsLeft;   // ˲
-	std::vector<SVF> svfsRight;  // ˲
-	std::vector<FilterNode> nodes;
-	std::vector<int> freeIds;
-	int numNodes = 0;
+	// 引擎当前的延迟: FIR为零, IIR为过采样的升降采样延迟
+	int GetEngineLatency(int engine) const
+	{
+		return engine == ENGINE_IIR ? Oversampler<float>::GetLatencySamples(osFactor, osPhase) : 0;
+	}
+
+	// 两个引擎都是最小相位且幅频一致, 所以可以直接交叉淡化
+	// 新引擎先从清空的状态跑满一个核长(IIR的长尾也足够衰减), 再做等长的线性淡化
+	// 两边延迟不同(IIR开着过采样)时淡化会变成梳状滤波, 跑满后直接切过去
+	void ProcessEngines(const float* inL, const float* inR, float* outL, float* outR, int numSamples)
+	{
+		int current = engineCurrent;
+		if (engineSwitchTo < 0)
+		{
+			int target = engineTarget;
+			if (target == current)
+			{
+				ProcessEngine(current, inL, inR, outL, outR, numSamples);
+				return;
+			}
+			engineSwitchTo = target;//切换开始后目标锁定, 结束后再看有没有变化
+			engineWarm = 0;
+			engineFade = 0;
+			if (engineSwitchTo == ENGINE_FIR) minFir.Reset();
+			else ResetStages(audioSlot);
+		}
+
+		// 先算新引擎(输入可能和输出是同一块内存)
+		ProcessEngine(engineSwitchTo, inL, inR, scratchL.data(), scratchR.data(), numSamples);
+		ProcessEngine(current, inL, inR, outL, outR, numSamples);
+
+		bool ready = engineWarm >= minFir.GetKernelLength() &&
+			(engineSwitchTo == ENGINE_IIR || minFir.IsSettled());
+		if (!ready)
+		{
+			engineWarm += numSamples;
+			return;
+		}
+		if (GetEngineLatency(engineSwitchTo) != GetEngineLatency(current))
+		{
+			memcpy(outL, scratchL.data(), sizeof(float) * numSamples);
+			memcpy(outR, scratchR.data(), sizeof(float) * numSamples);
+			engineCurrent = engineSwitchTo;
+			engineSwitchTo = -1;
+			return;
+		}
+		for (int s = 0; s < numSamples; ++s)
+		{
+			float g = std::min(1.0f, (float)(engineFade + s) / EngineFadeLength);
+			outL[s] += (scratchL[s] - outL[s]) * g;
+			outR[s] += (scratchR[s] - outR[s]) * g;
+		}
+		engineFade += numSamples;
+		if (engineFade >= EngineFadeLength)
+		{
+			engineCurrent = engineSwitchTo;
+			engineSwitchTo = -1;
+		}
+	}
+
+	static int GetGainShape(int mode)
+	{
+		switch (mode) {
+		case MODE_PEAKING:
+			return GainDesign::Peaking;
+		case MODE_LOWSHELF:
+			return GainDesign::Lowshelf;
+		case MODE_HIGHSHELF:
+			return GainDesign::Highshelf;
+		default:
+			return GainDesign::None;
+		}
+	}
+
+	// 音频线程: 节点所在的级联和设计它用的设计器, 过采样的节点在高采样率的那条里
+	StageBank& GetNodeBank(int id, BiquadDesigner*& d)
+	{
+		int factor = osFactor;
+		if (factor > 1 && hiBanks[audioSlot].HasNode(id))
+		{
+			d = &osDesigners[factor == 4 ? 1 : 0];
+			return hiBanks[audioSlot];
+		}
+		d = &designer;
+		return banks[audioSlot];
+	}
+
+	// 音频线程: 峰值/搁架节点用GainDesign直接给出SVF系数(d0 d1 d2 c1 c2), 其余模式返回false
+	bool DesignAudioSVF(int id, int mode, float cutoff, float q, float gainDB, float sampleRate, float* svf)
+	{
+		int shape = GetGainShape(mode);
+		if (shape == GainDesign::None || id >= MaxInPlaceNodes) return false;
+		GainDesign& g = gainDesigns[id];
+		g.Prepare(shape, sampleRate, cutoff, q);
+		g.DesignSVF(gainDB, svf[0], svf[1], svf[2], svf[3], svf[4]);
+		return true;
+	}
+
+	// 音频线程: 级联原地换一个节点的系数(跟踪节点换成跟踪到的频率, 调制节点加上当前的调制量), 峰值/搁架走GainDesign, 不行再完整设计
+	bool UpdateAudioNode(int id, int mode, float cutoff, float q, float gainDB)
+	{
+		cutoff = keytrack.Track(id, cutoff);
+		modulation.Modulate(id, cutoff, gainDB);
+		BiquadDesigner* d;
+		StageBank& bank = GetNodeBank(id, d);
+		float svf[5];
+		if (DesignAudioSVF(id, mode, cutoff, q, gainDB, d->GetSampleRate(), svf) &&
+			bank.UpdateNodeSVF(id, svf[0], svf[1], svf[2], svf[3], svf[4]))
+			return true;
+		return bank.UpdateNode(id, DesignFilter(*d, mode, cutoff, q, gainDB));
+	}
+
+	// 音频线程: 调制节点走一个子块; 单级节点交出SVF系数给ModulationBank插值, 多级节点在控制点上直接换
+	// 换不上(级要换段)时不重新发布, 节点停在上一次的系数上, 等调制回到范围内
+	template <typename T>
+	void AdvanceModulation(const T* inL, const T* inR, const T* keyL, const T* keyR, int numSamples)
+	{
+		bool iirInUse = phaseMode == PHASE_MINIMUM && engineCurrent == ENGINE_IIR && engineSwitchTo < 0;
+		modulation.Advance(inL, inR, keyL, keyR, numSamples, iirInUse,
+			[this](const ModulationBank::Band& b, float cutoff, float gainDB, float* svf)
+			{
+				gainDB += dynamics.GetGainOffset(b.id);
+				BiquadDesigner* d;
+				StageBank& bank = GetNodeBank(b.id, d);
+				if (DesignAudioSVF(b.id, b.mode, cutoff, b.q, gainDB, d->GetSampleRate(), svf)) return true;
+				BiquadCoeffs c = DesignFilter(*d, b.mode, cutoff, b.q, gainDB);
+				if (c.numStages == 0)
+				{
+					BiquadToSVF(c.b0, c.b1, c.b2, c.a1, c.a2, svf[0], svf[1], svf[2], svf[3], svf[4]);
+					return true;
+				}
+				bank.UpdateNode(b.id, c);
+				return false;
+			},
+			[this](int id, const float* svf)
+			{
+				BiquadDesigner* d;
+				GetNodeBank(id, d).UpdateNodeSVF(id, svf[0], svf[1], svf[2], svf[3], svf[4]);
+			});
+	}
+
+	// 音频线程: 跟踪节点走一个子块, 音高变了的节点把新频率交给动态和调制当基础值, 再原地换系数
+	// 和调制一样换不上时不重新发布
+	void AdvanceKeyTrack(int numSamples)
+	{
+		bool iirInUse = phaseMode == PHASE_MINIMUM && engineCurrent == ENGINE_IIR && engineSwitchTo < 0;
+		keytrack.Advance(numSamples, iirInUse, [this](const KeyTrackBank::Band& b, float cutoff)
+			{
+				float offset = dynamics.Rebase(b.id, b.mode, cutoff, b.q, b.gainDB);
+				modulation.Rebase(b.id, b.mode, cutoff, b.q, b.gainDB);
+				UpdateAudioNode(b.id, b.mode, cutoff, b.q, b.gainDB + offset);
+			});
+	}
+
+	void TakeNote(const NoteEvent& e)
+	{
+		if (e.note < 0) keytrack.AllNotesOff();
+		else if (e.on) keytrack.NoteOn(e.note);
+		else keytrack.NoteOff(e.note);
+	}
+
+	// 音频线程: 子块边界上按节点当前值重新设计, 级联原地换系数
+	void ApplyAutomatedNode(int id, const FilterNode& v)
+	{
+		keytrack.Rebase(id, v.mode, v.cutoff, v.q, v.gainDB);
+		float cutoff = keytrack.Track(id, v.cutoff);
+		float offset = dynamics.Rebase(id, v.mode, cutoff, v.q, v.gainDB);
+		modulation.Rebase(id, v.mode, cutoff, v.q, v.gainDB);
+		bool firInUse = phaseMode == PHASE_LINEAR || engineCurrent == ENGINE_FIR || engineSwitchTo >= 0;
+		// 过了过采样门限的节点先在原来的级联里接着换, 由消息线程重新分配
+		bool crossed = osFactor > 1 && (v.cutoff >= osThreshold) != hiBanks[audioSlot].HasNode(id);
+		if (!UpdateAudioNode(id, v.mode, v.cutoff, v.q, v.gainDB + offset) || firInUse || crossed) automationRepublish = true;
+		automated[id].unsent = true;
+	}
+
+	// 音频线程: 取走界面的增益编辑, 拿不到锁就下一块再取
+	void TakeGainEdits()
+	{
+		juce::SpinLock::ScopedTryLockType lock(gainEditLock);
+		if (!lock.isLocked()) return;
+		int epoch = gainEditEpoch;
+		if (epoch != rampEpoch) CancelGainRamps();
+		for (int id = 0; id < MaxInPlaceNodes; ++id)
+		{
+			if (!gainEditDirty[id]) continue;
+			gainEditDirty[id] = false;
+			const GainEdit& e = gainEditShared[id];
+			if (e.epoch != epoch) continue;
+			GainRamp& r = gainRamps[id];
+			if (!r.active)
+			{
+				r.active = true;
+				r.gainDB = e.fromGainDB;
+				++numGainRamps;
+			}
+			r.target = e.node;
+			r.step = (r.target.gainDB - r.gainDB) / (float)GainSmoothLength;
+		}
+	}
+
+	void CancelGainRamps()
+	{
+		for (auto& r : gainRamps) r.active = false;
+		numGainRamps = 0;
+		rampEpoch = gainEditEpoch;
+	}
+
+	// 音频线程: 斜坡上的节点往前走numSamples个样本, 每个子块开头换一次系数
+	void AdvanceGainRamps(int numSamples)
+	{
+		if (gainEditEpoch != rampEpoch)
+		{
+			CancelGainRamps();
+			return;
+		}
+		bool firInUse = phaseMode == PHASE_LINEAR || engineCurrent == ENGINE_FIR || engineSwitchTo >= 0;
+		for (int id = 0; id < MaxInPlaceNodes; ++id)
+		{
+			GainRamp& r = gainRamps[id];
+			if (!r.active) continue;
+			r.gainDB += r.step * numSamples;
+			if ((r.step >= 0.0f) == (r.gainDB >= r.target.gainDB))
+			{
+				r.gainDB = r.target.gainDB;
+				r.active = false;
+				--numGainRamps;
+			}
+			const FilterNode& v = r.target;
+			keytrack.Rebase(id, v.mode, v.cutoff, v.q, r.gainDB);
+			float cutoff = keytrack.Track(id, v.cutoff);
+			float offset = dynamics.Rebase(id, v.mode, cutoff, v.q, r.gainDB);
+			modulation.Rebase(id, v.mode, cutoff, v.q, r.gainDB);
+			if (firInUse || !UpdateAudioNode(id, v.mode, v.cutoff, v.q, r.gainDB + offset))
+			{
+				gainEditRepublish = true;
+				CancelGainRamps();
+				return;
+			}
+		}
+	}
+
+	static FilterNode InterpolateNode(const FilterNode& a, const FilterNode& b, float t)
+	{
+		FilterNode v = b;
+		v.cutoff = a.cutoff * powf(b.cutoff / a.cutoff, t);
+		v.q = a.q * powf(b.q / a.q, t);
+		v.gainDB = a.gainDB + (b.gainDB - a.gainDB) * t;
+		return v;
+	}
+
+	// 块内到pos为止的事件生效, 正在斜坡上的节点按pos插值, 返回下一个子块的结束位置
+	int AdvanceAutomation(int& cursor, int pos, int numSamples)
+	{
+		while (cursor < numEvents && events[cursor].offset <= pos)
+		{
+			const AutomationEvent& e = events[cursor++];
+			AutomatedNode& a = automated[e.id];
+			a.tracked = true;
+			a.point = e.value;
+			a.pointOffset = e.offset;
+			ApplyAutomatedNode(e.id, e.value);
+		}
+
+		// 每个节点在块内的下一个事件点就是它的斜坡终点
+		++automationStamp;
+		int end = cursor < numEvents ? events[cursor].offset : numSamples;
+		for (int i = cursor; i < numEvents; ++i)
+		{
+			const AutomationEvent& e = events[i];
+			AutomatedNode& a = automated[e.id];
+			if (a.stamp == automationStamp) continue;
+			a.stamp = automationStamp;
+			// 从没自动化过, 或上一个点太久远, 或模式不同: 到点直接跳变
+			if (!a.tracked || a.point.mode != e.value.mode || a.pointOffset < -hostBlockSize) continue;
+			if (pos > a.pointOffset)
+			{
+				float t = (float)(pos - a.pointOffset) / (float)(e.offset - a.pointOffset);
+				ApplyAutomatedNode(e.id, InterpolateNode(a.point, e.value, t));
+			}
+			end = std::min(end, pos + ControlSubBlock);
+		}
+		return end;
+	}
+
+	// 音频线程: 把自动化后的值交给消息线程, 拿不到锁就下一块再交
+	void SendAutomation(int numSamples)
+	{
+		juce::SpinLock::ScopedTryLockType lock(automationLock);
+		for (int id = 0; id < MaxInPlaceNodes; ++id)
+		{
+			AutomatedNode& a = automated[id];
+			if (a.tracked) a.pointOffset = std::max(a.pointOffset - numSamples, -hostBlockSize - 1);
+			if (!a.unsent || !lock.isLocked()) continue;
+			automationShared[id] = a.point;
+			automationDirty[id] = true;
+			a.unsent = false;
+		}
+	}
+
+	// 音频线程: 动态节点按控制点切段, 每段先检测输入(原地处理时输入马上会被覆盖), 再换系数, 再处理
+	// 换不上(搁架的级在float和宽级之间换段)时和增益斜坡一样交给消息线程按当前增益重新发布
+	template <typename T>
+	void ProcessDynamic(const T* inL, const T* inR, T* outL, T* outR, int numSamples, const T* keyL, const T* keyR)
+	{
+		if (!dynamics.Adopt())
+		{
+			ProcessSegment(inL, inR, outL, outR, numSamples);
+			return;
+		}
+		bool iirInUse = phaseMode == PHASE_MINIMUM && engineCurrent == ENGINE_IIR && engineSwitchTo < 0;
+		for (int pos = 0; pos < numSamples;)
+		{
+			int n = dynamics.NextControlLength(numSamples - pos);
+			dynamics.Detect(inL + pos, inR + pos, keyL ? keyL + pos : nullptr, keyR ? keyR + pos : nullptr, n);
+			dynamics.Control(n, iirInUse, [this](int id, const DynamicBandBank::Band& b, float gainDB)
+				{
+					if (!UpdateAudioNode(id, b.mode, b.cutoff, b.q, gainDB)) dynamicRepublish = true;
+				});
+			ProcessSegment(inL + pos, inR + pos, outL + pos, outR + pos, n);
+			pos += n;
+		}
+	}
+
+	template <typename T>
+	void ProcessScheduled(const T* inL, const T* inR, T* outL, T* outR, int numSamples, const T* keyL, const T* keyR)
+	{
+		TakeGainEdits();
+		dynamics.Adopt();//跟踪节点要改动态和调制的基础值, 先让它们接管新设置
+		bool modulated = modulation.Adopt();
+		bool tracking = keytrack.Adopt();
+		if (!tracking)
+		{
+			// 没有跟踪节点时音符只记下, 不切块
+			for (int i = 0; i < numNoteEvents; ++i) TakeNote(noteEvents[i]);
+			numNoteEvents = 0;
+		}
+		if (numEvents == 0 && numNoteEvents == 0 && numGainRamps == 0 && !modulated && !(tracking && keytrack.IsMoving()))
+		{
+			ProcessDynamic(inL, inR, outL, outR, numSamples, keyL, keyR);
+			return;
+		}
+		bool hadEvents = numEvents > 0;
+
+		// 宿主一般按时间顺序给, 插入排序几乎不用挪; 相同时间保持到达顺序
+		for (int i = 1; i < numEvents; ++i)
+		{
+			AutomationEvent e = events[i];
+			int j = i - 1;
+			for (; j >= 0 && events[j].offset > e.offset; --j) events[j + 1] = events[j];
+			events[j + 1] = e;
+		}
+		for (int i = 0; i < numEvents; ++i)
+			events[i].offset = juce::jlimit(0, std::max(0, numSamples - 1), events[i].offset);
+		// MidiBuffer本来就按时间排好, 只防宿主给出越界或倒序的时间
+		for (int i = 0; i < numNoteEvents; ++i)
+			noteEvents[i].offset = juce::jlimit(i > 0 ? noteEvents[i - 1].offset : 0, std::max(0, numSamples - 1), noteEvents[i].offset);
+
+		int cursor = 0;
+		int noteCursor = 0;
+		for (int pos = 0; pos < numSamples;)
+		{
+			int end = AdvanceAutomation(cursor, pos, numSamples);
+			while (noteCursor < numNoteEvents && noteEvents[noteCursor].offset <= pos) TakeNote(noteEvents[noteCursor++]);
+			if (noteCursor < numNoteEvents)
+				end = std::min(end, std::max(noteEvents[noteCursor].offset, pos + MinNoteSegment));
+			bool gliding = tracking && keytrack.IsGliding();
+			if (numGainRamps > 0 || modulated || gliding)
+			{
+				end = std::min(end, pos + ControlSubBlock);
+				if (numGainRamps > 0) AdvanceGainRamps(end - pos);
+			}
+			if (tracking) AdvanceKeyTrack(end - pos);
+			if (modulated) AdvanceModulation(inL + pos, inR + pos,
+				keyL ? keyL + pos : nullptr, keyR ? keyR + pos : nullptr, end - pos);
+			ProcessDynamic(inL + pos, inR + pos, outL + pos, outR + pos, end - pos,
+				keyL ? keyL + pos : nullptr, keyR ? keyR + pos : nullptr);
+			pos = end;
+		}
+		while (cursor < numEvents) AdvanceAutomation(cursor, numSamples, numSamples);
+		while (noteCursor < numNoteEvents) TakeNote(noteEvents[noteCursor++]);
+		numEvents = 0;
+		numNoteEvents = 0;
+		if (hadEvents) SendAutomation(numSamples);
+	}
+
+	// 消息线程: 标记节点待设计, 同一节点的多次编辑只设计最后一次
+	void RequestDesign(int id)
+	{
+		{
+			const juce::ScopedLock lock(coeffLock);
+			designPending[id] = 1;
+		}
+		if (!isThreadRunning()) startThread(juce::Thread::Priority::low);
+		notify();
+	}
+
+	// 消息线程(持coeffLock): 峰值/搁架节点只改了增益, 当场用GainDesign算出系数, 交给音频线程平滑地原地换上
+	// 设计线程手上有这个节点、A/B对比中、线性相位或FIR引擎时返回false, 照常走设计线程
+	bool RequestGainEdit(int id, float fromGainDB)
+	{
+		const FilterNode& n = nodes[id];
+		int shape = GetGainShape(n.mode);
+		if (shape == GainDesign::None || id >= MaxInPlaceNodes || designPending[id] || designBusy || comparing) return false;
+		if (phaseMode != PHASE_MINIMUM || engineTarget != ENGINE_IIR || engineCurrent != ENGINE_IIR) return false;
+
+		editDesign.Prepare(shape, designer.GetSampleRate(), n.cutoff, n.q);
+		coeffs[id] = InternDesigned(n, editDesign.Design(n.gainDB));
+		RedesignOversampled(id);
+
+		const juce::SpinLock::ScopedLockType lock(gainEditLock);
+		GainEdit& e = gainEditShared[id];
+		int epoch = gainEditEpoch;
+		if (!gainEditDirty[id] || e.epoch != epoch) e.fromGainDB = fromGainDB;//音频线程还没取走上一次时起点不变
+		e.node = n;
+		e.epoch = epoch;
+		gainEditDirty[id] = true;
+		return true;
+	}
+
+	// 还没设计完的编辑当场设计掉, 快照交换前调用
+	void FlushDesigns()
+	{
+		bool any = designBusy;
+		for (int i = 0; i < numNodes; ++i) {
+			if (designPending[i]) any = true;
+			designPending[i] = 0;
+		}
+		if (!any) return;
+		++designGeneration;
+		for (int i = 0; i < numNodes; ++i) {
+			if (nodes[i].active)
+				coeffs[i] = DesignShared(nodes[i].mode, nodes[i].cutoff, nodes[i].q, nodes[i].gainDB);
+		}
+		CoeffsChanged();
+	}
+
+	void run() override
+	{
+		std::vector<int> ids;
+		std::vector<FilterNode> values;
+		std::vector<CoeffHandle> designed;
+		while (!threadShouldExit())
+		{
+			wait(100);
+
+			// 取走待设计的节点, 设计时不持锁, 界面不会被卡住
+			float sr;
+			int generation;
+			ids.clear();
+			values.clear();
+			{
+				const juce::ScopedLock lock(coeffLock);
+				generation = designGeneration;
+				for (int i = 0; i < numNodes; ++i)
+				{
+					if (!designPending[i]) continue;
+					designPending[i] = 0;
+					ids.push_back(i);
+					values.push_back(nodes[i]);
+				}
+				sr = designer.GetSampleRate();
+				designBusy = !ids.empty();
+			}
+			if (ids.empty()) continue;
+
+			BiquadDesigner d(sr);
+			designed.resize(ids.size());
+			for (size_t k = 0; k < ids.size(); ++k)
+				designed[k] = DesignShared(*coeffCache, d, values[k].mode, values[k].cutoff, values[k].q, values[k].gainDB);
+			if (threadShouldExit()) break;
+
+			// 设计期间节点又被改过(会再设计一次)或被删掉的不写回
+			{
+				const juce::ScopedLock lock(coeffLock);
+				designBusy = false;
+				bool changed = false;
+				for (size_t k = 0; k < ids.size() && generation == designGeneration; ++k)
+				{
+					int id = ids[k];
+					if (id >= numNodes || !nodes[id].active || designPending[id]) continue;
+					coeffs[id] = designed[k];
+					changed = true;
+				}
+				if (changed && designer.GetSampleRate() == sr) CoeffsChanged();
+			}
+			sleep(DesignIntervalMs);
+		}
+	}
 
 	BiquadCoeffs DesignFilter(int mode, float cutoff, float q, float gainDB)
+	{
+		return DesignFilter(designer, mode, cutoff, q, gainDB);
+	}
+
+	// 非实时线程: 经过进程内缓存设计, 参数相同的节点在所有实例间共用一份系数
+	CoeffHandle DesignShared(int mode, float cutoff, float q, float gainDB)
+	{
+		return DesignShared(*coeffCache, designer, mode, cutoff, q, gainDB);
+	}
+
+	static CoeffHandle DesignShared(CoeffCache& cache, BiquadDesigner& d, int mode, float cutoff, float q, float gainDB)
+	{
+		return cache.Get({ mode, cutoff, q, gainDB, d.GetSampleRate() },
+			[&] { return DesignFilter(d, mode, cutoff, q, gainDB); });
+	}
+
+	CoeffHandle InternDesigned(const FilterNode& n, const BiquadCoeffs& c)
+	{
+		return coeffCache->Intern({ n.mode, n.cutoff, n.q, n.gainDB, designer.GetSampleRate() }, c);
+	}
+
+	static BiquadCoeffs DesignFilter(BiquadDesigner& designer, int mode, float cutoff, float q, float gainDB)
 	{
 		switch (mode) {
 		case MODE_LOWPASS:
@@ -77,93 +940,400 @@ private:
 		}
 	}
 
+	void SetDesignRate(float sr)
+	{
+		designer.SetSampleRate(sr);
+		osDesigners[0].SetSampleRate(sr * 2.0f);
+		osDesigners[1].SetSampleRate(sr * 4.0f);
+	}
+
+	// 只换了系数没有重新发布(增益编辑)时, 界面用的高采样率系数跟着重新设计
+	void RedesignOversampled(int id)
+	{
+		if (id >= (int)hiCoeffs.size() || !hiCoeffs[id]) return;
+		const FilterNode& n = nodes[id];
+		hiCoeffs[id] = DesignShared(*coeffCache, osDesigners[osFactor == 4 ? 1 : 0], n.mode, n.cutoff, n.q, n.gainDB);
+	}
+
 public:
-	Equalizer(float sampleRate = 48000.0f) : designer(sampleRate) {}
+	Equalizer(float sampleRate = 48000.0f) : juce::Thread("LMEQ Coeff Designer") { SetDesignRate(sampleRate); }
+	~Equalizer() override { stopThread(2000); }
 
 	void SetSampleRate(float sr)
 	{
-		designer.SetSampleRate(sr);
-		// ¼ϵ
+		const juce::ScopedLock lock(coeffLock);
+		// 系数总是按设计器当前的采样率设计的, 没变就不用重算(恢复状态后紧接着的prepareToPlay)
+		if (sr == designer.GetSampleRate())
+		{
+			CoeffsChanged();
+			if (comparing) PublishOther(false);
+			return;
+		}
+		SetDesignRate(sr);
+		// 重新计算所有系数
 		for (int i = 0; i < numNodes; ++i) {
 			if (nodes[i].active) {
-				coeffs[i] = DesignFilter(nodes[i].mode, nodes[i].cutoff,
+				coeffs[i] = DesignShared(nodes[i].mode, nodes[i].cutoff,
 					nodes[i].q, nodes[i].gainDB);
-				svfsLeft[i].SetBiquadCoeffs(coeffs[i]);
-				svfsRight[i].SetBiquadCoeffs(coeffs[i]);
 			}
 		}
+		CoeffsChanged();
+		if (comparing) PublishOther(true);
+	}
+
+	// prepareToPlay调用, 音频线程未运行
+	void Prepare(float sr, int maxBlockSize)
+	{
+		const juce::ScopedLock lock(coeffLock);
+		fir.Prepare(sr);
+		minFir.Prepare(sr, true);
+		hostBlockSize = std::max(1, maxBlockSize);
+		firBlockCost = minFir.EstimateBlockCost(hostBlockSize);
+		scratchL.assign(hostBlockSize, 0.0f);
+		scratchR.assign(hostBlockSize, 0.0f);
+		convL.assign(hostBlockSize, 0.0f);
+		convR.assign(hostBlockSize, 0.0f);
+		engineTarget = engineCurrent = ENGINE_IIR;
+		engineSwitchTo = -1;
+		phaseAudio = (int)phaseMode;
+		phaseGain = 1.0f;
+		abL.assign(hostBlockSize, 0.0f);
+		abR.assign(hostBlockSize, 0.0f);
+		abDL.assign(hostBlockSize, 0.0);
+		abDR.assign(hostBlockSize, 0.0);
+		audioSlot = liveSlot;
+		snapshotFade = 0;
+		events.resize(MaxAutomationEvents);
+		numEvents = 0;
+		for (auto& a : automated) a = AutomatedNode();
+		noteEvents.resize(MaxNoteEvents);
+		numNoteEvents = 0;
+		keytrack.Reset();
+		CancelGainRamps();
+		SetSampleRate(sr);
+		banks[0].Prepare(hostBlockSize);//按当前节点布局和块长实测选内核
+		banks[1].Prepare(hostBlockSize);
+		for (int slot = 0; slot < 2; ++slot) {
+			hiBanks[slot].Prepare(Oversampler<float>::MaxChunk * Oversampler<float>::MaxFactor);
+			oversamplers[slot].Prepare();
+			oversamplersD[slot].Prepare();
+		}
+		crossover.Prepare(hostBlockSize);
+		crossover.Publish(crossoverSettings, designer.GetSampleRate());
 	}
 
+	void SetPhaseMode(int mode)
+	{
+		phaseMode = mode;
+		CoeffsChanged();
+	}
+	int GetPhaseMode() const { return phaseMode; }
 
-	inline float ProcessSample(float in)
+	// 最小相位下是否允许按开销自动切换到FIR引擎
+	void SetAutoEngine(bool enable)
 	{
-		float out = in;
-		for (int i = 0; i < numNodes; ++i) {
-			if (nodes[i].active) {
-				out = svfsLeft[i].ProcessSample(out);
+		autoEngine = enable;
+		CoeffsChanged();
+	}
+	bool GetAutoEngine() const { return autoEngine; }
+	int GetEngine() const { return engineCurrent; }
+	int GetIIRKernel() const { return banks[editSlot].GetKernel(); }
+	int GetNumWideStages() const { return banks[editSlot].GetNumWideStages(); }
+	float GetIIRKernelCost(int kernel) const { return banks[editSlot].GetKernelCost(kernel); }
+
+	// 线性相位时为FIR半长 + 卷积头分块, 最小相位时为过采样升降的延迟
+	int GetLatencySamples() const
+	{
+		if (phaseAudio == PHASE_LINEAR) return fir.GetLatencySamples();
+		return GetEngineLatency(engineCurrent);//切换中报的是还听得到的那个引擎
+	}
+
+	// 过采样: factor为1(关)/2/4, phase为OversamplePhase, 截止频率不低于threshold的节点在高采样率上处理
+	void SetOversampling(int factor, int phase, float threshold)
+	{
+		const juce::ScopedLock lock(coeffLock);
+		osFactor = factor >= 4 ? 4 : factor >= 2 ? 2 : 1;
+		osPhase = phase == OVERSAMPLE_MINIMUM ? OVERSAMPLE_MINIMUM : OVERSAMPLE_LINEAR;
+		osThreshold = juce::jlimit(1000.0f, 20000.0f, std::isfinite(threshold) ? threshold : 8000.0f);
+		CoeffsChanged();
+		if (comparing) PublishOther(false);
+	}
+	int GetOversamplingFactor() const { return osFactor; }
+	int GetOversamplingPhase() const { return osPhase; }
+	float GetOversamplingThreshold() const { return osThreshold; }
+	bool IsNodeOversampled(int id) const { return IsNodeActive(id) && IsOversampled(nodes[id]); }
+
+
+	// 音频线程, 在ProcessBlock之前调用: offset为本块内的样本位置
+	// 之后的ProcessBlock在offset处切开, 节点在这里到达给定值(上一个事件点之后线性逼近)
+	void ScheduleNodeChange(int offset, int id, int mode, float cutoff, float q, float gainDB)
+	{
+		if (id < 0 || id >= MaxInPlaceNodes || numEvents >= (int)events.size()) return;
+		events[numEvents++] = { offset, id, { mode, cutoff, std::max(q, 0.01f), gainDB, true } };
+	}
+
+	// 音频线程, 在ProcessBlock之前按时间顺序调用: MIDI音符, offset为本块内的样本位置, note < 0为全部松开
+	void ScheduleNote(int offset, int note, bool on)
+	{
+		if (numNoteEvents >= (int)noteEvents.size()) return;
+		noteEvents[numNoteEvents++] = { offset, note, on };
+	}
+
+	// 消息线程定时调用: 把音频线程自动化后的值写回节点, 界面和保存的状态跟着变
+	// 自动化, 增益斜坡或动态节点在音频线程原地换不了(级数变了, 级要换段或FIR在用)时, 在这里重新发布
+	void SyncAutomation()
+	{
+		bool changed = false;
+		{
+			const juce::ScopedLock coeffsLock(coeffLock);
+			const juce::SpinLock::ScopedLockType lock(automationLock);
+			for (int id = 0; id < MaxInPlaceNodes; ++id)
+			{
+				if (!automationDirty[id]) continue;
+				automationDirty[id] = false;
+				if (id >= numNodes || !nodes[id].active) continue;
+				DynamicParams dyn = nodes[id].dyn;//自动化只带基础值
+				ModParams mod = nodes[id].mod;
+				KeyTrackParams key = nodes[id].key;
+				int route = nodes[id].route;
+				nodes[id] = automationShared[id];
+				nodes[id].dyn = dyn;
+				nodes[id].mod = mod;
+				nodes[id].key = key;
+				nodes[id].route = route;
+				coeffs[id] = DesignShared(nodes[id].mode, nodes[id].cutoff, nodes[id].q, nodes[id].gainDB);
+				RedesignOversampled(id);
+				changed = true;
 			}
 		}
-		return out;
+		bool republish = gainEditRepublish.exchange(false);
+		if (dynamicRepublish.exchange(false)) republish = true;
+		if (changed && automationRepublish.exchange(false)) republish = true;
+		if (republish) CoeffsChanged();
 	}
 
-	inline void ProcessSampleStereo(float inL, float inR, float& outL, float& outR)
+	// keyL/keyR为侧链输入, 动态节点选了侧链检测时用, 为空时用主输入
+	void ProcessBlock(const float* inL, const float* inR, float* outL, float* outR, int numSamples,
+		const float* keyL = nullptr, const float* keyR = nullptr)
 	{
-		outL = inL;
-		outR = inR;
-		for (int i = 0; i < numNodes; ++i) {
-			if (nodes[i].active) {
-				outL = svfsLeft[i].ProcessSample(outL);
-				outR = svfsRight[i].ProcessSample(outR);
-			}
+		ProcessScheduled(inL, inR, outL, outR, numSamples, keyL, keyR);
+	}
+
+	void ProcessBlock(const double* inL, const double* inR, double* outL, double* outR, int numSamples,
+		const double* keyL = nullptr, const double* keyR = nullptr)
+	{
+		ProcessScheduled(inL, inR, outL, outR, numSamples, keyL, keyR);
+	}
+
+	// 音频线程: 切到新的相位模式前清空它的全部状态, 免得放出上次停在里面的声音
+	void ResetPhaseMode(int mode)
+	{
+		if (mode == PHASE_LINEAR)
+		{
+			fir.Reset();
+			return;
 		}
+		ResetStages(0);
+		ResetStages(1);
+		minFir.Reset();
+		engineCurrent = ENGINE_IIR;//要走FIR时照常经过ProcessEngines预热和淡化
+		engineSwitchTo = -1;
+		snapshotFade = 0;
 	}
 
-	void ProcessBlock(const float* inL, const float* inR, float* outL, float* outR, int numSamples)
+	void ProcessSegment(const float* inL, const float* inR, float* outL, float* outR, int numSamples)
 	{
-		for (int s = 0; s < numSamples; ++s) {
-			float tempL = inL[s];
-			float tempR = inR[s];
+		int mode = phaseMode;
+		if (mode != phaseAudio && phaseGain <= 0.0f)
+		{
+			ResetPhaseMode(mode);
+			phaseAudio = mode;
+		}
+		ProcessPhase(inL, inR, outL, outR, numSamples);
+		if (mode == phaseAudio && phaseGain >= 1.0f) return;
 
-			for (int i = 0; i < numNodes; ++i) {
-				if (nodes[i].active) {
-					tempL = svfsLeft[i].ProcessSample(tempL);
-					tempR = svfsRight[i].ProcessSample(tempR);
-				}
+		float step = (mode == phaseAudio ? 1.0f : -1.0f) / PhaseFadeLength;
+		for (int s = 0; s < numSamples; ++s)
+		{
+			phaseGain = juce::jlimit(0.0f, 1.0f, phaseGain + step);
+			outL[s] *= phaseGain;
+			outR[s] *= phaseGain;
+		}
+	}
+
+	void ProcessPhase(const float* inL, const float* inR, float* outL, float* outR, int numSamples)
+	{
+		if (phaseAudio == PHASE_LINEAR)
+		{
+			fir.Process(inL, inR, outL, outR, numSamples);
+			return;
+		}
+		if (scratchL.empty())
+		{
+			ProcessIIR(inL, inR, outL, outR, numSamples, abL, abR);
+			return;
+		}
+
+		// 宿主给的块比prepareToPlay时大, 按暂存长度分段
+		for (int offset = 0; offset < numSamples; offset += (int)scratchL.size())
+		{
+			int n = std::min(numSamples - offset, (int)scratchL.size());
+			ProcessEngines(inL + offset, inR + offset, outL + offset, outR + offset, n);
+		}
+	}
+
+
+	// 64位宿主: IIR整条用double算, 走FIR(线性相位/自动切换)时分段转成float
+	void ProcessSegment(const double* inL, const double* inR, double* outL, double* outR, int numSamples)
+	{
+		bool iirOnly = phaseMode == PHASE_MINIMUM && phaseAudio == PHASE_MINIMUM && phaseGain >= 1.0f && engineSwitchTo < 0 &&
+			engineCurrent == ENGINE_IIR && engineTarget == ENGINE_IIR;
+		if (iirOnly || convL.empty())
+		{
+			ProcessIIR(inL, inR, outL, outR, numSamples, abDL, abDR);
+			return;
+		}
+
+		for (int offset = 0; offset < numSamples; offset += (int)convL.size())
+		{
+			int n = std::min(numSamples - offset, (int)convL.size());
+			for (int s = 0; s < n; ++s)
+			{
+				convL[s] = (float)inL[offset + s];
+				convR[s] = (float)inR[offset + s];
+			}
+			ProcessSegment(convL.data(), convR.data(), convL.data(), convR.data(), n);
+			for (int s = 0; s < n; ++s)
+			{
+				outL[offset + s] = convL[s];
+				outR[offset + s] = convR[s];
 			}
+		}
+	}
+
+	// 把正在编辑的快照复制成另一份, 开始A/B比较
+	void CopySnapshotToOther()
+	{
+		const juce::ScopedLock lock(coeffLock);
+		FlushDesigns();
+		other = { nodes, coeffs, freeIds, numNodes };
+		PublishOther(false);
+		comparing = true;
+	}
 
-			outL[s] = tempL;
-			outR[s] = tempR;
+	// 另一份快照从节点列表载入(恢复状态时用), 开始A/B比较
+	// designed为当前采样率下设计好的系数, 可以为空; numStages < 0 的那些重新设计
+	void SetOtherSnapshot(const std::vector<FilterNode>& list, const std::vector<BiquadCoeffs>& designed = {})
+	{
+		const juce::ScopedLock lock(coeffLock);
+		other = Snapshot();
+		for (size_t i = 0; i < list.size(); ++i) {
+			other.nodes.push_back(list[i]);
+			other.nodes.back().active = true;
+			bool has = i < designed.size() && designed[i].numStages >= 0;
+			other.coeffs.push_back(has ? InternDesigned(list[i], designed[i]) : CoeffHandle());
 		}
+		other.numNodes = (int)list.size();
+		PublishOther(false);
+		comparing = true;
 	}
 
+	std::vector<FilterNode> GetOtherSnapshot() const
+	{
+		std::vector<FilterNode> list;
+		if (!comparing) return list;
+		for (int i = 0; i < other.numNodes; ++i)
+			if (other.nodes[i].active) list.push_back(other.nodes[i]);
+		return list;
+	}
+
+	// 切换A/B: 两边的系数和级联都是现成的, 音频线程只换下标并淡化
+	void SwitchSnapshot()
+	{
+		const juce::ScopedLock lock(coeffLock);
+		if (!comparing) return;
+		FlushDesigns();
+		std::swap(nodes, other.nodes);
+		std::swap(coeffs, other.coeffs);
+		std::swap(freeIds, other.freeIds);
+		std::swap(numNodes, other.numNodes);
+		designPending.assign(numNodes, 0);
+		++designGeneration;
+		editSlot ^= 1;
+		liveSlot = editSlot;
+		CoeffsChanged();//级联不变(状态保留), 主要是让FIR引擎跟上
+	}
+
+	// 结束比较, 只保留正在编辑的快照
+	void EndCompare()
+	{
+		const juce::ScopedLock lock(coeffLock);
+		comparing = false;
+		other = Snapshot();
+		banks[editSlot ^ 1].SetStages({}, {});
+		hiBanks[editSlot ^ 1].SetStages({}, {});
+	}
+
+	bool IsComparing() const { return comparing; }
+	int GetSnapshotSlot() const { return editSlot; }
+
+	// 整体替换节点表, 只发布一次; designed的numStages < 0 或为空时重新设计
+	void LoadNodes(const std::vector<FilterNode>& list, const std::vector<BiquadCoeffs>& designed = {})
+	{
+		const juce::ScopedLock lock(coeffLock);
+		++designGeneration;
+		numNodes = (int)list.size();
+		nodes = list;
+		coeffs.resize(numNodes);
+		designPending.assign(numNodes, 0);
+		freeIds.clear();
+		for (int i = 0; i < numNodes; ++i) {
+			nodes[i].active = true;
+			if (i < (int)designed.size() && designed[i].numStages >= 0) coeffs[i] = InternDesigned(nodes[i], designed[i]);
+			else coeffs[i] = DesignShared(nodes[i].mode, nodes[i].cutoff, nodes[i].q, nodes[i].gainDB);
+		}
+		CoeffsChanged();
+	}
 
 	int AddNode(int mode, float cutoff, float q, float gainDB)
 	{
+		const juce::ScopedLock lock(coeffLock);
 		int id;
 		if (!freeIds.empty()) {
-			// ÿID
+			// 复用空闲ID
 			id = freeIds.back();
 			freeIds.pop_back();
 			nodes[id] = { mode, cutoff, q, gainDB, true };
 		}
 		else {
-			// ½ڵ
+			// 创建新节点
 			id = numNodes++;
 			nodes.push_back({ mode, cutoff, q, gainDB, true });
-			coeffs.push_back({ 1.0f, 0.0f, 0.0f, 0.0f, 0.0f });
-			svfsLeft.push_back(SVF());
-			svfsRight.push_back(SVF());
+			coeffs.push_back(CoeffHandle());
+			designPending.push_back(0);
 		}
 
-		coeffs[id] = DesignFilter(mode, cutoff, q, gainDB);
-		svfsLeft[id].SetBiquadCoeffs(coeffs[id]);
-		svfsRight[id].SetBiquadCoeffs(coeffs[id]);
+		coeffs[id] = DesignShared(mode, cutoff, q, gainDB);
+		CoeffsChanged();
 		return id;
 	}
 
+	// id空闲或超出时在这个id上新建节点(宿主打开某一段时用), 中间空出来的id记为空闲
 	void SetNode(int id, int mode, float cutoff, float q, float gainDB)
 	{
-		if (id < 0 || id >= numNodes) return;
+		const juce::ScopedLock lock(coeffLock);
+		if (id < 0) return;
+		while (numNodes <= id) {
+			nodes.push_back({ MODE_PEAKING, 1000.0f, 0.707f, 0.0f, false });
+			coeffs.push_back(CoeffHandle());
+			designPending.push_back(0);
+			if (numNodes < id) freeIds.push_back(numNodes);
+			++numNodes;
+		}
+		if (!nodes[id].active) {
+			freeIds.erase(std::remove(freeIds.begin(), freeIds.end(), id), freeIds.end());
+			nodes[id] = { mode, cutoff, q, gainDB, true };
+		}
 
 		nodes[id].mode = mode;
 		nodes[id].cutoff = cutoff;
@@ -171,30 +1341,117 @@ public:
 		nodes[id].gainDB = gainDB;
 		nodes[id].active = true;
 
-		coeffs[id] = DesignFilter(mode, cutoff, q, gainDB);
-		svfsLeft[id].SetBiquadCoeffs(coeffs[id]);
-		svfsRight[id].SetBiquadCoeffs(coeffs[id]);
+		coeffs[id] = DesignShared(mode, cutoff, q, gainDB);
+		CoeffsChanged();
 	}
 
 	void DeleteNode(int id)
 	{
+		const juce::ScopedLock lock(coeffLock);
 		if (id < 0 || id >= numNodes) return;
 
 		nodes[id].active = false;
-		coeffs[id] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f };
-		svfsLeft[id].SetBiquadCoeffs(coeffs[id]);
-		svfsRight[id].SetBiquadCoeffs(coeffs[id]);
+		coeffs[id] = CoeffHandle();
+		CoeffsChanged();
 		freeIds.push_back(id);
 	}
 
+	// 节点的动态设置; 只有前DynamicBandBank::MaxBands个id可以是动态的
+	void SetNodeDynamics(int id, const DynamicParams& dyn)
+	{
+		const juce::ScopedLock lock(coeffLock);
+		if (id < 0 || id >= numNodes || !nodes[id].active) return;
+		nodes[id].dyn = dyn;
+		nodes[id].dyn.enabled = dyn.enabled && id < DynamicBandBank::MaxBands;
+		CoeffsChanged();
+	}
+
+	static bool CanBeDynamic(int id) { return id >= 0 && id < DynamicBandBank::MaxBands; }
+
+	// 节点的调制设置; 只有前ModulationBank::MaxBands个id可以调制
+	void SetNodeModulation(int id, const ModParams& mod)
+	{
+		const juce::ScopedLock lock(coeffLock);
+		if (id < 0 || id >= numNodes || !nodes[id].active) return;
+		nodes[id].mod = mod;
+		if (id >= ModulationBank::MaxBands) nodes[id].mod.source = MOD_OFF;
+		CoeffsChanged();
+	}
+
+	static bool CanBeModulated(int id) { return id >= 0 && id < ModulationBank::MaxBands; }
+
+	// 界面: 调制节点当前被推到的频率和增益, 不是调制节点时返回false
+	bool GetModulatedValues(int id, float& cutoff, float& gainDB) const { return modulation.GetShownValues(id, cutoff, gainDB); }
+
+	// 节点的音高跟踪设置; 只有前KeyTrackBank::MaxBands个id可以跟踪
+	void SetNodeKeyTrack(int id, const KeyTrackParams& key)
+	{
+		const juce::ScopedLock lock(coeffLock);
+		if (id < 0 || id >= numNodes || !nodes[id].active) return;
+		nodes[id].key = key;
+		if (id >= KeyTrackBank::MaxBands) nodes[id].key.enabled = false;
+		CoeffsChanged();
+	}
+
+	static bool CanKeyTrack(int id) { return id >= 0 && id < KeyTrackBank::MaxBands; }
+
+	// 界面: 跟踪节点当前跟到的频率, 不是跟踪节点或还没有音符时返回false
+	bool GetTrackedCutoff(int id, float& cutoff) const { return keytrack.GetShownCutoff(id, cutoff); }
+
+	// 节点作用的声道(ChannelRoute), 改了之后整组重新发布
+	void SetNodeRoute(int id, int route)
+	{
+		const juce::ScopedLock lock(coeffLock);
+		if (id < 0 || id >= numNodes || !nodes[id].active || route < 0 || route >= NumChannelRoutes) return;
+		if (nodes[id].route == route) return;
+		nodes[id].route = route;
+		CoeffsChanged();
+	}
+
+	static const char* GetRouteName(int route) {
+		static const char* names[] = { "Stereo", "Left", "Right", "Mid", "Side" };
+		if (route >= 0 && route < NumChannelRoutes) return names[route];
+		return "Unknown";
+	}
+
+	// 音频线程, 每块处理前: 宿主的速度(BPM)和位置(拍), 没有位置时ppq给负数
+	void SetTransport(double bpm, double ppq, bool playing) { modulation.SetTransport(bpm, ppq, playing); }
+
+	// 分频设置, numBands为1时关掉
+	void SetCrossover(const Crossover::Settings& settings)
+	{
+		const juce::ScopedLock lock(coeffLock);
+		crossoverSettings = Crossover::Sanitize(settings);
+		crossover.Publish(crossoverSettings, designer.GetSampleRate());
+	}
+
+	Crossover::Settings GetCrossover() const
+	{
+		const juce::ScopedLock lock(coeffLock);
+		return crossoverSettings;
+	}
+
+	// 音频线程, ProcessBlock之后: 把处理好的l/r分段写到bandL/bandR[k], 为空的段跳过
+	template <typename T>
+	void ProcessCrossover(const T* l, const T* r, T* const* bandL, T* const* bandR, int numOutputs, int numSamples)
+	{
+		crossover.Process(l, r, bandL, bandR, numOutputs, numSamples);
+	}
+
+	// 界面: 动态节点当前的增益偏移(dB)
+	float GetDynamicGain(int id) const { return dynamics.GetGainOffset(id); }
+
 	std::complex<float> GetFrequencyResponse(int id, float freq)
 	{
+		const juce::ScopedLock lock(coeffLock);
 		if (id < 0 || id >= numNodes || !nodes[id].active) {
 			return std::complex<float>(1.0f, 0.0f);
 		}
+		if (id < (int)hiCoeffs.size() && hiCoeffs[id])
+			return BiquadTransferFunction(*hiCoeffs[id], 2.0f * freq / hiSampleRate);
 		float f0 = freq / designer.GetSampleRate();
 		float w = 2.0f * f0;
-		return TransferFunction(coeffs[id], w);
+		return BiquadTransferFunction(*coeffs[id], w);
 	}
 
 	std::complex<float> GetTotalFrequencyResponse(float freq)
@@ -215,7 +1472,7 @@ public:
 	}
 	float GetSampleRate() const { return designer.GetSampleRate(); }
 
-	// ȡлڵID
+	// 获取所有活动节点的ID
 	std::vector<int> GetActiveNodeIds() const
 	{
 		std::vector<int> activeIds;
@@ -226,57 +1483,50 @@ public:
 		}
 		return activeIds;
 	}
-	// ýڵıģʽ
+	// 以下为界面的连续编辑: 节点的值立即更新, 系数由设计线程稍后发布
+	// 峰值/搁架节点只改增益时例外, 见RequestGainEdit
+	// 设置节点参数（不改变模式）
 	void UpdateNodeFreqGain(int id, float cutoff, float gainDB)
 	{
 		if (id < 0 || id >= numNodes || !nodes[id].active) return;
 
+		const juce::ScopedLock lock(coeffLock);
+		bool gainOnly = nodes[id].cutoff == cutoff;
+		float from = nodes[id].gainDB;
 		nodes[id].cutoff = cutoff;
 		nodes[id].gainDB = gainDB;
-
-		coeffs[id] = DesignFilter(nodes[id].mode, nodes[id].cutoff,
-			nodes[id].q, nodes[id].gainDB);
-		svfsLeft[id].SetBiquadCoeffs(coeffs[id]);
-		svfsRight[id].SetBiquadCoeffs(coeffs[id]);
+		if (!gainOnly || !RequestGainEdit(id, from)) RequestDesign(id);
 	}
-	// ýڵQֵ
+	// 设置节点Q值
 	void UpdateNodeQ(int id, float q)
 	{
 		if (id < 0 || id >= numNodes || !nodes[id].active) return;
 
+		const juce::ScopedLock lock(coeffLock);
 		nodes[id].q = juce::jlimit(0.1f, 20.0f, q);
-
-		coeffs[id] = DesignFilter(nodes[id].mode, nodes[id].cutoff,
-			nodes[id].q, nodes[id].gainDB);
-		svfsLeft[id].SetBiquadCoeffs(coeffs[id]);
-		svfsRight[id].SetBiquadCoeffs(coeffs[id]);
+		RequestDesign(id);
 	}
-	// ýڵΪ0dB
+	// 重置节点增益为0dB
 	void ResetNodeGain(int id)
 	{
 		if (id < 0 || id >= numNodes || !nodes[id].active) return;
 
+		const juce::ScopedLock lock(coeffLock);
+		float from = nodes[id].gainDB;
 		nodes[id].gainDB = 0.0f;
-
-		coeffs[id] = DesignFilter(nodes[id].mode, nodes[id].cutoff,
-			nodes[id].q, nodes[id].gainDB);
-		svfsLeft[id].SetBiquadCoeffs(coeffs[id]);
-		svfsRight[id].SetBiquadCoeffs(coeffs[id]);
+		if (!RequestGainEdit(id, from)) RequestDesign(id);
 	}
-	// ýڵģʽ
+	// 设置节点模式
 	void SetNodeMode(int id, int mode)
 	{
 		if (id < 0 || id >= numNodes || !nodes[id].active) return;
 
+		const juce::ScopedLock lock(coeffLock);
 		nodes[id].mode = mode;
-
-		coeffs[id] = DesignFilter(nodes[id].mode, nodes[id].cutoff,
-			nodes[id].q, nodes[id].gainDB);
-		svfsLeft[id].SetBiquadCoeffs(coeffs[id]);
-		svfsRight[id].SetBiquadCoeffs(coeffs[id]);
+		RequestDesign(id);
 	}
 
-	// ȡ˲ģʽ
+	// 获取所有滤波器模式的名称
 	static const char* GetFilterModeName(int mode) {
 		static const char* names[] = {
 			"Low Pass", "High Pass", "Band Pass",
@@ -286,26 +1536,274 @@ public:
 		return "Unknown";
 	}
 
-	// ȡõ˲ģʽ
+	// 获取可用的滤波器模式数量
 	static int GetNumFilterModes() { return 7; }
 
 
 
 
-	// ݳ־ûӿ
+	// 二进制状态, 小端:
+	//   头: magic, 版本, 头长度(字节), 采样率, 相位模式, 自动引擎, 分频(版本5起: 段数, 阶数, 4个分频点),
+	//   过采样(版本7起: 倍数, 相位, 门限频率)
+	//   两段节点(正在编辑的, A/B的另一份): 节点数, 然后每个节点一条定长记录
+	//   模式, 频率, Q, 增益, 动态(版本2起: 标志, 阈值, 比例, attack, release),
+	//   调制(版本3起: 来源, 形状, 标志, 速率, 同步拍数, attack, release, 频率深度, 增益深度),
+	//   音高跟踪(版本4起: 标志, 谐波, 滑音时间), 声道路由(版本6起), 级数, 再跟(1 + 级数)组b0 b1 b2 a1 a2
+	// 系数是保存时采样率下设计好的(不含动态增益、调制和跟踪), 同采样率恢复时直接用; 级数为-1表示没带系数
+	static constexpr int StateMagic = 0x32514d4c;//"LMQ2"
+	static constexpr int StateVersion = 7;
+	static constexpr int StateHeaderBytes = 24;
+	static constexpr int StateCrossoverBytes = 8 + 4 * Crossover::MaxSplits;
+	static constexpr int StateOversamplingBytes = 12;
+	static constexpr int StateNodeBytes = 20;
+	static constexpr int StateDynamicBytes = 20;
+	static constexpr int StateModBytes = 36;
+	static constexpr int StateKeyBytes = 12;
+	static constexpr int StateRouteBytes = 4;
+	static constexpr int DynamicFlagEnabled = 1;
+	static constexpr int DynamicFlagSidechain = 2;
+	static constexpr int ModFlagSidechain = 1;
+	static constexpr int KeyFlagEnabled = 1;
+	static constexpr int StateStageBytes = 20;
+
+	void SerializeToBinary(juce::MemoryBlock& dest) const
+	{
+		const juce::ScopedLock lock(coeffLock);
+		juce::MemoryOutputStream out(dest, false);
+		out.writeInt(StateMagic);
+		out.writeInt(StateVersion);
+		out.writeInt(StateHeaderBytes + StateCrossoverBytes + StateOversamplingBytes);
+		out.writeFloat(designer.GetSampleRate());
+		out.writeInt(phaseMode);
+		out.writeInt(autoEngine ? 1 : 0);
+		out.writeInt(crossoverSettings.numBands);
+		out.writeInt(crossoverSettings.order);
+		for (float f : crossoverSettings.freqs) out.writeFloat(f);
+		out.writeInt(osFactor);
+		out.writeInt(osPhase);
+		out.writeFloat(osThreshold);
+
+		auto writeStage = [&](float b0, float b1, float b2, float a1, float a2) {
+			out.writeFloat(b0); out.writeFloat(b1); out.writeFloat(b2); out.writeFloat(a1); out.writeFloat(a2);
+		};
+		auto writeNodes = [&](const std::vector<FilterNode>& list, const std::vector<CoeffHandle>& cs,
+			const unsigned char* pending, int count) {
+			int active = 0;
+			for (int i = 0; i < count; ++i) active += list[i].active ? 1 : 0;
+			out.writeInt(active);
+			for (int i = 0; i < count; ++i) {
+				if (!list[i].active) continue;
+				out.writeInt(list[i].mode);
+				out.writeFloat(list[i].cutoff);
+				out.writeFloat(list[i].q);
+				out.writeFloat(list[i].gainDB);
+				const DynamicParams& d = list[i].dyn;
+				out.writeInt((d.enabled ? DynamicFlagEnabled : 0) | (d.sidechain ? DynamicFlagSidechain : 0));
+				out.writeFloat(d.thresholdDB);
+				out.writeFloat(d.ratio);
+				out.writeFloat(d.attackMs);
+				out.writeFloat(d.releaseMs);
+				const ModParams& m = list[i].mod;
+				out.writeInt(m.source);
+				out.writeInt(m.shape);
+				out.writeInt(m.sidechain ? ModFlagSidechain : 0);
+				out.writeFloat(m.rateHz);
+				out.writeFloat(m.syncBeats);
+				out.writeFloat(m.attackMs);
+				out.writeFloat(m.releaseMs);
+				out.writeFloat(m.depthOctaves);
+				out.writeFloat(m.depthDB);
+				const KeyTrackParams& k = list[i].key;
+				out.writeInt(k.enabled ? KeyFlagEnabled : 0);
+				out.writeFloat(k.harmonic);
+				out.writeFloat(k.glideMs);
+				out.writeInt(list[i].route);
+				// 设计线程还没跟上的节点不带系数
+				if (designBusy || (pending != nullptr && pending[i])) {
+					out.writeInt(-1);
+					continue;
+				}
+				const BiquadCoeffs& c = *cs[i];
+				out.writeInt(c.numStages);
+				writeStage(c.b0, c.b1, c.b2, c.a1, c.a2);
+				for (int j = 0; j < c.numStages; ++j)
+					writeStage(c.b0s[j], c.b1s[j], c.b2s[j], c.a1s[j], c.a2s[j]);
+			}
+		};
+		writeNodes(nodes, coeffs, designPending.data(), numNodes);
+		writeNodes(other.nodes, other.coeffs, nullptr, comparing ? other.numNodes : 0);
+	}
+
+	// 一遍读完并校验, 格式不对返回false且不改动任何状态
+	bool DeserializeFromBinary(const void* data, int sizeInBytes)
+	{
+		if (data == nullptr || sizeInBytes < StateHeaderBytes + 8) return false;
+		juce::MemoryInputStream in(data, (size_t)sizeInBytes, false);
+		if (in.readInt() != StateMagic) return false;
+		int version = in.readInt();
+		int headerBytes = in.readInt();
+		if (version < 1 || version > StateVersion || headerBytes < StateHeaderBytes || headerBytes > sizeInBytes) return false;
+		float sr = in.readFloat();
+		int newPhaseMode = in.readInt();
+		int newAutoEngine = in.readInt();
+		if (!(sr >= 8000.0f && sr <= 768000.0f) || (newPhaseMode != PHASE_MINIMUM && newPhaseMode != PHASE_LINEAR)) return false;
+		Crossover::Settings newCrossover;
+		int extraBytes = headerBytes - StateHeaderBytes;
+		if (version >= 5 && extraBytes >= StateCrossoverBytes)
+		{
+			newCrossover.numBands = in.readInt();
+			newCrossover.order = in.readInt();
+			for (float& f : newCrossover.freqs) f = in.readFloat();
+			if (newCrossover.numBands < 1 || newCrossover.numBands > Crossover::MaxBands ||
+				(newCrossover.order != 4 && newCrossover.order != 8))
+				return false;
+			for (float f : newCrossover.freqs)
+				if (!(f >= Crossover::MinFreq && f <= Crossover::MaxFreq)) return false;
+			extraBytes -= StateCrossoverBytes;
+		}
+		int newFactor = 1, newOsPhase = OVERSAMPLE_LINEAR;
+		float newThreshold = 8000.0f;
+		if (version >= 7 && extraBytes >= StateOversamplingBytes)
+		{
+			newFactor = in.readInt();
+			newOsPhase = in.readInt();
+			newThreshold = in.readFloat();
+			if ((newFactor != 1 && newFactor != 2 && newFactor != 4) ||
+				(newOsPhase != OVERSAMPLE_LINEAR && newOsPhase != OVERSAMPLE_MINIMUM) || !(newThreshold >= 1000.0f && newThreshold <= 20000.0f))
+				return false;
+			extraBytes -= StateOversamplingBytes;
+		}
+		in.skipNextBytes(extraBytes);//新版本在头里加的字段
+
+		const int nodeBytes = StateNodeBytes + (version >= 2 ? StateDynamicBytes : 0) + (version >= 3 ? StateModBytes : 0) +
+			(version >= 4 ? StateKeyBytes : 0) + (version >= 6 ? StateRouteBytes : 0);
+		std::vector<FilterNode> lists[2];
+		std::vector<BiquadCoeffs> designed[2];
+		for (int part = 0; part < 2; ++part)
+		{
+			if (in.getNumBytesRemaining() < 4) return false;
+			int count = in.readInt();
+			if (count < 0 || count > in.getNumBytesRemaining() / nodeBytes) return false;
+			lists[part].resize(count);
+			designed[part].resize(count);
+			for (int i = 0; i < count; ++i)
+			{
+				if (in.getNumBytesRemaining() < nodeBytes) return false;
+				FilterNode& n = lists[part][i];
+				n.mode = in.readInt();
+				n.cutoff = in.readFloat();
+				n.q = in.readFloat();
+				n.gainDB = in.readFloat();
+				n.active = true;
+				n.dyn = DynamicParams();
+				if (version >= 2)
+				{
+					int flags = in.readInt();
+					n.dyn.enabled = (flags & DynamicFlagEnabled) != 0;
+					n.dyn.sidechain = (flags & DynamicFlagSidechain) != 0;
+					n.dyn.thresholdDB = in.readFloat();
+					n.dyn.ratio = in.readFloat();
+					n.dyn.attackMs = in.readFloat();
+					n.dyn.releaseMs = in.readFloat();
+					if (!std::isfinite(n.dyn.thresholdDB) || !(n.dyn.ratio >= 1.0f && n.dyn.ratio <= 100.0f) ||
+						!(n.dyn.attackMs > 0.0f && n.dyn.attackMs < 1e4f) || !(n.dyn.releaseMs > 0.0f && n.dyn.releaseMs < 1e5f))
+						return false;
+				}
+				n.mod = ModParams();
+				if (version >= 3)
+				{
+					ModParams& m = n.mod;
+					m.source = in.readInt();
+					m.shape = in.readInt();
+					m.sidechain = (in.readInt() & ModFlagSidechain) != 0;
+					m.rateHz = in.readFloat();
+					m.syncBeats = in.readFloat();
+					m.attackMs = in.readFloat();
+					m.releaseMs = in.readFloat();
+					m.depthOctaves = in.readFloat();
+					m.depthDB = in.readFloat();
+					if (m.source < MOD_OFF || m.source > MOD_ENVELOPE || m.shape < LFO_SINE || m.shape > LFO_SQUARE ||
+						!(m.rateHz >= 0.0f && m.rateHz <= 100.0f) || !(m.syncBeats >= 0.0f && m.syncBeats <= 64.0f) ||
+						!(m.attackMs > 0.0f && m.attackMs < 1e4f) || !(m.releaseMs > 0.0f && m.releaseMs < 1e5f) ||
+						!(std::abs(m.depthOctaves) <= 10.0f) || !(std::abs(m.depthDB) <= 48.0f))
+						return false;
+				}
+				n.key = KeyTrackParams();
+				if (version >= 4)
+				{
+					KeyTrackParams& k = n.key;
+					k.enabled = (in.readInt() & KeyFlagEnabled) != 0;
+					k.harmonic = in.readFloat();
+					k.glideMs = in.readFloat();
+					if (!(k.harmonic > 0.0f && k.harmonic <= 64.0f) || !(k.glideMs >= 0.0f && k.glideMs <= 1e4f))
+						return false;
+				}
+				n.route = ROUTE_STEREO;
+				if (version >= 6)
+				{
+					n.route = in.readInt();
+					if (n.route < 0 || n.route >= NumChannelRoutes) return false;
+				}
+				int stages = in.readInt();
+				if (n.mode < 0 || n.mode >= GetNumFilterModes() || !(n.cutoff > 0.0f && n.cutoff < 1e6f) ||
+					!(n.q > 0.0f && n.q < 1e3f) || !std::isfinite(n.gainDB) || stages < -1 || stages > MaxBiquadStages)
+					return false;
+
+				BiquadCoeffs& c = designed[part][i];
+				c.numStages = -1;
+				if (stages < 0) continue;
+				if (in.getNumBytesRemaining() < (juce::int64)(1 + stages) * StateStageBytes) return false;
+				float v[5];
+				bool finite = true;
+				for (int j = -1; j < stages; ++j)
+				{
+					for (auto& x : v) {
+						x = in.readFloat();
+						finite = finite && std::isfinite(x);
+					}
+					if (j < 0) { c.b0 = v[0]; c.b1 = v[1]; c.b2 = v[2]; c.a1 = v[3]; c.a2 = v[4]; }
+					else { c.b0s[j] = v[0]; c.b1s[j] = v[1]; c.b2s[j] = v[2]; c.a1s[j] = v[3]; c.a2s[j] = v[4]; }
+				}
+				c.numStages = finite ? stages : -1;//坏掉的系数重新设计
+			}
+		}
+
+		// 保存的系数只在保存时的采样率和正在运行的一致时直接用, 否则按运行的采样率重新设计
+		// 运行的采样率不跟着状态走: 音频线程可能正在用它, 分频也按它发布
+		const juce::ScopedLock lock(coeffLock);
+		float runningRate = designer.GetSampleRate();
+		if (sr != runningRate)
+		{
+			for (auto& part : designed)
+				for (auto& c : part) c.numStages = -1;
+		}
+		phaseMode = newPhaseMode;
+		autoEngine = newAutoEngine != 0;
+		crossoverSettings = Crossover::Sanitize(newCrossover);
+		crossover.Publish(crossoverSettings, runningRate);
+		osFactor = newFactor;
+		osPhase = newOsPhase;
+		osThreshold = newThreshold;
+		LoadNodes(lists[0], designed[0]);
+		if (!lists[1].empty()) SetOtherSnapshot(lists[1], designed[1]);
+		else EndCompare();
+		return true;
+	}
+
+	// 数据持久化接口
 	struct EqualizerState {
 		float sampleRate;
 		int numNodes;
 		std::vector<FilterNode> activeNodes;
 		std::vector<int> nodeIds;
 	};
-	// ȡǰ״̬ڳ־û
+	// 获取当前状态用于持久化
 	EqualizerState GetState() const {
 		EqualizerState state;
 		state.sampleRate = designer.GetSampleRate();
 		state.numNodes = numNodes;
 
-		// лڵ
+		// 保存所有活动节点
 		for (int i = 0; i < numNodes; ++i) {
 			if (nodes[i].active) {
 				state.activeNodes.push_back(nodes[i]);
@@ -315,22 +1813,22 @@ public:
 
 		return state;
 	}
-	// ״ָ̬
+	// 从状态恢复
 	void SetState(const EqualizerState& state) {
-		// ״̬
+		// 清除现有状态
 		Clear();
 
-		// ò
-		designer.SetSampleRate(state.sampleRate);
+		// 保存时的采样率只作记录, 节点按正在运行的采样率设计
 
-		// ָڵ
+		// 恢复节点
 		for (size_t i = 0; i < state.activeNodes.size(); ++i) {
 			const FilterNode& node = state.activeNodes[i];
 			AddNode(node.mode, node.cutoff, node.q, node.gainDB);
 		}
 	}
-	// нڵ
+	// 清除所有节点
 	void Clear() {
+		const juce::ScopedLock lock(coeffLock);
 		for (int i = 0; i < numNodes; ++i) {
 			if (nodes[i].active) {
 				DeleteNode(i);
@@ -340,10 +1838,10 @@ public:
 		numNodes = 0;
 		nodes.clear();
 		coeffs.clear();
-		svfsLeft.clear();
-		svfsRight.clear();
+		designPending.clear();
+		CoeffsChanged();
 	}
-	// лΪַ򵥸ʽ
+	// 序列化为字符串（简单格式）
 	std::string SerializeToString() const {
 		std::ostringstream oss;
 		oss << designer.GetSampleRate() << "|";
@@ -359,25 +1857,24 @@ public:
 
 		return oss.str();
 	}
-	// ַл
+	// 从字符串反序列化
 	bool DeserializeFromString(const std::string& data) {
 		std::istringstream iss(data);
 		std::string token;
 
 		try {
-			// ȡ
+			// 保存时的采样率只作记录, 节点按正在运行的采样率设计
 			if (!std::getline(iss, token, '|')) return false;
-			float sampleRate = std::stof(token);
+			std::stof(token);
 
-			// ȡڵ
+			// 读取节点数量
 			if (!std::getline(iss, token, '|')) return false;
 			int nodeCount = std::stoi(token);
 
-			// ״̬
+			// 清除现有状态
 			Clear();
-			designer.SetSampleRate(sampleRate);
 
-			// ȡÿڵ
+			// 读取每个节点
 			for (int i = 0; i < nodeCount; ++i) {
 				if (!std::getline(iss, token, '|')) return false;
 
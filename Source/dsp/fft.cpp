@@ -106,3 +106,45 @@ void fft_f32(float* are, float* aim, int n, int inv)
 		}
 	}
 }
+
+void fft_f64(double* are, double* aim, int n, int inv)
+{
+	for (int i = 1, j = 0; i < n - 1; ++i)
+	{
+		for (int s = n; j ^= s >>= 1, ~j & s;)
+			;
+		if (i < j)
+		{
+			double tmp = are[i];
+			are[i] = are[j];
+			are[j] = tmp;
+			tmp = aim[i];
+			aim[i] = aim[j];
+			aim[j] = tmp;
+		}
+	}
+
+	int p1, p2;
+	for (int m = 2; m <= n; m <<= 1)
+	{
+		p1 = m >> 1;
+		for (int j = 0; j < p1; ++j)
+		{
+			// 旋转因子直接计算, 不用递推, 避免长变换的累积误差
+			double w_re = cos(2.0 * M_PI * j / m);
+			double w_im = sin(2.0 * M_PI * j / m) * inv;
+
+			for (int k = 0; k < n; k += m)
+			{
+				p2 = k + j;
+				double t_re = w_re * are[p2 + p1] - w_im * aim[p2 + p1];
+				double t_im = w_re * aim[p2 + p1] + w_im * are[p2 + p1];
+
+				are[p2 + p1] = are[p2] - t_re;
+				aim[p2 + p1] = aim[p2] - t_im;
+				are[p2] += t_re;
+				aim[p2] += t_im;
+			}
+		}
+	}
+}
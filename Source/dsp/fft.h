@@ -5,21 +5,57 @@
 
 void fft_f32(float* are, float* aim, int n, int inv);
 void fft_f32(std::vector<float>& are, std::vector<float>& aim, int n, int inv);
+void fft_f64(double* are, double* aim, int n, int inv);//设计滤波器核用, 精度优先
 
+// 多路信号打包成一个lane类型, 一次变换N路同样长度的信号, 旋转因子各路共用
+// 普通数组加逐lane循环, x64下编译器直接生成SSE/AVX指令
+template<int N>
+struct FloatLanes
+{
+	alignas(N * sizeof(float)) float v[N];
+
+	FloatLanes() = default;
+	FloatLanes(float x) { for (int l = 0; l < N; ++l) v[l] = x; }
+
+	FloatLanes operator+(const FloatLanes& o) const { FloatLanes r; for (int l = 0; l < N; ++l) r.v[l] = v[l] + o.v[l]; return r; }
+	FloatLanes operator-(const FloatLanes& o) const { FloatLanes r; for (int l = 0; l < N; ++l) r.v[l] = v[l] - o.v[l]; return r; }
+	FloatLanes operator*(float s) const { FloatLanes r; for (int l = 0; l < N; ++l) r.v[l] = v[l] * s; return r; }
+	FloatLanes& operator+=(const FloatLanes& o) { for (int l = 0; l < N; ++l) v[l] += o.v[l]; return *this; }
+};
+
+typedef FloatLanes<4> FloatLanes4;
+typedef FloatLanes<8> FloatLanes8;
+
+// sample是lane类型, 需要支持+ - += 和乘float
 template<typename sample>
 class FFT
 {
 private:
-	sample w_re;
-	sample w_im;
-public:
-	void fft_f32(sample* are, sample* aim, int n, int inv)
+	std::vector<float> w_re;//旋转因子表, n/2个, 所有lane共用
+	std::vector<float> w_im;
+	int tableSize = 0;
+	int tableInv = 0;
+
+	void MakeTable(int n, int inv)
 	{
-		if (w_re.size() < are[0].size())//·À±¬
+		if (tableSize == n && tableInv == inv) return;
+		w_re.resize(n / 2);
+		w_im.resize(n / 2);
+		for (int k = 0; k < n / 2; ++k)
 		{
-			w_re.resize(are[0].size());
-			w_im.resize(are[0].size());
+			double a = 2.0 * 3.14159265358979323846 * k / n;
+			w_re[k] = (float)cos(a);
+			w_im[k] = (float)sin(a) * inv;
 		}
+		tableSize = n;
+		tableInv = inv;
+	}
+
+public:
+	// 表按最近一次的长度缓存, 同一个对象不要在多个线程里同时用
+	void fft_f32(sample* are, sample* aim, int n, int inv)
+	{
+		MakeTable(n, inv);
 
 		for (int i = 1, j = 0; i < n - 1; ++i)
 		{
@@ -39,35 +75,57 @@ public:
 		int p1, p2;
 		for (int m = 2; m <= n; m <<= 1)
 		{
-			float wm_re = cosf(2.0f * M_PI / m);
-			float wm_im = sinf(2.0f * M_PI / m) * inv;
-
+			int step = n / m;
+			p1 = m >> 1;
 			for (int k = 0; k < n; k += m)
 			{
-				w_re = 1.0f;
-				w_im = 0.0f;
-				p1 = m >> 1;
-
 				for (int j = 0; j < p1; ++j)
 				{
 					p2 = k + j;
-					// ¼ÆËã t = w * a[p2 + p1]
-					sample t_re = w_re * are[p2 + p1] - w_im * aim[p2 + p1];
-					sample t_im = w_re * aim[p2 + p1] + w_im * are[p2 + p1];
+					float wr = w_re[j * step];
+					float wi = w_im[j * step];
+					// 计算 t = w * a[p2 + p1]
+					sample t_re = are[p2 + p1] * wr - aim[p2 + p1] * wi;
+					sample t_im = aim[p2 + p1] * wr + are[p2 + p1] * wi;
 
-					// ¸üÐÂ a[p2] ºÍ a[p2 + p1]
+					// 更新 a[p2] 和 a[p2 + p1]
 					are[p2 + p1] = are[p2] - t_re;
 					aim[p2 + p1] = aim[p2] - t_im;
 					are[p2] += t_re;
 					aim[p2] += t_im;
-
-					// ¸üÐÂ w = w * wm
-					t_re = w_re * wm_re - w_im * wm_im;
-					t_im = w_re * wm_im + w_im * wm_re;
-					w_re = t_re;
-					w_im = t_im;
 				}
 			}
 		}
 	}
-};
\ No newline at end of file
+
+	// 把lanes路信号打包成lane类型(多出来的lane补0), 变换后再拆回各自的数组
+	void fft_batch(float* const* re, float* const* im, int lanes, int n, int inv)
+	{
+		const int N = (int)(sizeof(sample) / sizeof(float));
+		if ((int)packRe.size() < n)
+		{
+			packRe.resize(n);
+			packIm.resize(n);
+		}
+		for (int i = 0; i < n; ++i)
+		{
+			for (int l = 0; l < N; ++l)
+			{
+				packRe[i].v[l] = l < lanes ? re[l][i] : 0.0f;
+				packIm[i].v[l] = l < lanes ? im[l][i] : 0.0f;
+			}
+		}
+		fft_f32(packRe.data(), packIm.data(), n, inv);
+		for (int i = 0; i < n; ++i)
+		{
+			for (int l = 0; l < lanes; ++l)
+			{
+				re[l][i] = packRe[i].v[l];
+				im[l][i] = packIm[i].v[l];
+			}
+		}
+	}
+
+private:
+	std::vector<sample> packRe, packIm;
+};
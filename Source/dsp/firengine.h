@@ -0,0 +1,264 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include <atomic>
+#include "biquad.h"
+#include "convolver.h"
+#include "mailbox.h"
+
+// 由IIR级联的幅频响应设计FIR, 在后台线程完成, 再交给分块卷积器
+// 线性相位: 零相位谱 -> IFFT -> 平移到中心 -> 加窗, 整体延迟 = 核长/2 + 头分块
+// 最小相位: 对数幅度谱 -> 倒谱折叠 -> exp -> IFFT, 核头直接卷积, 零延迟
+// 卷积开销只和核长有关, 与节点数和级数无关
+class FIREngine : private juce::Thread
+{
+private:
+	static constexpr int HeadSize = 128;
+	static constexpr int DirectSize = 64;
+	static constexpr int MaxBlockSize = 8192;
+
+	PartitionedConvolver convolver;
+	int kernelLength = 8192;
+	bool minimumPhase = false;
+	bool designed = false;//音频线程: 已经换上了设计好的核
+	int warmSamples = 0;//音频线程: Reset之后送进的样本数
+
+	// 消息线程 -> 设计线程, 只保留最新一份
+	juce::CriticalSection requestLock;
+	std::vector<BiquadCoeffs> requestCoeffs;
+	std::vector<float> requestScales;//各组系数的频率缩放, 按k倍采样率设计的为1/k
+	bool hasRequest = false;
+
+	// 设计线程 <-> 音频线程
+	LatestMailbox<ConvolutionKernel> kernels;
+
+	static void DesignLinearPhase(const std::vector<BiquadCoeffs>& coeffs, const std::vector<float>& scales, int length,
+		std::vector<float>& taps)
+	{
+		// 频率网格取核长的2倍, 减少IIR长尾造成的时域混叠
+		int n = length * 2;
+		std::vector<double> re(n, 0.0), im(n, 0.0);
+		for (int k = 0; k <= n / 2; ++k)
+		{
+			float w = 2.0f * k / n;
+			double mag = 1.0;
+			for (size_t i = 0; i < coeffs.size(); ++i)
+				mag *= std::abs(BiquadTransferFunction(coeffs[i], w * scales[i]));
+			re[k] = mag;
+			if (k > 0 && k < n / 2) re[n - k] = mag;
+		}
+		fft_f64(re.data(), im.data(), n, 1);
+
+		// 零相位脉冲在0点, 取[-length/2, length/2)平移到中心并加Blackman窗
+		taps.assign(length, 0.0f);
+		int half = length / 2;
+		for (int i = 0; i < length; ++i)
+		{
+			int src = (i - half + n) % n;
+			double x = (double)i / length;
+			double win = 0.42 - 0.5 * cos(2.0 * M_PI * x) + 0.08 * cos(4.0 * M_PI * x);
+			taps[i] = (float)(re[src] / n * win);
+		}
+	}
+
+	//A. V. Oppenheim, R. W. Schafer, "Discrete-Time Signal Processing", 3rd ed., ch. 13 (real cepstrum)
+	static void DesignMinimumPhase(const std::vector<BiquadCoeffs>& coeffs, const std::vector<float>& scales, int length,
+		std::vector<float>& taps)
+	{
+		// 网格取核长的4倍, 降低倒谱混叠
+		int n = length * 4;
+		std::vector<double> re(n, 0.0), im(n, 0.0);
+		for (int k = 0; k <= n / 2; ++k)
+		{
+			float w = 2.0f * k / n;
+			double mag = 1.0;
+			for (size_t i = 0; i < coeffs.size(); ++i)
+				mag *= std::abs(BiquadTransferFunction(coeffs[i], w * scales[i]));
+			double lg = log(std::max(mag, 1e-10));//阻带限制在-200dB
+			re[k] = lg;
+			if (k > 0 && k < n / 2) re[n - k] = lg;
+		}
+		fft_f64(re.data(), im.data(), n, 1);
+
+		// 实倒谱折叠成因果序列: c[0]不变, 正时间×2, 负时间清零
+		for (int i = 0; i < n; ++i)
+		{
+			double c = re[i] / n;
+			if (i > 0 && i < n / 2) c *= 2.0;
+			else if (i > n / 2) c = 0.0;
+			re[i] = c;
+			im[i] = 0.0;
+		}
+		fft_f64(re.data(), im.data(), n, -1);
+
+		for (int k = 0; k < n; ++k)
+		{
+			double mag = exp(re[k]);
+			double ph = im[k];
+			re[k] = mag * cos(ph);
+			im[k] = mag * sin(ph);
+		}
+		fft_f64(re.data(), im.data(), n, 1);
+
+		// 能量集中在开头, 只在最后1/8做半个Hann淡出
+		taps.assign(length, 0.0f);
+		int tail = length / 8;
+		for (int i = 0; i < length; ++i)
+		{
+			double win = 1.0;
+			if (i >= length - tail) win = 0.5 + 0.5 * cos(M_PI * (i - (length - tail)) / tail);
+			taps[i] = (float)(re[i] / n * win);
+		}
+	}
+
+	void run() override
+	{
+		std::vector<BiquadCoeffs> coeffs;
+		std::vector<float> scales, taps;
+		while (!threadShouldExit())
+		{
+			wait(100);
+			kernels.FreeRetired();
+
+			{
+				juce::ScopedLock lock(requestLock);
+				if (!hasRequest) continue;
+				coeffs = requestCoeffs;
+				scales = requestScales;
+				hasRequest = false;
+			}
+
+			if (minimumPhase) DesignMinimumPhase(coeffs, scales, kernelLength, taps);
+			else DesignLinearPhase(coeffs, scales, kernelLength, taps);
+			if (threadShouldExit()) break;
+
+			ConvolutionKernel* kernel = new ConvolutionKernel();
+			kernel->Build(taps.data(), (int)taps.size(), convolver.GetLayout(), convolver.GetDirectLength());
+			kernels.Publish(kernel);
+		}
+	}
+
+public:
+	FIREngine() : juce::Thread("LMEQ FIR Designer") {}
+	~FIREngine() override
+	{
+		stopThread(2000);
+		kernels.Clear();
+		delete convolver.GetActiveKernel();
+		delete convolver.GetFadingKernel();
+	}
+
+	// 非实时线程调用(prepareToPlay / 采样率改变), 此时音频线程不在运行
+	void Prepare(float sr, bool minPhase = false)
+	{
+		stopThread(2000);
+		kernels.Clear();
+		delete convolver.GetActiveKernel();
+		delete convolver.GetFadingKernel();
+
+		minimumPhase = minPhase;
+		if (minimumPhase)
+		{
+			// 最小相位的能量集中在开头, 核长取线性相位的一半
+			kernelLength = sr <= 50000.0f ? 4096 : (sr <= 100000.0f ? 8192 : 16384);
+			convolver.Prepare(DirectSize, MaxBlockSize, kernelLength, true);
+		}
+		else
+		{
+			kernelLength = sr <= 50000.0f ? 8192 : (sr <= 100000.0f ? 16384 : 32768);
+			convolver.Prepare(HeadSize, MaxBlockSize, kernelLength);
+		}
+
+		// 初始核为单位脉冲(线性相位放在中心), 设计完成前也保持相同延迟
+		std::vector<float> taps(kernelLength, 0.0f);
+		taps[minimumPhase ? 0 : kernelLength / 2] = 1.0f;
+		ConvolutionKernel* identity = new ConvolutionKernel();
+		identity->Build(taps.data(), kernelLength, convolver.GetLayout(), convolver.GetDirectLength());
+		convolver.SetKernel(identity);
+		designed = false;
+		warmSamples = 0;
+	}
+
+	// 消息线程调用, 连续请求只设计最后一次
+	// scales为空时全部按当前采样率; 按高采样率设计的系数只取到它的1/k, 没有双线性变换在奈奎斯特附近的压缩
+	void RequestDesign(const std::vector<BiquadCoeffs>& coeffs, const std::vector<float>& scales = {})
+	{
+		{
+			juce::ScopedLock lock(requestLock);
+			requestCoeffs = coeffs;
+			requestScales = scales;
+			requestScales.resize(coeffs.size(), 1.0f);
+			hasRequest = true;
+		}
+		if (!isThreadRunning()) startThread(juce::Thread::Priority::low);
+		notify();
+	}
+
+	int GetLatencySamples() const
+	{
+		return minimumPhase ? 0 : kernelLength / 2 + convolver.GetLatencySamples();
+	}
+	int GetKernelLength() const { return kernelLength; }
+
+	// 一个宿主块的估计运算量(flops): 同步的级块内至少算一次,
+	// 分摊的级每个头分块边界只做自己的1/steps, 块内边界数 × 每步开销
+	float EstimateBlockCost(int blockSize) const
+	{
+		float cost = (float)blockSize * convolver.GetDirectLength() * 4.0f;
+		const auto& layout = convolver.GetLayout();
+		int head = layout.empty() ? 1 : layout[0].blockSize;
+		for (size_t l = 0; l < layout.size(); ++l)
+		{
+			const auto& lv = layout[l];
+			int n = lv.blockSize * 2;
+			float fft = 5.0f * n * log2f((float)n);
+			float full = 2.0f * fft + 8.0f * n * lv.numPartitions;
+			int steps = convolver.GetLevelSteps((int)l);
+			if (steps == 1)
+				cost += (blockSize + lv.blockSize - 1) / lv.blockSize * full;
+			else
+				cost += (blockSize + head - 1) / head * full / steps;
+		}
+		return cost;
+	}
+
+	// 音频线程: 设计好的核已生效, 且输入历史已填满一个核长
+	bool IsSettled() const
+	{
+		return designed && !convolver.IsFading() && warmSamples >= kernelLength;
+	}
+
+	// 音频线程: 引擎闲置一段时间后重新启用前清空历史
+	void Reset()
+	{
+		convolver.Reset();
+		warmSamples = 0;
+	}
+
+	void Process(const float* inL, const float* inR, float* outL, float* outR, int numSamples)
+	{
+		if (!convolver.IsPrepared())
+		{
+			if (outL != inL) memcpy(outL, inL, numSamples * sizeof(float));
+			if (outR != inR) memcpy(outR, inR, numSamples * sizeof(float));
+			return;
+		}
+
+		// 换下的旧核还没交出去时不取新核, 保证每次Retire之前都有一次Take
+		if (!convolver.IsFading() && !kernels.HasBacklog())
+		{
+			ConvolutionKernel* kernel = kernels.Take();
+			if (kernel != nullptr)
+			{
+				convolver.SetKernel(kernel);
+				designed = true;
+			}
+		}
+		warmSamples = std::min(warmSamples + numSamples, kernelLength);
+
+		const ConvolutionKernel* old = convolver.Process(inL, inR, outL, outR, numSamples);
+		if (!kernels.Retire(const_cast<ConvolutionKernel*>(old)))
+			jassertfalse;//积压时没有换上新核, 不会再换下旧核
+	}
+};
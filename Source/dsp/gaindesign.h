@@ -0,0 +1,209 @@
+#pragma once
+
+#include <math.h>
+#include "biquad.h"
+#include "svf.h"
+
+// 只改增益时的快速设计, 结果和BiquadDesigner的DesignPeaking/DesignLowshelf/DesignHighshelf相同
+// Prepare按 形状/采样率/频率/Q 算好和增益无关的部分, 之后每换一次增益只剩一次pow、几次开方和乘除, 直接给出SVF系数
+// 峰值(MZT): 提升时极点只和频率/Q有关, 换增益只动分子, SVF里只有d0/d1在变(直流增益为1, d2恒为1)
+//   衰减是提升的倒数, 极点就是提升的零点, c1/c2只能跟着变, 但不再有三角函数和指数
+// 搁架(RBJ): 极点本身随sqrt(A)移动, 没法固定; cos/sin预先算好, SVF系数用化简后的闭式, 只剩两次除法
+class GainDesign
+{
+public:
+	enum Shape { None = -1, Peaking = 0, Lowshelf, Highshelf };
+
+	// 参数没变时直接返回
+	void Prepare(int newShape, float sampleRate, float cutoff, float q)
+	{
+		if (newShape == shape && sampleRate == sr && cutoff == fc && q == Q) return;
+		shape = newShape;
+		sr = sampleRate;
+		fc = cutoff;
+		Q = q;
+		if (shape == Peaking) PreparePeaking();
+		else if (shape == Lowshelf || shape == Highshelf) PrepareShelf();
+	}
+
+	bool IsPrepared() const { return shape != None; }
+
+	BiquadCoeffs Design(float gainDB) const
+	{
+		float b0, b1, b2, a1, a2;
+		DesignBiquad(gainDB, b0, b1, b2, a1, a2);
+		return BiquadCoeffs(b0, b1, b2, a1, a2);
+	}
+
+	void DesignSVF(float gainDB, float& d0, float& d1, float& d2, float& c1, float& c2) const
+	{
+		if (shape == Peaking && gainDB >= 0.0f)
+		{
+			// 极点不动: c1/c2直接用预先算好的, 分子换算也只有乘法
+			float b0, b1, b2;
+			PeakingNumerator(powf(10.0f, gainDB / 20.0f), b0, b1, b2);
+			c1 = pc1;
+			c2 = pc2;
+			d0 = b0;
+			d1 = (2.0f * b0 + b1) * invC1;
+			d2 = (b0 + b1 + b2) * invH0;
+			return;
+		}
+		if (shape == Peaking)
+		{
+			// 衰减: 分母是提升的分子, 除以b0归一化; 分子是提升的极点
+			float b0, b1, b2;
+			PeakingNumerator(powf(10.0f, -gainDB / 20.0f), b0, b1, b2);
+			if (b0 == 0.0f)
+			{
+				d0 = 1.0f; d1 = d2 = c1 = c2 = 0.0f;
+				return;
+			}
+			float inv = 1.0f / b0;
+			c1 = b1 * inv + 2.0f;
+			float sum = (b0 + b1 + b2) * inv;
+			c2 = sum / c1;
+			d0 = inv;
+			d1 = inv * pc1 / c1;
+			d2 = H0 * inv / sum;
+			return;
+		}
+		if (shape == Lowshelf || shape == Highshelf)
+		{
+			// RBJ搁架代进BiquadToSVF化简后的闭式, k = 1 - cos(w0), u = sqrt(A) * alpha:
+			// 低搁架 c1 = 4(k + u)/a0, c2 = k/(k + u), d1 = A(Ak + u)/(k + u), d2 = A^2
+			// 高搁架 c1 = 4(Ak + u)/a0, c2 = Ak/(Ak + u), d1 = A(k + u)/(Ak + u), d2 = 1
+			float A = powf(10.0f, gainDB / 20.0f);
+			float u = sqrtf(A) * alpha;
+			float s = shape == Lowshelf ? 1.0f : -1.0f;
+			float invA0 = 1.0f / ((A + 1.0f) + s * (A - 1.0f) * cosw0 + 2.0f * u);
+			float pk = shape == Lowshelf ? k : A * k;//极点那一侧的k
+			float zk = shape == Lowshelf ? A * k : k;
+			float invDen = 1.0f / (pk + u);
+			d0 = A * ((A + 1.0f) - s * (A - 1.0f) * cosw0 + 2.0f * u) * invA0;
+			d1 = A * (zk + u) * invDen;
+			d2 = shape == Lowshelf ? A * A : 1.0f;
+			c1 = 4.0f * (pk + u) * invA0;
+			c2 = pk * invDen;
+			return;
+		}
+		d0 = 1.0f;
+		d1 = d2 = c1 = c2 = 0.0f;
+	}
+
+private:
+	void PreparePeaking()
+	{
+		float w0T = 2.0f * M_PI * fc / sr;
+		if (Q > 0.5f) {
+			pa1 = -2.0f * exp(-w0T / (2.0f * Q)) * cos(sqrt(1.0f - pow(1.0f / (2.0f * Q), 2.0f)) * w0T);
+			pa2 = exp(-w0T / Q);
+		}
+		else {
+			float p1_term = 1.0f / (2.0f * Q) + sqrt(pow(1.0f / (2.0f * Q), 2.0f) - 1.0f);
+			float p2_term = 1.0f / (2.0f * Q) - sqrt(pow(1.0f / (2.0f * Q), 2.0f) - 1.0f);
+			pa1 = -(exp(-w0T * p1_term) + exp(-w0T * p2_term));
+			pa2 = exp(-w0T / Q);
+		}
+
+		// Fs/6和Fs/3处模拟原型的幅度: (1 - r^2)^2 + (g*r/Q)^2 除以 g = 1 时的值, 只有g*r/Q一项随增益变
+		float r1 = (sr / 6.0f) / fc;
+		float r2 = (sr / 3.0f) / fc;
+		base1 = pow(1.0f - r1 * r1, 2.0f);
+		base2 = pow(1.0f - r2 * r2, 2.0f);
+		slope1 = r1 / Q;
+		slope2 = r2 / Q;
+		den1 = base1 + slope1 * slope1;
+		den2 = base2 + slope2 * slope2;
+
+		float Hd1_den_sq = 1.0f + pa1 - pa2 + pa1 * pa1 + pa1 * pa2 + pa2 * pa2;
+		Hd1 = (Hd1_den_sq <= 0.0f) ? 1.0f : 1.0f / sqrt(Hd1_den_sq);
+		float Hd2_den_sq = 1.0f - pa1 - pa2 + pa1 * pa1 - pa1 * pa2 + pa2 * pa2;
+		Hd2 = (Hd2_den_sq <= 0.0f) ? 1.0f : 1.0f / sqrt(Hd2_den_sq);
+		H0 = 1.0f + pa1 + pa2;
+
+		pc1 = pa1 + 2.0f;
+		pc2 = H0 / pc1;
+		invC1 = 1.0f / pc1;
+		invH0 = 1.0f / H0;
+	}
+
+	void PrepareShelf()
+	{
+		float w0 = 2.0f * M_PI * fc / sr;
+		cosw0 = cosf(w0);
+		float sh = sinf(0.5f * w0);
+		k = 2.0f * sh * sh;//1 - cos(w0), 低频时不损失精度
+		alpha = sinf(w0) / (2.0f * Q);
+	}
+
+	// 提升型峰值的分子, 和DesignPeaking的步骤3、4相同
+	void PeakingNumerator(float g0, float& b0, float& b1, float& b2) const
+	{
+		float t1 = g0 * slope1, t2 = g0 * slope2;
+		float Ha1 = (den1 == 0.0f) ? 1.0f : sqrt((base1 + t1 * t1) / den1);
+		float Ha2 = (den2 == 0.0f) ? 1.0f : sqrt((base2 + t2 * t2) / den2);
+		float H1 = Ha1 / Hd1;
+		float H2 = Ha2 / Hd2;
+
+		float b1_sqrt_term = H0 * H0 - 2.0f * H1 * H1 + 2.0f * H2 * H2;
+		if (b1_sqrt_term < 0.0f) b1_sqrt_term = 0.0f;
+		b1 = (H0 - sqrt(b1_sqrt_term)) / 2.0f;
+
+		float b2_sqrt_term = -3.0f * H0 * H0 - 6.0f * H0 * b1 - 3.0f * b1 * b1 + 12.0f * H1 * H1;
+		if (b2_sqrt_term < 0.0f) b2_sqrt_term = 0.0f;
+		b2 = (3.0f * (H0 - b1) - sqrt(b2_sqrt_term)) / 6.0f;
+
+		b0 = H0 - b1 - b2;
+	}
+
+	void DesignBiquad(float gainDB, float& b0, float& b1, float& b2, float& a1, float& a2) const
+	{
+		if (shape == Peaking)
+		{
+			bool isCut = gainDB < 0.0f;
+			float nb0, nb1, nb2;
+			PeakingNumerator(powf(10.0f, fabsf(gainDB) / 20.0f), nb0, nb1, nb2);
+			if (!isCut)
+			{
+				b0 = nb0; b1 = nb1; b2 = nb2; a1 = pa1; a2 = pa2;
+				return;
+			}
+			if (nb0 == 0.0f)
+			{
+				b0 = 1.0f; b1 = b2 = a1 = a2 = 0.0f;
+				return;
+			}
+			float inv = 1.0f / nb0;
+			b0 = inv; b1 = pa1 * inv; b2 = pa2 * inv; a1 = nb1 * inv; a2 = nb2 * inv;
+			return;
+		}
+		if (shape != Lowshelf && shape != Highshelf)
+		{
+			b0 = 1.0f; b1 = b2 = a1 = a2 = 0.0f;
+			return;
+		}
+
+		float A = powf(10.0f, gainDB / 20.0f);
+		float sqrtA = sqrtf(A);
+		float s = shape == Lowshelf ? 1.0f : -1.0f;//高搁架是低搁架把cos和奇数项反号
+		float a0 = (A + 1.0f) + s * (A - 1.0f) * cosw0 + 2.0f * sqrtA * alpha;
+		float inv = 1.0f / a0;
+		b0 = A * ((A + 1.0f) - s * (A - 1.0f) * cosw0 + 2.0f * sqrtA * alpha) * inv;
+		b1 = s * 2.0f * A * ((A - 1.0f) - s * (A + 1.0f) * cosw0) * inv;
+		b2 = A * ((A + 1.0f) - s * (A - 1.0f) * cosw0 - 2.0f * sqrtA * alpha) * inv;
+		a1 = -s * 2.0f * ((A - 1.0f) + s * (A + 1.0f) * cosw0) * inv;
+		a2 = ((A + 1.0f) + s * (A - 1.0f) * cosw0 - 2.0f * sqrtA * alpha) * inv;
+	}
+
+	int shape = None;
+	float sr = 0.0f, fc = 0.0f, Q = 0.0f;
+
+	// 峰值: 提升型的极点和SVF形式, 两个匹配频率上的幅度项
+	float pa1 = 0.0f, pa2 = 0.0f, pc1 = 0.0f, pc2 = 0.0f, invC1 = 0.0f, invH0 = 0.0f;
+	float base1 = 0.0f, base2 = 0.0f, slope1 = 0.0f, slope2 = 0.0f, den1 = 0.0f, den2 = 0.0f;
+	float Hd1 = 1.0f, Hd2 = 1.0f, H0 = 1.0f;
+
+	// 搁架
+	float cosw0 = 1.0f, k = 0.0f, alpha = 0.0f;
+};
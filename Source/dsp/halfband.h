@@ -0,0 +1,112 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+// 31阶半带FIR二倍抽取: 偶数位置的系数为0, 只剩中心抽头和8对对称的奇数抽头
+// 通带到输出采样率的0.4左右, 对频谱显示足够; 每出一个样本只做8次乘加
+// 按块处理: 输入拆成偶数/奇数两路, 第m个输出 = 0.5 * E[m-7] + Σ taps[p] * (O[m-8-p] + O[m-7+p]),
+// 8对抽头在外层, 内层沿输出方向连续读写, 编译器可以向量化
+class HalfbandDecimator
+{
+public:
+	static constexpr int NumTaps = 31;
+	static constexpr int NumPairs = 8;
+	static constexpr int MaxChunk = 128;//一次最多出多少个, 更长的输入分段做
+
+	HalfbandDecimator() { Reset(); }
+
+	void Reset()
+	{
+		memset(even, 0, sizeof(even));
+		memset(odd, 0, sizeof(odd));
+		pending = 0.0f;
+		hasPending = false;
+	}
+
+	// 还有一个偶数位置的样本在等它的下一个, 下一个输入样本会出一个输出
+	bool HasPending() const { return hasPending; }
+
+	// 抽取n个输入, 输出写进out, 返回输出个数(n / 2左右, 看上次剩没剩一个). in和out可以是同一个数组
+	int Process(const float* in, int n, float* out)
+	{
+		const float* taps = GetPairTaps();
+		int count = 0;
+		int i = 0;
+		while (i < n)
+		{
+			// 先凑齐这一段的偶数/奇数两路, 接在上一段留下的历史后面
+			int m = 0;
+			if (hasPending)
+			{
+				even[EvenCarry] = pending;
+				odd[OddCarry] = in[i++];
+				hasPending = false;
+				m = 1;
+			}
+			for (; m < MaxChunk && i + 1 < n; ++m, i += 2)
+			{
+				even[EvenCarry + m] = in[i];
+				odd[OddCarry + m] = in[i + 1];
+			}
+			if (m < MaxChunk && i < n)
+			{
+				pending = in[i++];
+				hasPending = true;
+			}
+
+			float* y = out + count;
+			for (int j = 0; j < m; ++j)
+				y[j] = 0.5f * even[j];
+			for (int p = 0; p < NumPairs; ++p)
+			{
+				const float t = taps[p];
+				const float* lo = odd + NumPairs - 1 - p;//O[m-8-p]
+				const float* hi = odd + NumPairs + p;//O[m-7+p]
+				for (int j = 0; j < m; ++j)
+					y[j] += t * (lo[j] + hi[j]);
+			}
+			count += m;
+
+			memmove(even, even + m, EvenCarry * sizeof(float));
+			memmove(odd, odd + m, OddCarry * sizeof(float));
+		}
+		return count;
+	}
+
+	// 第p对抽头(离中心2p+1)的系数, Blackman窗的sinc, 归一化到直流增益为1
+	static const float* GetPairTaps()
+	{
+		struct Table
+		{
+			float taps[NumPairs];
+			Table()
+			{
+				const double pi = 3.14159265358979323846;
+				double sum = 0.0;
+				for (int p = 0; p < NumPairs; ++p)
+				{
+					int n = 2 * p + 1;
+					double sinc = sin(pi * n / 2.0) / (pi * n);
+					double t = (double)(n + NumTaps / 2 + 1) / (NumTaps + 1);//窗两端不落在最外侧抽头上
+					double w = 0.42 - 0.5 * cos(2.0 * pi * t) + 0.08 * cos(4.0 * pi * t);
+					taps[p] = (float)(sinc * w);
+					sum += taps[p];
+				}
+				for (int p = 0; p < NumPairs; ++p)
+					taps[p] = (float)(taps[p] * 0.25 / sum);
+			}
+		};
+		static const Table table;
+		return table.taps;
+	}
+
+private:
+	static constexpr int EvenCarry = NumPairs - 1;//E[m-7]
+	static constexpr int OddCarry = NumPairs * 2 - 1;//O[m-15] .. O[m]
+
+	float even[EvenCarry + MaxChunk];
+	float odd[OddCarry + MaxChunk];
+	float pending;
+	bool hasPending;
+};
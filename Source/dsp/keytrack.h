@@ -0,0 +1,276 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include "mailbox.h"
+
+// 节点的音高跟踪: 频率 = 当前音符的频率 * harmonic, 换音时在glideMs内按对数频率滑过去
+struct KeyTrackParams {
+	bool enabled = false;
+	float harmonic = 1.0f;//跟第几次谐波, 可以是分数(0.5为低八度)
+	float glideMs = 0.0f;//0为到点直接跳
+};
+
+// 音高跟踪: 单音, 最后按下的音符优先, 全部松开后停在最后一个音上, 还没来过音符时用节点自己的频率
+// 音符由Equalizer按时间点切开子块后送进来, 跳变只在事件点上换一次系数, 滑音时每个子块换一次
+class KeyTrackBank
+{
+public:
+	static constexpr int MaxBands = 64;
+	static constexpr int MaxHeld = 16;
+
+	struct Band
+	{
+		int id;
+		int mode;
+		float cutoff;
+		float q;
+		float gainDB;
+		KeyTrackParams key;
+	};
+
+	KeyTrackBank()
+	{
+		for (int i = 0; i < MaxBands; ++i) shownCutoff[i].store(0.0f);
+	}
+
+	~KeyTrackBank() { Release(); }
+
+	// 消息线程(调用方持锁): 跟踪节点列表, 每次发布级联时一起发布
+	void SetBands(const std::vector<Band>& list, float sampleRate)
+	{
+		if (list.empty() && publishedEmpty) return;
+		publishedEmpty = list.empty();
+
+		auto* set = new BandSet();
+		set->sampleRate = sampleRate;
+		set->numBands = std::min((int)list.size(), MaxBands);
+		for (int i = 0; i < set->numBands; ++i)
+		{
+			set->bands[i] = list[i];
+			set->slotOf[list[i].id] = i;
+			set->glideSamples[i] = std::max(0.0f, list[i].key.glideMs) * 0.001f * sampleRate;
+		}
+		sets.Publish(set);
+	}
+
+	// 界面: 节点当前跟踪到的频率, 不是跟踪节点或还没有音符时返回false
+	bool GetShownCutoff(int id, float& cutoff) const
+	{
+		if (id < 0 || id >= MaxBands) return false;
+		cutoff = shownCutoff[id].load(std::memory_order_relaxed);
+		return cutoff > 0.0f;
+	}
+
+	// 音频线程: 接管新的设置, 音高按节点id延续, 返回是否有跟踪节点
+	// 级联刚按静态值重新发布过, 有音高的节点都要在下一个子块重新换上
+	bool Adopt()
+	{
+		if (BandSet* next = sets.Take())
+		{
+			for (int i = 0; i < next->numBands; ++i)
+			{
+				int id = next->bands[i].id;
+				int old = current != nullptr ? current->slotOf[id] : -1;
+				if (old >= 0)
+				{
+					next->pitch[i] = current->pitch[old];
+					next->target[i] = current->target[old];
+					next->step[i] = current->step[old];
+				}
+				else
+				{
+					next->pitch[i] = next->target[i] = (float)lastNote;//刚打开跟踪时直接到当前的音
+				}
+				next->pending[i] = next->pitch[i] >= 0.0f;
+			}
+			for (int id = 0; id < MaxBands; ++id)
+				if (next->slotOf[id] < 0) shownCutoff[id].store(0.0f, std::memory_order_relaxed);
+			sets.Retire(current);
+			current = next;
+		}
+		return current != nullptr && current->numBands > 0;
+	}
+
+	// 音频线程: 音符事件, 在它的时间点上调用
+	void NoteOn(int note)
+	{
+		RemoveHeld(note);
+		if (numHeld == MaxHeld) RemoveHeld(held[0]);
+		held[numHeld++] = note;
+		Retarget(note);
+	}
+
+	void NoteOff(int note)
+	{
+		bool wasTop = numHeld > 0 && held[numHeld - 1] == note;
+		RemoveHeld(note);
+		if (wasTop && numHeld > 0) Retarget(held[numHeld - 1]);//松开最上面的音时回到还按着的上一个音
+	}
+
+	void AllNotesOff() { numHeld = 0; }
+
+	// 还有节点要换系数: 滑音中或者有没换上的跳变
+	bool IsMoving() const
+	{
+		if (current == nullptr) return false;
+		for (int i = 0; i < current->numBands; ++i)
+			if (current->pending[i] || current->step[i] != 0.0f) return true;
+		return false;
+	}
+
+	bool IsGliding() const
+	{
+		if (current == nullptr) return false;
+		for (int i = 0; i < current->numBands; ++i)
+			if (current->step[i] != 0.0f) return true;
+		return false;
+	}
+
+	// 音频线程: 子块开始时调用, 滑音走numSamples个样本(系数取子块结束时的值), 音高变了的节点交给apply(band, cutoff)
+	// canApply为假(FIR在用)时只跟踪, 留到能换的时候再换
+	template <typename Apply>
+	void Advance(int numSamples, bool canApply, Apply&& apply)
+	{
+		if (current == nullptr) return;
+		BandSet& s = *current;
+		for (int i = 0; i < s.numBands; ++i)
+		{
+			if (s.step[i] != 0.0f)
+			{
+				s.pitch[i] += s.step[i] * numSamples;
+				if ((s.step[i] > 0.0f) == (s.pitch[i] >= s.target[i]))
+				{
+					s.pitch[i] = s.target[i];
+					s.step[i] = 0.0f;
+				}
+				s.pending[i] = true;
+			}
+			if (!s.pending[i]) continue;
+			float cutoff = Cutoff(s, i);
+			shownCutoff[s.bands[i].id].store(cutoff, std::memory_order_relaxed);
+			if (!canApply) continue;
+			s.pending[i] = false;
+			apply(s.bands[i], cutoff);
+		}
+	}
+
+	// 音频线程: 别的路径(自动化/界面增益/动态/调制)要换这个节点的系数时, 有音高就把频率换成跟踪到的
+	float Track(int id, float cutoff) const
+	{
+		if (current == nullptr || id < 0 || id >= MaxBands) return cutoff;
+		int i = current->slotOf[id];
+		if (i < 0 || current->pitch[i] < 0.0f) return cutoff;
+		return Cutoff(*current, i);
+	}
+
+	// 音频线程: 自动化或界面增益斜坡改了节点的基础值, 跟踪时频率不用, 其余照常
+	void Rebase(int id, int mode, float cutoff, float q, float gainDB)
+	{
+		if (current == nullptr || id < 0 || id >= MaxBands) return;
+		int i = current->slotOf[id];
+		if (i < 0) return;
+		Band& b = current->bands[i];
+		b.mode = mode;
+		b.cutoff = cutoff;
+		b.q = q;
+		b.gainDB = gainDB;
+	}
+
+	// 音频线程不运行时调用: 忘掉按着的音和当前音高
+	void Reset()
+	{
+		numHeld = 0;
+		lastNote = -1;
+		if (current == nullptr) return;
+		for (int i = 0; i < current->numBands; ++i)
+		{
+			current->pitch[i] = current->target[i] = -1.0f;
+			current->step[i] = 0.0f;
+			current->pending[i] = false;
+			shownCutoff[current->bands[i].id].store(0.0f, std::memory_order_relaxed);
+		}
+	}
+
+	// 音频线程不运行时调用
+	void Release()
+	{
+		sets.Clear();
+		delete current;
+		current = nullptr;
+		publishedEmpty = true;
+	}
+
+private:
+	struct BandSet
+	{
+		float sampleRate = 48000.0f;
+		int numBands = 0;
+		Band bands[MaxBands];
+		int slotOf[MaxBands];
+		float glideSamples[MaxBands] = {};
+		float pitch[MaxBands];//当前音高(MIDI音符号, 滑音时有小数), <0表示还没有音符
+		float target[MaxBands];
+		float step[MaxBands] = {};//每样本走多少半音, 0表示没在滑
+		bool pending[MaxBands] = {};//音高变了还没换上
+
+		BandSet()
+		{
+			for (int i = 0; i < MaxBands; ++i)
+			{
+				slotOf[i] = -1;
+				pitch[i] = target[i] = -1.0f;
+			}
+		}
+	};
+
+	static float Cutoff(const BandSet& s, int i)
+	{
+		float hz = 440.0f * std::exp2((s.pitch[i] - 69.0f) / 12.0f) * s.bands[i].key.harmonic;
+		return juce::jlimit(10.0f, s.sampleRate * 0.49f, hz);
+	}
+
+	// 新的音: 没有滑音或还没有音高的节点直接跳, 其余从当前音高出发, 在glideMs内滑到
+	void Retarget(int note)
+	{
+		lastNote = note;
+		if (current == nullptr) return;
+		BandSet& s = *current;
+		for (int i = 0; i < s.numBands; ++i)
+		{
+			s.target[i] = (float)note;
+			if (s.pitch[i] < 0.0f || s.glideSamples[i] < 1.0f)
+			{
+				if (s.pitch[i] != (float)note) s.pending[i] = true;//同一个音重复按下不用换系数
+				s.pitch[i] = (float)note;
+				s.step[i] = 0.0f;
+			}
+			else
+			{
+				s.step[i] = ((float)note - s.pitch[i]) / s.glideSamples[i];
+			}
+		}
+	}
+
+	void RemoveHeld(int note)
+	{
+		int n = 0;
+		for (int i = 0; i < numHeld; ++i)
+			if (held[i] != note) held[n++] = held[i];
+		numHeld = n;
+	}
+
+	// 消息线程
+	bool publishedEmpty = true;
+
+	LatestMailbox<BandSet> sets;
+	std::atomic<float> shownCutoff[MaxBands];
+
+	// 音频线程
+	BandSet* current = nullptr;
+	int held[MaxHeld] = {};
+	int numHeld = 0;
+	int lastNote = -1;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+
+// 非实时线程 -> 音频线程的对象交接, 只保留最新的一个
+// 音频线程不分配也不释放: 换下来的旧对象放进retired, 由发布方下次发布时释放
+template <typename T>
+class LatestMailbox
+{
+private:
+	std::atomic<T*> pending{ nullptr };
+	std::atomic<T*> retired{ nullptr };
+	T* toRetire = nullptr;//音频线程暂存, retired空出来再交出去
+
+	void Flush()
+	{
+		if (toRetire == nullptr) return;
+		T* expected = nullptr;
+		if (retired.compare_exchange_strong(expected, toRetire)) toRetire = nullptr;
+	}
+
+public:
+	~LatestMailbox() { Clear(); }
+
+	// 发布方调用, 音频线程还没取走的旧对象直接作废
+	void Publish(T* obj)
+	{
+		FreeRetired();
+		delete pending.exchange(obj);
+	}
+
+	void FreeRetired()
+	{
+		delete retired.exchange(nullptr);
+	}
+
+	// 音频线程不运行时调用
+	void Clear()
+	{
+		delete pending.exchange(nullptr);
+		delete retired.exchange(nullptr);
+		delete toRetire;
+		toRetire = nullptr;
+	}
+
+	// 音频线程: 取最新的对象, 上一个旧对象还没交出去时先不取
+	T* Take()
+	{
+		Flush();
+		if (toRetire != nullptr) return nullptr;
+		return pending.exchange(nullptr);
+	}
+
+	// 音频线程: 交还不再使用的对象, 每次Take之后最多交还一个
+	// 上一个还暂存着时拒收并返回false, 对象仍归调用者: 覆盖toRetire会泄漏
+	// 积压时Take不取新对象, 按"取一个换一个"使用就不会走到这里
+	bool Retire(T* obj)
+	{
+		if (obj == nullptr) return true;
+		Flush();
+		if (toRetire != nullptr) return false;
+		T* expected = nullptr;
+		if (!retired.compare_exchange_strong(expected, obj)) toRetire = obj;
+		return true;
+	}
+
+	// 音频线程: 还有旧对象没交出去(先试着交一次), 这时不要取新对象
+	bool HasBacklog()
+	{
+		Flush();
+		return toRetire != nullptr;
+	}
+};
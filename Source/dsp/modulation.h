@@ -0,0 +1,339 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include "mailbox.h"
+
+enum ModSource {
+	MOD_OFF = 0,
+	MOD_LFO,
+	MOD_ENVELOPE	// 输入电平的包络, -60..0dB对应0..1
+};
+
+enum LfoShape {
+	LFO_SINE = 0,
+	LFO_TRIANGLE,
+	LFO_SAW,
+	LFO_SQUARE
+};
+
+// 节点的调制设置: LFO(双极性)或包络(单极性)推动频率和增益
+struct ModParams {
+	int source = MOD_OFF;
+	int shape = LFO_SINE;
+	float rateHz = 1.0f;
+	float syncBeats = 0.0f;//>0时跟随宿主速度, 一个周期的拍数
+	float attackMs = 10.0f;//包络
+	float releaseMs = 200.0f;
+	bool sidechain = false;//包络跟随侧链, 没有侧链输入时退回主输入
+	float depthOctaves = 1.0f;//频率乘 2^(depthOctaves * m)
+	float depthDB = 0.0f;//增益加 depthDB * m
+};
+
+// 节点调制: 每ControlInterval个样本一个控制点, 按调制量算出节点的目标值, 由Equalizer设计成目标系数
+// 单级节点给出SVF系数, 控制点之间每个子块把SVF系数从上一个目标线性插到这一个, 原地换上(SVF对逐段变化的系数表现良好)
+// 多级节点没法插值, 只在控制点上重新设计; FIR在用时只跟踪相位和包络
+class ModulationBank
+{
+public:
+	static constexpr int MaxBands = 64;
+	static constexpr int ControlInterval = 128;
+	static constexpr float EnvelopeRangeDB = 60.0f;
+	static constexpr float FloorDB = -120.0f;
+	static constexpr float MaxGainDB = 36.0f;
+
+	struct Band
+	{
+		int id;
+		int mode;
+		float cutoff;
+		float q;
+		float gainDB;
+		ModParams mod;
+	};
+
+	ModulationBank()
+	{
+		for (int i = 0; i < MaxBands; ++i)
+		{
+			shownCutoff[i].store(0.0f);
+			shownGain[i].store(0.0f);
+		}
+	}
+
+	~ModulationBank() { Release(); }
+
+	// 消息线程(调用方持锁): 调制节点列表, 每次发布级联时一起发布
+	void SetBands(const std::vector<Band>& list, float sampleRate)
+	{
+		if (list.empty() && publishedEmpty) return;
+		publishedEmpty = list.empty();
+
+		auto* set = new BandSet();
+		set->sampleRate = sampleRate;
+		set->numBands = std::min((int)list.size(), MaxBands);
+		for (int i = 0; i < set->numBands; ++i)
+		{
+			set->bands[i] = list[i];
+			set->slotOf[list[i].id] = i;
+			const ModParams& m = list[i].mod;
+			set->attackSamples[i] = std::max(0.1f, m.attackMs) * 0.001f * sampleRate;
+			set->releaseSamples[i] = std::max(1.0f, m.releaseMs) * 0.001f * sampleRate;
+			if (m.source == MOD_ENVELOPE) set->anyEnvelope = true;
+		}
+		sets.Publish(set);
+	}
+
+	// 界面: 节点当前调制到的位置, 不是调制节点时返回false
+	bool GetShownValues(int id, float& cutoff, float& gainDB) const
+	{
+		if (id < 0 || id >= MaxBands) return false;
+		cutoff = shownCutoff[id].load(std::memory_order_relaxed);
+		gainDB = shownGain[id].load(std::memory_order_relaxed);
+		return cutoff > 0.0f;
+	}
+
+	// 音频线程: 每块开始时给出宿主的速度和位置, 同步的LFO按拍子对齐相位
+	void SetTransport(double bpm, double ppq, bool playing)
+	{
+		hostBpm = bpm > 0.0 ? bpm : 120.0;
+		hostPpq = ppq;
+		hostPlaying = playing;
+		transportFresh = true;
+	}
+
+	// 音频线程: 接管新的设置, 相位和包络按节点id延续, 返回是否有调制节点
+	bool Adopt()
+	{
+		if (BandSet* next = sets.Take())
+		{
+			for (int i = 0; i < next->numBands; ++i)
+			{
+				int id = next->bands[i].id;
+				int old = current != nullptr ? current->slotOf[id] : -1;
+				if (old >= 0)
+				{
+					next->phase[i] = current->phase[old];
+					next->env[i] = current->env[old];
+				}
+			}
+			for (int id = 0; id < MaxBands; ++id)
+				if (next->slotOf[id] < 0) shownCutoff[id].store(0.0f, std::memory_order_relaxed);
+			sets.Retire(current);
+			current = next;
+			sinceControl = ControlInterval;//级联刚按静态值重新发布过, 马上出一个控制点
+		}
+		return current != nullptr && current->numBands > 0;
+	}
+
+	// 音频线程: 子块开始时调用, 先用这个子块的输入更新包络, 到了控制点就设计新的目标, 然后把插值后的系数换上
+	// design(band, cutoff, gainDB, svf)返回true时svf里是单级节点的d0 d1 d2 c1 c2, false表示它自己已经换好了
+	// apply(id, svf)在子块上换插值后的系数; canApply为假(FIR在用)时只跟踪
+	template <typename T, typename Design, typename Apply>
+	void Advance(const T* inL, const T* inR, const T* keyL, const T* keyR, int numSamples,
+		bool canApply, Design&& design, Apply&& apply)
+	{
+		BandSet& s = *current;
+		if (transportFresh) SyncPhases(s);
+		float mainLevel = FloorDB, keyLevel = FloorDB;
+		if (s.anyEnvelope)
+		{
+			mainLevel = LevelDB(inL, inR, numSamples);
+			keyLevel = keyL != nullptr ? LevelDB(keyL, keyR, numSamples) : mainLevel;
+		}
+
+		bool control = sinceControl >= ControlInterval;
+		if (control) sinceControl = 0;
+		sinceControl += numSamples;
+		float t = std::min(1.0f, (float)sinceControl / (float)ControlInterval);
+
+		for (int i = 0; i < s.numBands; ++i)
+		{
+			const Band& b = s.bands[i];
+			if (b.mod.source == MOD_ENVELOPE)
+			{
+				float level = b.mod.sidechain ? keyLevel : mainLevel;
+				float tau = level > s.env[i] ? s.attackSamples[i] : s.releaseSamples[i];
+				s.env[i] = level + (s.env[i] - level) * std::exp(-(float)numSamples / tau);
+			}
+			if (control)
+			{
+				// LFO取这一段结束时的值, 插值正好在段尾到达
+				float m = b.mod.source == MOD_LFO ? LfoValue(b.mod.shape, s.phase[i] + Increment(s, b) * ControlInterval) :
+					juce::jlimit(0.0f, 1.0f, 1.0f + s.env[i] / EnvelopeRangeDB);
+				s.value[i] = m;
+				float cutoff, gainDB;
+				ModulatedValues(s, i, b.cutoff, b.gainDB, cutoff, gainDB);
+				shownCutoff[b.id].store(cutoff, std::memory_order_relaxed);
+				shownGain[b.id].store(gainDB, std::memory_order_relaxed);
+
+				s.interpolate[i] = false;
+				if (canApply)
+				{
+					float svf[5];
+					if (design(b, cutoff, gainDB, svf))
+					{
+						for (int k = 0; k < 5; ++k)
+						{
+							s.from[i][k] = s.fresh[i] ? svf[k] : s.to[i][k];
+							s.to[i][k] = svf[k];
+						}
+						s.interpolate[i] = true;
+						s.fresh[i] = false;
+					}
+				}
+				else
+				{
+					s.fresh[i] = true;
+				}
+			}
+			if (b.mod.source == MOD_LFO)
+			{
+				s.phase[i] += Increment(s, b) * numSamples;
+				s.phase[i] -= std::floor(s.phase[i]);
+			}
+			if (!s.interpolate[i] || !canApply) continue;
+
+			float svf[5];
+			for (int k = 0; k < 5; ++k) svf[k] = s.from[i][k] + (s.to[i][k] - s.from[i][k]) * t;
+			apply(b.id, svf);
+			if (t >= 1.0f) s.interpolate[i] = false;//到了目标, 下个控制点之前不用再换
+		}
+	}
+
+	// 音频线程: 别的路径(自动化/界面增益/动态)要换这个节点的系数时, 按最近一个控制点的调制量改成调制后的值
+	void Modulate(int id, float& cutoff, float& gainDB) const
+	{
+		if (current == nullptr || id < 0 || id >= MaxBands) return;
+		int i = current->slotOf[id];
+		if (i < 0) return;
+		ModulatedValues(*current, i, cutoff, gainDB, cutoff, gainDB);
+	}
+
+	// 音频线程: 自动化/界面增益斜坡/音高跟踪改了节点的基础值, 调用方随后会按新值换上系数
+	// 停掉正在走的插值免得把新系数盖回去, 下个控制点直接跳到新目标
+	void Rebase(int id, int mode, float cutoff, float q, float gainDB)
+	{
+		if (current == nullptr || id < 0 || id >= MaxBands) return;
+		int i = current->slotOf[id];
+		if (i < 0) return;
+		Band& b = current->bands[i];
+		b.mode = mode;
+		b.cutoff = cutoff;
+		b.q = q;
+		b.gainDB = gainDB;
+		current->interpolate[i] = false;
+		current->fresh[i] = true;
+	}
+
+	// 音频线程不运行时调用
+	void Release()
+	{
+		sets.Clear();
+		delete current;
+		current = nullptr;
+		publishedEmpty = true;
+	}
+
+private:
+	struct BandSet
+	{
+		float sampleRate = 48000.0f;
+		int numBands = 0;
+		bool anyEnvelope = false;//只有LFO时不用算输入电平
+		Band bands[MaxBands];
+		int slotOf[MaxBands];
+		float phase[MaxBands] = {};//LFO相位, 单位为周期
+		float env[MaxBands];//包络, dB
+		float value[MaxBands] = {};//最近一个控制点的调制量
+		float attackSamples[MaxBands] = {};
+		float releaseSamples[MaxBands] = {};
+		float from[MaxBands][5] = {};//单级节点插值的起点和终点, d0 d1 d2 c1 c2
+		float to[MaxBands][5] = {};
+		bool interpolate[MaxBands] = {};
+		bool fresh[MaxBands];//还没有换上过, 第一个目标直接跳过去
+
+		BandSet()
+		{
+			for (int i = 0; i < MaxBands; ++i)
+			{
+				slotOf[i] = -1;
+				env[i] = FloorDB;
+				fresh[i] = true;
+			}
+		}
+	};
+
+	static float LfoValue(int shape, float phase)
+	{
+		phase -= std::floor(phase);
+		switch (shape) {
+		case LFO_TRIANGLE:
+			return 1.0f - 4.0f * std::abs(phase - 0.5f);
+		case LFO_SAW:
+			return 2.0f * phase - 1.0f;
+		case LFO_SQUARE:
+			return phase < 0.5f ? 1.0f : -1.0f;
+		default:
+			return std::sin(2.0f * juce::MathConstants<float>::pi * phase);
+		}
+	}
+
+	// 每样本走多少个周期
+	float Increment(const BandSet& s, const Band& b) const
+	{
+		float rate = b.mod.syncBeats > 0.0f ? (float)(hostBpm / 60.0) / b.mod.syncBeats : b.mod.rateHz;
+		return juce::jlimit(0.0f, 50.0f, rate) / s.sampleRate;
+	}
+
+	// 宿主在播放时同步的LFO直接按拍子位置定相位, 停下来时自由走
+	void SyncPhases(BandSet& s)
+	{
+		transportFresh = false;
+		if (!hostPlaying || hostPpq < 0.0) return;
+		for (int i = 0; i < s.numBands; ++i)
+		{
+			float beats = s.bands[i].mod.syncBeats;
+			if (s.bands[i].mod.source != MOD_LFO || beats <= 0.0f) continue;
+			double cycles = hostPpq / beats;
+			s.phase[i] = (float)(cycles - std::floor(cycles));
+		}
+	}
+
+	static void ModulatedValues(const BandSet& s, int i, float cutoff, float gainDB, float& outCutoff, float& outGain)
+	{
+		const ModParams& m = s.bands[i].mod;
+		float v = s.value[i];
+		outCutoff = juce::jlimit(10.0f, s.sampleRate * 0.49f, cutoff * std::exp2(m.depthOctaves * v));
+		outGain = juce::jlimit(-MaxGainDB, MaxGainDB, gainDB + m.depthDB * v);
+	}
+
+	// 一段输入两声道的平均功率, dB
+	template <typename T>
+	static float LevelDB(const T* l, const T* r, int numSamples)
+	{
+		if (numSamples <= 0) return FloorDB;
+		float acc = 0.0f;
+		for (int t = 0; t < numSamples; ++t)
+			acc += (float)(l[t] * l[t] + r[t] * r[t]);
+		float power = acc / (float)numSamples;
+		return power > 1e-12f ? 10.0f * std::log10(power) : FloorDB;
+	}
+
+	// 消息线程
+	bool publishedEmpty = true;
+
+	LatestMailbox<BandSet> sets;
+	std::atomic<float> shownCutoff[MaxBands];
+	std::atomic<float> shownGain[MaxBands];
+
+	// 音频线程
+	BandSet* current = nullptr;
+	int sinceControl = ControlInterval;
+	double hostBpm = 120.0;
+	double hostPpq = -1.0;
+	bool hostPlaying = false;
+	bool transportFresh = false;
+};
@@ -0,0 +1,539 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <type_traits>
+#include "stagebank.h"//LMEQ_X86, LMEQ_TARGET
+
+// 2x/4x过采样: 每一级是一个2倍半带, 按多相拆开, 只在低采样率一侧算
+// 线性相位: 对称FIR半带, 偶数位置的系数为0, 升采样的一相只是延迟, 另一相和降采样都是长2P的对称点积
+// 最小相位: 两路一阶全通的多相IIR半带(椭圆设计), 延迟只有几个样本, 相位不线性
+// EQ本身是线性的, 升采样留下的镜像会被降采样滤掉, 两边的阻带叠加起来, 所以每级只要90dB左右
+enum OversamplePhase {
+	OVERSAMPLE_LINEAR = 0,
+	OVERSAMPLE_MINIMUM
+};
+
+// 线性相位半带, 立体声交错(LRLR...)
+// 每个输出是连续2P帧的对称点积, 按输出帧向量化: 一次算相邻的一串帧, 每个抽头广播一次, 没有横向求和
+template <typename T>
+class HalfbandFIR
+{
+public:
+	// beta为Kaiser窗参数
+	void Prepare(int pairs, double beta, int maxFrames)
+	{
+		numPairs = pairs;
+		const int len = pairs * 2;
+		const double pi = 3.14159265358979323846;
+		std::vector<double> g(pairs);
+		double sum = 0.0;
+		for (int p = 0; p < pairs; ++p)
+		{
+			int n = 2 * p + 1;//离中心的距离
+			double r = (double)n / (2.0 * pairs);//窗的两端落在(4P-1)阶滤波器之外的一个零点上
+			g[p] = sin(pi * n / 2.0) / (pi * n) * BesselI0(beta * sqrt(std::max(0.0, 1.0 - r * r))) / BesselI0(beta);
+			sum += g[p];
+		}
+		// 窗口里第P+p和第P-1-p帧乘同一个系数; 降采样的直流增益(中心0.5加上两倍的和)归一化到1
+		// 升采样插了零, 系数乘2补回增益
+		down.assign(len, 0.0f);
+		up.assign(len, 0.0f);
+		for (int p = 0; p < pairs; ++p)
+		{
+			float v = (float)(g[p] * 0.25 / sum);
+			down[pairs + p] = down[pairs - 1 - p] = v;
+			up[pairs + p] = up[pairs - 1 - p] = v * 2.0f;
+		}
+		upHist.assign((len - 1 + maxFrames) * 2, (T)0);
+		downEven.assign((len - 1 + maxFrames) * 2, (T)0);
+		downOdd.assign((pairs + maxFrames) * 2, (T)0);
+		dots.assign(maxFrames * 2, (T)0);
+#if LMEQ_X86
+		kernel = juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3() ? 2 : 1;
+#endif
+	}
+
+	void Reset()
+	{
+		std::fill(upHist.begin(), upHist.end(), (T)0);
+		std::fill(downEven.begin(), downEven.end(), (T)0);
+		std::fill(downOdd.begin(), downOdd.end(), (T)0);
+	}
+
+	// n帧进, 2n帧出: 一相是点积, 另一相是延迟P-1帧的输入
+	void Up(const T* in, T* out, int n)
+	{
+		const int hist = numPairs * 2 - 1;
+		T* h = upHist.data();
+		memcpy(h + hist * 2, in, n * 2 * sizeof(T));
+		Convolve(up.data(), h, dots.data(), n);
+		for (int t = 0; t < n; ++t)
+		{
+			out[t * 4] = dots[t * 2];
+			out[t * 4 + 1] = dots[t * 2 + 1];
+			out[t * 4 + 2] = h[(t + numPairs) * 2];
+			out[t * 4 + 3] = h[(t + numPairs) * 2 + 1];
+		}
+		memmove(h, h + n * 2, hist * 2 * sizeof(T));
+	}
+
+	// 2n帧进, n帧出: 偶数帧走点积, 奇数帧只过中心抽头
+	void Down(const T* in, T* out, int n)
+	{
+		const int hist = numPairs * 2 - 1;
+		T* e = downEven.data();
+		T* o = downOdd.data();
+		for (int t = 0; t < n; ++t)
+		{
+			e[(hist + t) * 2] = in[t * 4];
+			e[(hist + t) * 2 + 1] = in[t * 4 + 1];
+			o[(numPairs + t) * 2] = in[t * 4 + 2];
+			o[(numPairs + t) * 2 + 1] = in[t * 4 + 3];
+		}
+		Convolve(down.data(), e, dots.data(), n);
+		for (int t = 0; t < n * 2; ++t)
+			out[t] = dots[t] + (T)0.5 * o[t];
+		memmove(e, e + n * 2, hist * 2 * sizeof(T));
+		memmove(o, o + n * 2, numPairs * 2 * sizeof(T));
+	}
+
+	// 升降采样合起来的延迟, 以低采样率一侧的样本计
+	double GetLatency() const { return numPairs * 2 - 1; }
+
+private:
+	std::vector<float> up, down;//2P个系数
+	std::vector<T> upHist, downEven, downOdd;//开头是上一块留下的历史, 后面接这一块
+	std::vector<T> dots;
+	int numPairs = 0;
+	int kernel = 0;//0标量, 1 SSE, 2 AVX2
+
+	static double BesselI0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 50 && term > sum * 1e-17; ++k)
+		{
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	// out[t][ch] = sum k[i] * h[t + i][ch]
+	void Convolve(const float* k, const T* h, T* out, int n) const
+	{
+		const int len = numPairs * 2;
+		int t = 0;
+#if LMEQ_X86
+		if constexpr (std::is_same<T, float>::value)
+		{
+			if (kernel == 2) t = ConvolveAVX2(k, len, h, out, n);
+			else t = ConvolveSSE(k, len, h, out, n);
+		}
+#endif
+		for (; t < n; ++t)
+		{
+			T l = 0, r = 0;
+			for (int i = 0; i < len; ++i)
+			{
+				l += (T)k[i] * h[(t + i) * 2];
+				r += (T)k[i] * h[(t + i) * 2 + 1];
+			}
+			out[t * 2] = l;
+			out[t * 2 + 1] = r;
+		}
+	}
+
+#if LMEQ_X86
+	// 一个向量是相邻两帧的LR; 四个累加器一次8帧, 返回算完的帧数, 剩下的不到两帧交给标量
+	static int ConvolveSSE(const float* k, int len, const float* h, float* out, int n)
+	{
+		int t = 0;
+		for (; t + 8 <= n; t += 8)
+		{
+			__m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+			const float* p = h + t * 2;
+			for (int i = 0; i < len; ++i, p += 2)
+			{
+				__m128 c = _mm_set1_ps(k[i]);
+				a0 = _mm_add_ps(a0, _mm_mul_ps(c, _mm_loadu_ps(p)));
+				a1 = _mm_add_ps(a1, _mm_mul_ps(c, _mm_loadu_ps(p + 4)));
+				a2 = _mm_add_ps(a2, _mm_mul_ps(c, _mm_loadu_ps(p + 8)));
+				a3 = _mm_add_ps(a3, _mm_mul_ps(c, _mm_loadu_ps(p + 12)));
+			}
+			_mm_storeu_ps(out + t * 2, a0);
+			_mm_storeu_ps(out + t * 2 + 4, a1);
+			_mm_storeu_ps(out + t * 2 + 8, a2);
+			_mm_storeu_ps(out + t * 2 + 12, a3);
+		}
+		for (; t + 2 <= n; t += 2)
+		{
+			__m128 a = _mm_setzero_ps();
+			const float* p = h + t * 2;
+			for (int i = 0; i < len; ++i, p += 2)
+				a = _mm_add_ps(a, _mm_mul_ps(_mm_set1_ps(k[i]), _mm_loadu_ps(p)));
+			_mm_storeu_ps(out + t * 2, a);
+		}
+		return t;
+	}
+
+	// 一次16帧
+	LMEQ_TARGET("avx2,fma")
+	static int ConvolveAVX2(const float* k, int len, const float* h, float* out, int n)
+	{
+		int t = 0;
+		for (; t + 16 <= n; t += 16)
+		{
+			__m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+			const float* p = h + t * 2;
+			for (int i = 0; i < len; ++i, p += 2)
+			{
+				__m256 c = _mm256_broadcast_ss(k + i);
+				a0 = _mm256_fmadd_ps(c, _mm256_loadu_ps(p), a0);
+				a1 = _mm256_fmadd_ps(c, _mm256_loadu_ps(p + 8), a1);
+				a2 = _mm256_fmadd_ps(c, _mm256_loadu_ps(p + 16), a2);
+				a3 = _mm256_fmadd_ps(c, _mm256_loadu_ps(p + 24), a3);
+			}
+			_mm256_storeu_ps(out + t * 2, a0);
+			_mm256_storeu_ps(out + t * 2 + 8, a1);
+			_mm256_storeu_ps(out + t * 2 + 16, a2);
+			_mm256_storeu_ps(out + t * 2 + 24, a3);
+		}
+		for (; t + 4 <= n; t += 4)
+		{
+			__m256 a = _mm256_setzero_ps();
+			const float* p = h + t * 2;
+			for (int i = 0; i < len; ++i, p += 2)
+				a = _mm256_fmadd_ps(_mm256_broadcast_ss(k + i), _mm256_loadu_ps(p), a);
+			_mm256_storeu_ps(out + t * 2, a);
+		}
+		return t;
+	}
+#endif
+};
+
+// 最小相位半带: H(z) = (A0(z^2) + z^-1 A1(z^2)) / 2, A0/A1各是一串一阶全通(a + z^-1) / (1 + a z^-1)
+// 两路在低采样率一侧并行, 一个向量是[L路0, L路1, R路0, R路1], 每个样本穿过所有全通
+// 级数是模板参数, 整块处理时状态留在寄存器里, 每级的反馈只有减乘加, 相邻样本的各级可以重叠
+template <typename T>
+class HalfbandIIR
+{
+public:
+	static constexpr int MaxStages = 8;
+
+	// numCoefs为偶数, transition为过渡带宽度(相对高采样率, 通带到0.25 - transition)
+	void Prepare(int numCoefs, double transition)
+	{
+		numStages = juce::jlimit(1, MaxStages, numCoefs / 2);
+		double a[MaxStages * 2];
+		DesignCoefs(a, numStages * 2, transition);
+		latency = 0.0;//两路错开的半个样本在升采样里晚, 在降采样里早, 正好抵消
+		for (int i = 0; i < numStages * 2; ++i)
+		{
+			coefs[i / 2 * 4 + (i & 1)] = coefs[i / 2 * 4 + 2 + (i & 1)] = (float)a[i];
+			latency += (1.0 - a[i]) / (1.0 + a[i]);//一阶全通在直流处的群延迟
+		}
+		Reset();
+	}
+
+	void Reset()
+	{
+		memset(upX, 0, sizeof(upX)); memset(upY, 0, sizeof(upY));
+		memset(downX, 0, sizeof(downX)); memset(downY, 0, sizeof(downY));
+	}
+
+	void Up(const T* in, T* out, int n) { Dispatch<false>(upX, upY, in, out, n); }
+	void Down(const T* in, T* out, int n) { Dispatch<true>(downX, downY, in, out, n); }
+
+	// 升降采样合起来在直流处的群延迟, 以低采样率一侧的样本计; 高频处更长
+	double GetLatency() const { return latency; }
+
+private:
+	float coefs[MaxStages * 4] = {};//[级][L路0, L路1, R路0, R路1]
+	T upX[MaxStages * 4], upY[MaxStages * 4], downX[MaxStages * 4], downY[MaxStages * 4];
+	int numStages = 0;
+	double latency = 0.0;
+
+	template <bool Down>
+	void Dispatch(T* x, T* y, const T* in, T* out, int n)
+	{
+		switch (numStages)
+		{
+		case 1: Run<1, Down>(x, y, in, out, n); break;
+		case 2: Run<2, Down>(x, y, in, out, n); break;
+		case 3: Run<3, Down>(x, y, in, out, n); break;
+		case 4: Run<4, Down>(x, y, in, out, n); break;
+		case 5: Run<5, Down>(x, y, in, out, n); break;
+		case 6: Run<6, Down>(x, y, in, out, n); break;
+		case 7: Run<7, Down>(x, y, in, out, n); break;
+		default: Run<8, Down>(x, y, in, out, n); break;
+		}
+	}
+
+	// 升采样: 一帧进, 两路各出一帧; 降采样: 两帧进(后一帧走路0), 两路平均
+	template <int S, bool Down>
+	void Run(T* xs, T* ys, const T* in, T* out, int n)
+	{
+#if LMEQ_X86
+		if constexpr (std::is_same<T, float>::value)
+		{
+			__m128 a[S], x[S], y[S];
+			for (int k = 0; k < S; ++k)
+			{
+				a[k] = _mm_loadu_ps(coefs + k * 4);
+				x[k] = _mm_loadu_ps(xs + k * 4);
+				y[k] = _mm_loadu_ps(ys + k * 4);
+			}
+			const __m128 half = _mm_set1_ps(0.5f);
+			for (int t = 0; t < n; ++t)
+			{
+				__m128 s;
+				if (Down)
+				{
+					__m128 f = _mm_loadu_ps(in + t * 4);//[L0 R0 L1 R1]
+					s = _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 3, 0, 2));//[L1 L0 R1 R0]
+				}
+				else
+				{
+					__m128 f = _mm_castpd_ps(_mm_load_sd((const double*)(in + t * 2)));
+					s = _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 1, 0, 0));//[L L R R]
+				}
+				for (int k = 0; k < S; ++k)
+				{
+					__m128 o = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(s, y[k]), a[k]), x[k]);
+					x[k] = s;
+					y[k] = s = o;
+				}
+				if (Down)
+				{
+					__m128 h = _mm_mul_ps(_mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 3, 0, 1))), half);
+					_mm_storel_pi((__m64*)(out + t * 2), _mm_shuffle_ps(h, h, _MM_SHUFFLE(2, 0, 2, 0)));
+				}
+				else
+				{
+					_mm_storeu_ps(out + t * 4, _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 1, 2, 0)));//[L路0 R路0 L路1 R路1]
+				}
+			}
+			for (int k = 0; k < S; ++k)
+			{
+				_mm_storeu_ps(xs + k * 4, x[k]);
+				_mm_storeu_ps(ys + k * 4, y[k]);
+			}
+			return;
+		}
+#endif
+		T x[S][4], y[S][4];
+		memcpy(x, xs, sizeof(x));
+		memcpy(y, ys, sizeof(y));
+		for (int t = 0; t < n; ++t)
+		{
+			T s[4];
+			if (Down)
+			{
+				s[0] = in[t * 4 + 2]; s[1] = in[t * 4]; s[2] = in[t * 4 + 3]; s[3] = in[t * 4 + 1];
+			}
+			else
+			{
+				s[0] = s[1] = in[t * 2];
+				s[2] = s[3] = in[t * 2 + 1];
+			}
+			for (int k = 0; k < S; ++k)
+			{
+				for (int j = 0; j < 4; ++j)
+				{
+					T o = (s[j] - y[k][j]) * (T)coefs[k * 4 + j] + x[k][j];
+					x[k][j] = s[j];
+					y[k][j] = s[j] = o;
+				}
+			}
+			if (Down)
+			{
+				out[t * 2] = (T)0.5 * (s[0] + s[1]);
+				out[t * 2 + 1] = (T)0.5 * (s[2] + s[3]);
+			}
+			else
+			{
+				out[t * 4] = s[0]; out[t * 4 + 1] = s[2];
+				out[t * 4 + 2] = s[1]; out[t * 4 + 3] = s[3];
+			}
+		}
+		memcpy(xs, x, sizeof(x));
+		memcpy(ys, y, sizeof(y));
+	}
+
+	// 椭圆半带的全通系数, 按阶数和过渡带宽度给出(Valenzuela & Constantinides的闭式, 即hiir的做法)
+	static void DesignCoefs(double* a, int numCoefs, double transition)
+	{
+		const double pi = 3.14159265358979323846;
+		double k = tan((1.0 - transition * 2.0) * pi / 4.0);
+		k *= k;
+		double kk = pow(1.0 - k * k, 0.25);
+		double e = 0.5 * (1.0 - kk) / (1.0 + kk);
+		double e4 = e * e * e * e;
+		double q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4)));
+		int order = numCoefs * 2 + 1;
+		for (int index = 0; index < numCoefs; ++index)
+		{
+			int c = index + 1;
+			double num = 0.0, den = 0.0, term;
+			int sign = 1;
+			for (int i = 0; ; ++i, sign = -sign)
+			{
+				term = pow(q, i * (i + 1)) * sin((i * 2 + 1) * c * pi / order) * sign;
+				num += term;
+				if (fabs(term) <= 1e-100) break;
+			}
+			sign = -1;
+			for (int i = 1; ; ++i, sign = -sign)
+			{
+				term = pow(q, i * i) * cos(i * 2 * c * pi / order) * sign;
+				den += term;
+				if (fabs(term) <= 1e-100) break;
+			}
+			double ww = num * pow(q, 0.25) / (den + 0.5);
+			double wwsq = ww * ww;
+			double x = sqrt((1.0 - wwsq * k) * (1.0 - wwsq / k)) / (1.0 + wwsq);
+			a[index] = (1.0 - x) / (1.0 + x);
+		}
+	}
+};
+
+// 2x/4x过采样外壳: 整块升上去, 交给inner(l, r, n)在高采样率上原地处理, 再降回来
+// 两种相位的两级都预先分配好, 音频线程换倍数或相位只清状态, 不分配
+template <typename T>
+class Oversampler
+{
+public:
+	static constexpr int MaxFactor = 4;
+	static constexpr int MaxChunk = 256;
+
+	// prepareToPlay调用, 音频线程未运行
+	// 第一级的过渡带按44.1kHz下20kHz的通带取, 第二级只要保护第一级的通带, 短得多
+	void Prepare()
+	{
+		firA.Prepare(32, 9.2, MaxChunk);
+		firB.Prepare(6, 8.6, MaxChunk * 2);
+		iirA.Prepare(12, 0.0225);
+		iirB.Prepare(4, 0.13);
+		base.assign(MaxChunk * 2, (T)0);
+		mid.assign(MaxChunk * 4, (T)0);
+		high.assign(MaxChunk * 8, (T)0);
+		highL.assign(MaxChunk * MaxFactor, (T)0);
+		highR.assign(MaxChunk * MaxFactor, (T)0);
+		Reset();
+	}
+
+	void Reset()
+	{
+		firA.Reset(); firB.Reset();
+		iirA.Reset(); iirB.Reset();
+		midDelay[0] = midDelay[1] = (T)0;
+	}
+
+	// 线性相位时是整数; 4x时第二级差的半个样本在两级之间补一个2x样本的延迟
+	static int GetLatencySamples(int factor, int phase)
+	{
+		static const Latencies lat;
+		if (factor <= 1) return 0;
+		int p = phase == OVERSAMPLE_MINIMUM ? 1 : 0;
+		return factor == 2 ? lat.x2[p] : lat.x4[p];
+	}
+
+	template <typename Inner>
+	void Process(T* l, T* r, int numSamples, int factor, int phase, Inner&& inner)
+	{
+		if (factor != lastFactor || phase != lastPhase)
+		{
+			Reset();
+			lastFactor = factor;
+			lastPhase = phase;
+		}
+		if (factor <= 1 || base.empty())
+		{
+			inner(l, r, numSamples);
+			return;
+		}
+
+		for (int pos = 0; pos < numSamples; pos += MaxChunk)
+		{
+			int n = std::min(MaxChunk, numSamples - pos);
+			int hn = n * factor;
+			for (int t = 0; t < n; ++t)
+			{
+				base[t * 2] = l[pos + t];
+				base[t * 2 + 1] = r[pos + t];
+			}
+			T* up = factor == 4 ? high.data() : mid.data();
+			UpA(base.data(), mid.data(), n, phase);
+			if (factor == 4) UpB(mid.data(), high.data(), n * 2, phase);
+			for (int t = 0; t < hn; ++t)
+			{
+				highL[t] = up[t * 2];
+				highR[t] = up[t * 2 + 1];
+			}
+			inner(highL.data(), highR.data(), hn);
+			for (int t = 0; t < hn; ++t)
+			{
+				up[t * 2] = highL[t];
+				up[t * 2 + 1] = highR[t];
+			}
+			if (factor == 4)
+			{
+				DownB(high.data(), mid.data(), n * 2, phase);
+				if (phase == OVERSAMPLE_LINEAR) DelayMid(n * 2);
+			}
+			DownA(mid.data(), base.data(), n, phase);
+			for (int t = 0; t < n; ++t)
+			{
+				l[pos + t] = base[t * 2];
+				r[pos + t] = base[t * 2 + 1];
+			}
+		}
+	}
+
+private:
+	HalfbandFIR<T> firA, firB;
+	HalfbandIIR<T> iirA, iirB;
+	std::vector<T> base, mid, high;//交错的1x/2x/4x
+	std::vector<T> highL, highR;
+	T midDelay[2] = {};
+	int lastFactor = 1;
+	int lastPhase = OVERSAMPLE_LINEAR;
+
+	// 各组合的延迟只和两级的设计有关, 按Prepare里的参数算一次
+	struct Latencies
+	{
+		int x2[2], x4[2];
+		Latencies()
+		{
+			HalfbandFIR<T> fa, fb;
+			HalfbandIIR<T> ia, ib;
+			fa.Prepare(32, 9.2, 1);
+			fb.Prepare(6, 8.6, 1);
+			ia.Prepare(12, 0.0225);
+			ib.Prepare(4, 0.13);
+			x2[0] = (int)fa.GetLatency();
+			x4[0] = (int)(fa.GetLatency() + (fb.GetLatency() + 1.0) * 0.5);
+			x2[1] = (int)lround(ia.GetLatency());
+			x4[1] = (int)lround(ia.GetLatency() + ib.GetLatency() * 0.5);
+		}
+	};
+
+	void UpA(const T* in, T* out, int n, int phase) { if (phase == OVERSAMPLE_MINIMUM) iirA.Up(in, out, n); else firA.Up(in, out, n); }
+	void UpB(const T* in, T* out, int n, int phase) { if (phase == OVERSAMPLE_MINIMUM) iirB.Up(in, out, n); else firB.Up(in, out, n); }
+	void DownA(const T* in, T* out, int n, int phase) { if (phase == OVERSAMPLE_MINIMUM) iirA.Down(in, out, n); else firA.Down(in, out, n); }
+	void DownB(const T* in, T* out, int n, int phase) { if (phase == OVERSAMPLE_MINIMUM) iirB.Down(in, out, n); else firB.Down(in, out, n); }
+
+	// 2x一侧整体晚一帧
+	void DelayMid(int n)
+	{
+		for (int t = 0; t < n; ++t)
+		{
+			std::swap(midDelay[0], mid[t * 2]);
+			std::swap(midDelay[1], mid[t * 2 + 1]);
+		}
+	}
+};
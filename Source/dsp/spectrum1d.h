@@ -2,145 +2,492 @@
 #include <JuceHeader.h>
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <algorithm>
 #include <cmath>
-
-extern void fft_f32(std::vector<float>& are, std::vector<float>& aim, int n, int inv);
-class Spectrum1d
+#include "spectrumbus.h"
+#include "analysispool.h"
+#include "halfband.h"
+#include "spectrumstats.h"
+
+// 按需运行的频谱分析: 没有可见的界面(消费者)时processBlock直接返回, 缓冲区在第一个消费者出现时才分配
+// 只按显示帧率出帧: 每帧之间最多做MAX_AVERAGED_HOPS次FFT, 功率取平均, 再统一换算成dB和对数频谱
+// 每帧的对数频谱同时发布到进程内的SpectrumBus, 别的实例在看这个槽时也算作消费者
+// 音频线程只把帧放进队列, FFT和出帧都在共享的AnalysisPool里做; 队列满了就丢帧
+// 多分辨率: 半带抽取级联出NUM_OCTAVES个倍频程, 每级用同样长度的FFT, 低频从低采样率的级里取, 分辨率逐级翻倍
+// 打开会话统计后, 每帧对数频谱再喂给SpectrumStatistics, 界面关掉也继续统计
+// 侧链: 主输入放进复数FFT的实部, 侧链放虚部, 一次变换出两个频谱, 再按共轭对称拆开, 不多做FFT
+class Spectrum1d : public AnalysisClient
 {
 public:
 	static constexpr int FFT_SIZE = 1024;
 	static constexpr int HOP_SIZE = 512;
-	static constexpr int LOG_SPECTRUM_BINS = 1024; // Ƶ׵bin
+	static constexpr int LOG_SPECTRUM_BINS = 1024; // 对数频谱的bin数量
 	static constexpr float MIN_FREQ = 10.01f;
 	static constexpr float MAX_FREQ = 24000.0f;
+	static constexpr int MAX_AVERAGED_HOPS = 2;
+	static constexpr float DEFAULT_DISPLAY_RATE = 30.0f;
+	static constexpr int QUEUE_FRAMES = 16;
+	static constexpr int NUM_OCTAVES = 5;            // 第4级在48k下约2.9Hz一个bin
+	static constexpr int DECIMATE_CHUNK = 256;       // processBlock按这个长度分段, 每段逐级整块抽取
+	static constexpr int MIN_OCTAVE_HOP = FFT_SIZE / 4;
+	static constexpr float OCTAVE_CROSSOVER = 0.2f;  // 第k级只用到它采样率的0.2倍, 再往上交给上一级
 
 	Spectrum1d(double sampleRate = 44100.0)
 		: sampleRate_(sampleRate)
-		, writePosition_(0)
 	{
-		inputBuffer_.resize(FFT_SIZE, 0.0f);
-		windowBuffer_.resize(FFT_SIZE, 0.0f);
-		fftReal_.resize(FFT_SIZE, 0.0f);
-		fftImag_.resize(FFT_SIZE, 0.0f);
-		linearMagnitudeBuffer_.resize(FFT_SIZE / 2, 0.0f);
-		logSpectrumBuffer_.resize(LOG_SPECTRUM_BINS, 0.0f);
+		static_assert(LOG_SPECTRUM_BINS == SpectrumBus::NumBins, "bus slot size");
+		busSlot_ = bus_->Claim();
+	}
 
-		createHannWindow();
-		setupLogFrequencies();
+	~Spectrum1d() override
+	{
+		if (allocated_.load())
+			pool_->Unregister(this);
+		bus_->Release(busSlot_);
+	}
+
+	// 消息线程: 界面可见时登记, 隐藏或销毁时注销
+	void addConsumer()
+	{
+		if (!allocated_.load(std::memory_order_acquire))
+			allocateBuffers();
+		++consumers_;
+	}
+
+	void removeConsumer()
+	{
+		if (consumers_.load() > 0)
+			--consumers_;
+	}
+
+	bool isActive() const { return consumers_.load() > 0 || bus_->HasViewers(busSlot_); }
+
+	// 消息线程定时调用: 只有别的实例在看时, 也要把缓冲区准备好
+	void syncBus()
+	{
+		if (bus_->HasViewers(busSlot_) && !allocated_.load(std::memory_order_acquire))
+			allocateBuffers();
+	}
+
+	// 宿主告知的轨道名, 显示在别的实例的叠加列表里
+	void setBusName(const juce::String& name)
+	{
+		if (name.isNotEmpty())
+			bus_->SetName(busSlot_, name);
+	}
+
+	int getBusSlot() const { return busSlot_; }
+
+	// 消息线程: 界面的刷新率, 决定出帧间隔
+	void setDisplayRate(float hz)
+	{
+		displayRate_ = std::max(1.0f, hz);
 	}
 
-	~Spectrum1d() = default;
+	template <typename T>
+	void processBlock(const T* inL, const T* inR, int numSamples)
+	{
+		processBlock(inL, inR, (const T*)nullptr, (const T*)nullptr, numSamples);
+	}
 
-	void processBlock(const float* inL, const float* inR, int numSamples)
+	// keyL/keyR为侧链输入, 为空时没有侧链
+	template <typename T>
+	void processBlock(const T* inL, const T* inR, const T* keyL, const T* keyR, int numSamples)
 	{
-		for (int i = 0; i < numSamples; ++i)
+		if (!isActive() || !allocated_.load(std::memory_order_acquire))
+		{
+			restartFrames();
+			return;
+		}
+		// 侧链接上或断开时从头攒帧, 主输入和侧链的环形缓冲区和抽取器始终对齐
+		bool withKey = keyL != nullptr && keyR != nullptr;
+		if (withKey != keyConnected_)
+		{
+			restartFrames();
+			keyConnected_ = withKey;
+		}
+		updateStrides();
+
+		for (int start = 0; start < numSamples; start += DECIMATE_CHUNK)
 		{
-			// 
-			float sample = (inL[i] + inR[i]) * 0.5f;
+			int n = std::min(DECIMATE_CHUNK, numSamples - start);
 
-			inputBuffer_[writePosition_] = sample;
-			writePosition_++;
+			// 混合左右声道
+			Octave& top = octaves_[0];
+			for (int i = 0; i < n; ++i)
+			{
+				top.block[i] = (float)(inL[start + i] + inR[start + i]) * 0.5f;
+				top.keyBlock[i] = withKey ? (float)(keyL[start + i] + keyR[start + i]) * 0.5f : 0.0f;
+			}
+			top.count = n;
 
-			// ʱִFFT
-			if (writePosition_ >= FFT_SIZE)
+			// 每级抽取一半, 第k级的采样率是sampleRate / 2^k; 整段逐级抽取, 记下每级抽取前有没有剩一个样本
+			bool pending[NUM_OCTAVES] = {};
+			for (int k = 1; k < NUM_OCTAVES; ++k)
 			{
-				performFFT();
-				writePosition_ = 0;
+				Octave& from = octaves_[k - 1];
+				Octave& to = octaves_[k];
+				pending[k - 1] = from.decimator.HasPending();
+				int count = from.decimator.Process(from.block, from.count, to.block);
+				if (withKey) from.keyDecimator.Process(from.keyBlock, from.count, to.keyBlock);
+				else std::fill(to.keyBlock, to.keyBlock + count, 0.0f);
+				to.count = count;
+			}
+
+			// 按时间顺序把各级的样本交给环形缓冲区, 和逐个样本抽取时的出帧顺序一致
+			int used[NUM_OCTAVES] = {};
+			for (int i = 0; i < n; ++i)
+			{
+				++sinceFrame_;
+				pushOctave(0, top.block[i], top.keyBlock[i]);
+				for (int k = 1; k < NUM_OCTAVES; ++k)
+				{
+					bool ready = pending[k - 1];
+					pending[k - 1] = !ready;
+					if (!ready) break;
+					int j = used[k]++;
+					pushOctave(k, octaves_[k].block[j], octaves_[k].keyBlock[j]);
+				}
 			}
 		}
 	}
 
+	// prepareToPlay调用, 音频线程未运行, 分析线程可能还在出帧
 	void setSampleRate(double sampleRate)
 	{
+		juce::ScopedLock lock(spectrumLock_);
 		sampleRate_ = sampleRate;
-		setupLogFrequencies(); // öƵ
+		if (allocated_.load())
+			setupLogFrequencies(); // 重新设置对数频率
+		strideRate_ = 0.0f;
 	}
 
-	// ȡԭʼƵݣڼԣ
+	// 获取原始线性频谱数据（用于兼容性）
 	std::vector<float> getLinearSpectrumData() const
 	{
 		juce::ScopedLock lock(spectrumLock_);
-		return linearMagnitudeBuffer_;
+		return linearMagnitudeBuffer_[0];
 	}
 
-	// ȡƵݣƽʹã
+	// 获取对数频谱数据（平滑绘制使用）
 	std::vector<float> getLogSpectrumData() const
 	{
 		juce::ScopedLock lock(spectrumLock_);
 		return logSpectrumBuffer_;
 	}
 
-	// ȡƵ
+	// 获取对数频率数组
 	std::vector<float> getLogFrequencies() const
 	{
 		return logFrequencies_;
 	}
 
+	// 侧链的对数频谱, 和getLogSpectrumData在同一组频率点上; 最近一帧没有侧链时返回空
+	std::vector<float> getSidechainSpectrumData() const
+	{
+		juce::ScopedLock lock(spectrumLock_);
+		return keyValid_ ? keyLogSpectrumBuffer_ : std::vector<float>();
+	}
+
 	double getSampleRate() const { return sampleRate_; }
 	int getLogSpectrumSize() const { return LOG_SPECTRUM_BINS; }
 
-private:
-	void performFFT()
+	// 消息线程: 整段会话的频谱统计, 开着时本身算一个消费者
+	void setCollectStatistics(bool shouldCollect)
+	{
+		if (shouldCollect == collectStats_.load()) return;
+		if (shouldCollect)
+		{
+			if (stats_.GetNumBins() != LOG_SPECTRUM_BINS)
+				stats_.SetNumBins(LOG_SPECTRUM_BINS);
+			collectStats_.store(true);
+			addConsumer();
+		}
+		else
+		{
+			collectStats_.store(false);
+			removeConsumer();
+		}
+	}
+
+	bool isCollectingStatistics() const { return collectStats_.load(); }
+	void resetStatistics() { stats_.Reset(); }
+	SpectrumStatistics::Snapshot getStatistics() const { return stats_.GetSnapshot(); }
+
+	// 导出为CSV: 每个对数频率点一行
+	juce::String exportStatisticsCSV() const
 	{
-		// ӦôƵFFT
+		auto s = stats_.GetSnapshot();
+		auto freqs = getLogFrequencies();
+		juce::String csv;
+		csv << "# frames," << juce::String(s.frames) << "\n";
+		csv << "freq_hz,ltas_db,mean_db,stddev_db,p10_db,p50_db,p90_db\n";
+		for (size_t i = 0; i < s.mean.size() && i < freqs.size(); ++i)
+		{
+			csv << juce::String(freqs[i], 2) << ","
+				<< juce::String(s.ltas[i], 2) << ","
+				<< juce::String(s.mean[i], 2) << ","
+				<< juce::String(s.stddev[i], 2) << ","
+				<< juce::String(s.p10[i], 2) << ","
+				<< juce::String(s.p50[i], 2) << ","
+				<< juce::String(s.p90[i], 2) << "\n";
+		}
+		return csv;
+	}
+
+	// 分析跟不上时音频线程丢掉的帧数
+	int getDroppedFrames() const { return droppedFrames_.load(std::memory_order_relaxed); }
+
+	// AnalysisClient, 由共享分析线程调用
+	int GetFFTSize() const override { return FFT_SIZE; }
+
+	int GetPriority() const override
+	{
+		return consumers_.load(std::memory_order_relaxed) > 0 ? 1 : 0;
+	}
+
+	int GetNumPending() const override
+	{
+		return (int)(queueWrite_.load(std::memory_order_acquire) - queueRead_.load(std::memory_order_relaxed));
+	}
+
+	void FillFrame(int k, float* re, float* im) override
+	{
+		unsigned int slot = (queueRead_.load(std::memory_order_relaxed) + k) % QUEUE_FRAMES;
+		const float* frame = &queue_[slot * FFT_SIZE];
+		if (queueHasKey_[slot])
+		{
+			const float* key = &keyQueue_[slot * FFT_SIZE];
+			for (int i = 0; i < FFT_SIZE; ++i)
+			{
+				re[i] = frame[i] * windowBuffer_[i];
+				im[i] = key[i] * windowBuffer_[i];
+			}
+			return;
+		}
 		for (int i = 0; i < FFT_SIZE; ++i)
 		{
-			fftReal_[i] = inputBuffer_[i] * windowBuffer_[i];
-			fftImag_[i] = 0.0f;
+			re[i] = frame[i] * windowBuffer_[i];
+			im[i] = 0.0f;
+		}
+	}
+
+	void ConsumeFrames(int count, float* const* re, float* const* im) override
+	{
+		unsigned int read = queueRead_.load(std::memory_order_relaxed);
+		if (discardPartial_.exchange(false, std::memory_order_relaxed))
+		{
+			for (int o = 0; o < NUM_OCTAVES; ++o)
+			{
+				std::fill(powerSum_[o].begin(), powerSum_[o].end(), 0.0f);
+				std::fill(keyPowerSum_[o].begin(), keyPowerSum_[o].end(), 0.0f);
+				hopsAveraged_[o] = 0;
+				keyHopsAveraged_[o] = 0;
+			}
 		}
+		for (int k = 0; k < count; ++k)
+		{
+			unsigned int slot = (read + k) % QUEUE_FRAMES;
+			if (queueHasKey_[slot]) accumulateSplitPower(queueOctave_[slot], re[k], im[k]);
+			else accumulatePower(queueOctave_[slot], re[k], im[k]);
+			if (queueEndOfFrame_[slot])
+				publishFrame();
+		}
+		queueRead_.store(read + count, std::memory_order_release);
+	}
 
-		// ִFFT
-		fft_f32(fftReal_, fftImag_, FFT_SIZE, 0);
+private:
+	void allocateBuffers()
+	{
+		for (int o = 0; o < NUM_OCTAVES; ++o)
+		{
+			octaves_[o].input.assign(FFT_SIZE, 0.0f);
+			octaves_[o].keyInput.assign(FFT_SIZE, 0.0f);
+			powerSum_[o].assign(FFT_SIZE / 2, 0.0f);
+			keyPowerSum_[o].assign(FFT_SIZE / 2, 0.0f);
+			linearMagnitudeBuffer_[o].assign(FFT_SIZE / 2, -100.0f);
+			keyLinearBuffer_[o].assign(FFT_SIZE / 2, -100.0f);
+		}
+		windowBuffer_.assign(FFT_SIZE, 0.0f);
+		queue_.assign(QUEUE_FRAMES * FFT_SIZE, 0.0f);
+		keyQueue_.assign(QUEUE_FRAMES * FFT_SIZE, 0.0f);
+		logSpectrumBuffer_.assign(LOG_SPECTRUM_BINS, -100.0f);
+		keyLogSpectrumBuffer_.assign(LOG_SPECTRUM_BINS, -100.0f);
 
-		// Ƶ׷ȲתΪdB
-		calculateLinearSpectrum();
+		createHannWindow();
+		{
+			juce::ScopedLock lock(spectrumLock_);
+			setupLogFrequencies();
+		}
+		allocated_.store(true, std::memory_order_release);
+		pool_->Register(this);
+	}
 
-		// תΪƵ
-		convertToLogSpectrum();
+	// 音频线程: 空闲或侧链接上/断开时丢掉攒了一半的帧, 重新开始时不混入旧数据
+	void restartFrames()
+	{
+		if (octaves_[0].filled > 0) discardPartial_.store(true, std::memory_order_relaxed);
+		for (auto& o : octaves_)
+		{
+			o.filled = 0;
+			o.decimator.Reset();
+			o.keyDecimator.Reset();
+		}
+		sinceFrame_ = 0;
+		carryEndOfFrame_ = false;
 	}
 
-	void calculateLinearSpectrum()
+	// 一帧的样本数按显示刷新率算, 帧内的FFT间隔不小于FFT_SIZE / 2
+	// 低采样率的级按同样的时间间隔做FFT, 但重叠不超过3/4
+	void updateStrides()
 	{
-		juce::ScopedLock lock(spectrumLock_);
+		float rate = displayRate_.load();
+		if (rate == strideRate_) return;
+		strideRate_ = rate;
+		frameStride_ = std::max(HOP_SIZE, (int)(sampleRate_ / rate));
+		int hopStride = std::max(HOP_SIZE, frameStride_ / MAX_AVERAGED_HOPS);
+		for (int k = 0; k < NUM_OCTAVES; ++k)
+			octaves_[k].hopStride = std::max(MIN_OCTAVE_HOP, hopStride >> k);
+	}
 
-		for (int i = 0; i < FFT_SIZE / 2; ++i)
+	// 音频线程: 第k级来了一个样本, 出帧标记只跟着全频带那一级走
+	void pushOctave(int k, float sample, float key)
+	{
+		Octave& o = octaves_[k];
+		o.input[o.writePosition] = sample;
+		o.keyInput[o.writePosition] = key;
+		o.writePosition = (o.writePosition + 1) % FFT_SIZE;
+		o.filled = std::min(o.filled + 1, FFT_SIZE);
+
+		if (++o.sinceHop >= o.hopStride && o.filled >= FFT_SIZE)
 		{
-			float magnitude = std::sqrt(fftReal_[i] * fftReal_[i] + fftImag_[i] * fftImag_[i]);
+			o.sinceHop = 0;
+			bool endOfFrame = k == 0 && sinceFrame_ >= frameStride_;
+			if (endOfFrame) sinceFrame_ = 0;
+			enqueueFrame(k, endOfFrame);
+		}
+	}
 
-			// һתΪdB
-			magnitude = magnitude / (FFT_SIZE * 0.5f);
-			float dB = 20.0f * std::log10(std::max(magnitude, 1e-5f));
+	// 音频线程: 从环形缓冲区按时间顺序取出一帧放进队列, 加窗留给分析线程
+	// 队列满了说明分析跟不上, 丢掉这一帧, 出帧标记留给下一帧
+	void enqueueFrame(int octave, bool endOfFrame)
+	{
+		endOfFrame = endOfFrame || carryEndOfFrame_;
+		unsigned int write = queueWrite_.load(std::memory_order_relaxed);
+		if (write - queueRead_.load(std::memory_order_acquire) >= (unsigned int)QUEUE_FRAMES)
+		{
+			carryEndOfFrame_ = endOfFrame;
+			droppedFrames_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		carryEndOfFrame_ = false;
+
+		const Octave& o = octaves_[octave];
+		float* frame = &queue_[(write % QUEUE_FRAMES) * FFT_SIZE];
+		int head = FFT_SIZE - o.writePosition;
+		std::copy(o.input.begin() + o.writePosition, o.input.end(), frame);
+		std::copy(o.input.begin(), o.input.begin() + o.writePosition, frame + head);
+		if (keyConnected_)
+		{
+			float* keyFrame = &keyQueue_[(write % QUEUE_FRAMES) * FFT_SIZE];
+			std::copy(o.keyInput.begin() + o.writePosition, o.keyInput.end(), keyFrame);
+			std::copy(o.keyInput.begin(), o.keyInput.begin() + o.writePosition, keyFrame + head);
+		}
+		queueHasKey_[write % QUEUE_FRAMES] = keyConnected_;
+		queueEndOfFrame_[write % QUEUE_FRAMES] = endOfFrame;
+		queueOctave_[write % QUEUE_FRAMES] = octave;
+		queueWrite_.store(write + 1, std::memory_order_release);
+	}
 
-			linearMagnitudeBuffer_[i] = dB;
+	// 分析线程: 功率累加, 出帧时取平均
+	void accumulatePower(int octave, const float* re, const float* im)
+	{
+		std::vector<float>& sum = powerSum_[octave];
+		for (int i = 0; i < FFT_SIZE / 2; ++i)
+			sum[i] += re[i] * re[i] + im[i] * im[i];
+		hopsAveraged_[octave]++;
+	}
+
+	// 分析线程: 实部是主输入, 虚部是侧链, 两个实信号的频谱按共轭对称拆开
+	// X[k] = (Z[k] + conj(Z[N-k])) / 2, Y[k] = (Z[k] - conj(Z[N-k])) / 2j
+	void accumulateSplitPower(int octave, const float* re, const float* im)
+	{
+		std::vector<float>& sum = powerSum_[octave];
+		std::vector<float>& keySum = keyPowerSum_[octave];
+		for (int i = 0; i < FFT_SIZE / 2; ++i)
+		{
+			int j = (FFT_SIZE - i) & (FFT_SIZE - 1);
+			float xr = re[i] + re[j], xi = im[i] - im[j];
+			float yr = im[i] + im[j], yi = re[j] - re[i];
+			sum[i] += (xr * xr + xi * xi) * 0.25f;
+			keySum[i] += (yr * yr + yi * yi) * 0.25f;
 		}
+		hopsAveraged_[octave]++;
+		keyHopsAveraged_[octave]++;
 	}
 
-	void convertToLogSpectrum()
+	// 分析线程: 界面读取很快, 直接等锁
+	// 低频的级一帧里可能还没做完一次FFT, 沿用上一帧的结果
+	void publishFrame()
 	{
+		if (hopsAveraged_[0] == 0) return;
 		juce::ScopedLock lock(spectrumLock_);
 
-		double freqPerBin = sampleRate_ / (FFT_SIZE * 2.0);
-
-		// Ƶ
-		std::vector<float> linearFreqs;
-		std::vector<float> linearMags;
+		for (int o = 0; o < NUM_OCTAVES; ++o)
+		{
+			if (hopsAveraged_[o] == 0) continue;
+			calculateLinearSpectrum(powerSum_[o], hopsAveraged_[o], linearMagnitudeBuffer_[o]);
+			std::fill(powerSum_[o].begin(), powerSum_[o].end(), 0.0f);
+			hopsAveraged_[o] = 0;
+		}
+		convertToLogSpectrum(linearMagnitudeBuffer_, logSpectrumBuffer_);
 
-		for (int i = 1; i < FFT_SIZE / 2; ++i) // DC
+		// 侧链只在这一帧里全频带那一级有过侧链的FFT时才算有效
+		keyValid_ = keyHopsAveraged_[0] > 0;
+		if (keyValid_)
 		{
-			float freq = (float)(i * freqPerBin);
-			if (freq >= MIN_FREQ && freq <= MAX_FREQ)
+			for (int o = 0; o < NUM_OCTAVES; ++o)
 			{
-				linearFreqs.push_back(freq);
-				linearMags.push_back(linearMagnitudeBuffer_[i]);
+				if (keyHopsAveraged_[o] == 0) continue;
+				calculateLinearSpectrum(keyPowerSum_[o], keyHopsAveraged_[o], keyLinearBuffer_[o]);
+				std::fill(keyPowerSum_[o].begin(), keyPowerSum_[o].end(), 0.0f);
+				keyHopsAveraged_[o] = 0;
 			}
+			convertToLogSpectrum(keyLinearBuffer_, keyLogSpectrumBuffer_);
+		}
+		bus_->Publish(busSlot_, logSpectrumBuffer_.data());
+		if (collectStats_.load(std::memory_order_relaxed))
+			stats_.AddFrame(logSpectrumBuffer_.data());
+	}
+
+	void calculateLinearSpectrum(const std::vector<float>& sum, int hops, std::vector<float>& out)
+	{
+		float invHops = 1.0f / (float)hops;
+		for (int i = 0; i < FFT_SIZE / 2; ++i)
+		{
+			float magnitude = std::sqrt(sum[i] * invHops);
+
+			// 归一化并转换为dB
+			magnitude = magnitude / (FFT_SIZE * 0.5f);
+			float dB = 20.0f * std::log10(std::max(magnitude, 1e-5f));
+
+			out[i] = dB;
 		}
+	}
 
-		// ÿƵʵղֵ
+	// 对数频率点上的4点拉格朗日插值, 取哪一级、哪几个点和权重都在setupLogFrequencies里预先算好
+	void convertToLogSpectrum(const std::vector<float>* linearOctaves, std::vector<float>& out)
+	{
 		for (int i = 0; i < LOG_SPECTRUM_BINS; ++i)
 		{
-			float targetFreq = logFrequencies_[i];
-			logSpectrumBuffer_[i] = lagrangeInterpolation(linearFreqs, linearMags, targetFreq);
+			const int* bins = &logInterpBins_[i * 4];
+			const float* weights = &logInterpWeights_[i * 4];
+			const std::vector<float>& linear = linearOctaves[logInterpOctave_[i]];
+			float result = 0.0f;
+			for (int k = 0; k < 4; ++k)
+				result += weights[k] * linear[bins[k]];
+			out[i] = result;
 		}
 	}
 
@@ -158,64 +505,75 @@ private:
 			float logFreq = logMin + i * logStep;
 			logFrequencies_.push_back(std::pow(10.0f, logFreq));
 		}
+
+		setupLogInterpolation();
 	}
 
-	float lagrangeInterpolation(const std::vector<float>& xData,
-		const std::vector<float>& yData,
-		float x) const
+	void setupLogInterpolation()
 	{
-		if (xData.empty() || yData.empty() || xData.size() != yData.size())
-			return -60.0f; // ĬСdBֵ
-
-		// ҵֵΧݵ
-		int n = (int)xData.size();
-
-		// ĿƵʳΧرֵ߽
-		if (x <= xData[0]) return yData[0];
-		if (x >= xData[n - 1]) return yData[n - 1];
-
-		// ҵֵ
-		int startIdx = -1;
-		for (int i = 0; i < n - 1; ++i)
+		logInterpBins_.assign(LOG_SPECTRUM_BINS * 4, 0);
+		logInterpWeights_.assign(LOG_SPECTRUM_BINS * 4, 0.0f);
+		logInterpOctave_.assign(LOG_SPECTRUM_BINS, 0);
+
+		// 每一级的线性频率点, 跳过DC分量
+		std::vector<float> octaveX[NUM_OCTAVES];
+		std::vector<int> octaveBins[NUM_OCTAVES];
+		for (int o = 0; o < NUM_OCTAVES; ++o)
 		{
-			if (x >= xData[i] && x <= xData[i + 1])
+			double freqPerBin = sampleRate_ / (double)(1 << o) / FFT_SIZE;
+			for (int i = 1; i < FFT_SIZE / 2; ++i)
 			{
-				startIdx = i;
-				break;
+				float freq = (float)(i * freqPerBin);
+				if (freq >= MIN_FREQ && freq <= MAX_FREQ)
+				{
+					octaveX[o].push_back(freq);
+					octaveBins[o].push_back(i);
+				}
 			}
 		}
 
-		if (startIdx == -1) return -60.0f;
-
-		// ʹ4ղֵܣ
-		int numPoints = 4;
-		int start = std::max(0, startIdx - 1);
-		int end = std::min(n - 1, start + numPoints - 1);
-		start = std::max(0, end - numPoints + 1);
-
-		// ʵʹõĲֵ
-		int actualPoints = end - start + 1;
-
-		// ղֵ
-		float result = 0.0f;
-
-		for (int i = start; i <= end; ++i)
+		for (int i = 0; i < LOG_SPECTRUM_BINS; ++i)
 		{
-			float term = yData[i];
+			int* outBins = &logInterpBins_[i * 4];
+			float* outWeights = &logInterpWeights_[i * 4];
+			float x = logFrequencies_[i];
+
+			// 取分辨率最高、且这个频率还在它通带里的一级
+			int octave = 0;
+			while (octave + 1 < NUM_OCTAVES && x < OCTAVE_CROSSOVER * sampleRate_ / (double)(1 << (octave + 1)))
+				++octave;
+			logInterpOctave_[i] = octave;
+			const std::vector<float>& xData = octaveX[octave];
+			const std::vector<int>& bins = octaveBins[octave];
+			int n = (int)xData.size();
+			if (n == 0) continue;
+
+			// 如果目标频率超出范围，取边界值
+			if (x <= xData[0] || x >= xData[n - 1] || n < 4)
+			{
+				outBins[0] = x <= xData[0] ? bins[0] : bins[n - 1];
+				outWeights[0] = 1.0f;
+				continue;
+			}
+
+			// 找到插值区间, 取包含它的4个点
+			int startIdx = (int)(std::upper_bound(xData.begin(), xData.end(), x) - xData.begin()) - 1;
+			int start = std::max(0, startIdx - 1);
+			int end = std::min(n - 1, start + 3);
+			start = std::max(0, end - 3);
 
-			// ջ
-			for (int j = start; j <= end; ++j)
+			for (int a = start; a <= end; ++a)
 			{
-				if (i != j)
+				float w = 1.0f;
+				for (int b = start; b <= end; ++b)
 				{
-					term *= (x - xData[j]) / (xData[i] - xData[j]);
+					if (a != b)
+						w *= (x - xData[b]) / (xData[a] - xData[b]);
 				}
+				outBins[a - start] = bins[a];
+				outWeights[a - start] = w;
 			}
-
-			result += term;
 		}
-
-		return result;
 	}
 
 	void createHannWindow()
@@ -228,14 +586,63 @@ private:
 
 private:
 	double sampleRate_;
-	std::vector<float> inputBuffer_;
 	std::vector<float> windowBuffer_;
-	std::vector<float> fftReal_;
-	std::vector<float> fftImag_;
-	std::vector<float> linearMagnitudeBuffer_;  // Ƶ
-	std::vector<float> logSpectrumBuffer_;      // Ƶ
-	std::vector<float> logFrequencies_;         // Ƶ
+	std::vector<float> queue_;                  // 等待分析的帧, QUEUE_FRAMES个
+	std::vector<float> keyQueue_;               // 和queue_对应的侧链帧
+	bool queueEndOfFrame_[QUEUE_FRAMES] = {};
+	bool queueHasKey_[QUEUE_FRAMES] = {};
+	int queueOctave_[QUEUE_FRAMES] = {};
+	std::atomic<unsigned int> queueWrite_{ 0 };
+	std::atomic<unsigned int> queueRead_{ 0 };
+	std::atomic<int> droppedFrames_{ 0 };
+	std::atomic<bool> discardPartial_{ false };  // 空闲过, 分析线程丢掉攒了一半的功率
+	std::vector<float> powerSum_[NUM_OCTAVES];  // 本帧内各次FFT的功率和
+	std::vector<float> linearMagnitudeBuffer_[NUM_OCTAVES];  // 各级的线性频谱数据, 第0级是全频带
+	std::vector<float> logSpectrumBuffer_;      // 对数频谱数据
+	std::vector<float> keyPowerSum_[NUM_OCTAVES];  // 侧链, 同上
+	std::vector<float> keyLinearBuffer_[NUM_OCTAVES];
+	std::vector<float> keyLogSpectrumBuffer_;
+	bool keyValid_ = false;                     // spectrumLock_保护
+	std::vector<float> logFrequencies_;         // 对数频率数组
+	std::vector<int> logInterpOctave_;          // 每个对数频率点取自哪一级
+	std::vector<int> logInterpBins_;            // 每个对数频率点的4个插值点
+	std::vector<float> logInterpWeights_;
+
+	std::atomic<int> consumers_{ 0 };
+	std::atomic<bool> allocated_{ false };
+	std::atomic<float> displayRate_{ DEFAULT_DISPLAY_RATE };
+	std::atomic<bool> collectStats_{ false };
+	SpectrumStatistics stats_;                  // 自己有锁, 分析线程写, 界面取快照
+
+	// 音频线程: 每个倍频程一个环形缓冲区, 抽取器把输出送给下一级
+	struct Octave
+	{
+		std::vector<float> input;
+		std::vector<float> keyInput;
+		int writePosition = 0;
+		int filled = 0;
+		int sinceHop = 0;
+		int hopStride = FFT_SIZE;
+		HalfbandDecimator decimator;
+		HalfbandDecimator keyDecimator;
+		float block[DECIMATE_CHUNK];//这一段里本级的样本, 由上一级抽取得到
+		float keyBlock[DECIMATE_CHUNK];
+		int count = 0;
+	};
+	Octave octaves_[NUM_OCTAVES];
+	int sinceFrame_ = 0;
+	int frameStride_ = FFT_SIZE;
+	float strideRate_ = 0.0f;
+	bool carryEndOfFrame_ = false;
+	bool keyConnected_ = false;
+
+	// 分析线程
+	int hopsAveraged_[NUM_OCTAVES] = {};
+	int keyHopsAveraged_[NUM_OCTAVES] = {};
 
-	int writePosition_;
 	mutable juce::CriticalSection spectrumLock_;
+
+	juce::SharedResourcePointer<SpectrumBus> bus_;
+	int busSlot_ = -1;
+	juce::SharedResourcePointer<AnalysisPool> pool_;
 };
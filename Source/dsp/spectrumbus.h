@@ -0,0 +1,150 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+// 进程内所有实例共享的频谱总线: 每个实例占一个槽, 把最新的对数频谱写进去, 别的实例的界面可以叠加显示
+// 槽固定分配不释放. 数据用8位dB存(0.5dB一级), 每个槽用序号锁(seqlock)保护
+// 写的一方是AnalysisPool的工作线程(出帧时), 读的一方是别的实例界面的定时器(消息线程)
+// 每个槽只有一个写者: 槽属于一个Spectrum1d实例, 而池子同一时刻只把一个实例交给一个工作线程(AnalysisClient::busy)
+// 写的一方只做原子写, 不加锁也不看读者, 写一帧的步数是固定的(无等待), 读者再慢也拖不住分析线程;
+// 读的一方发现序号是奇数或前后变了就重读, 最多重读MaxReadRetries次, 读不到这一帧就沿用上一帧
+class SpectrumBus
+{
+public:
+	static constexpr int NumSlots = 128;
+	static constexpr int NumBins = 1024;//和Spectrum1d::LOG_SPECTRUM_BINS一致
+	static constexpr float MinDB = -120.0f;
+	static constexpr float StepDB = 0.5f;//0..255 对应 -120..+7.5dB
+	static constexpr int MaxReadRetries = 4;
+
+	struct PublisherInfo
+	{
+		int slot;
+		juce::String name;
+	};
+
+	// 消息线程: 占一个空槽, 满了返回-1
+	int Claim()
+	{
+		for (int i = 0; i < NumSlots; ++i)
+		{
+			bool expected = false;
+			if (slots[i].claimed.compare_exchange_strong(expected, true))
+			{
+				juce::SpinLock::ScopedLockType lock(nameLock);
+				names[i] = juce::String("Track ") + juce::String(i + 1);
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	void Release(int slot)
+	{
+		if (slot < 0) return;
+		Slot& s = slots[slot];
+		s.frames.store(0, std::memory_order_relaxed);
+		s.claimed.store(false, std::memory_order_release);
+	}
+
+	// 宿主给出的轨道名, 只在消息线程读写
+	void SetName(int slot, const juce::String& name)
+	{
+		if (slot < 0) return;
+		juce::SpinLock::ScopedLockType lock(nameLock);
+		names[slot] = name;
+	}
+
+	// 已经出过帧的发布者, exclude一般是自己的槽
+	std::vector<PublisherInfo> GetPublishers(int exclude = -1) const
+	{
+		std::vector<PublisherInfo> list;
+		juce::SpinLock::ScopedLockType lock(nameLock);
+		for (int i = 0; i < NumSlots; ++i)
+		{
+			if (i != exclude && slots[i].claimed.load(std::memory_order_acquire))
+				list.push_back({ i, names[i] });
+		}
+		return list;
+	}
+
+	// 看的人登记后, 发布者即使自己的界面没打开也会继续分析
+	void AddViewer(int slot) { if (slot >= 0) ++slots[slot].viewers; }
+	void RemoveViewer(int slot) { if (slot >= 0 && slots[slot].viewers.load() > 0) --slots[slot].viewers; }
+	bool HasViewers(int slot) const { return slot >= 0 && slots[slot].viewers.load(std::memory_order_relaxed) > 0; }
+
+	// AnalysisPool工作线程(分析线程): 写入一帧dB频谱, 不加锁不等待
+	void Publish(int slot, const float* dB)
+	{
+		if (slot < 0) return;
+		Slot& s = slots[slot];
+		unsigned int seq = s.seq.load(std::memory_order_relaxed);
+		s.seq.store(seq + 1, std::memory_order_relaxed);//奇数: 正在写
+		std::atomic_thread_fence(std::memory_order_release);
+		for (int w = 0; w < NumBins / 4; ++w)
+		{
+			uint32_t word = 0;
+			for (int k = 0; k < 4; ++k)
+				word |= (uint32_t)Encode(dB[w * 4 + k]) << (k * 8);
+			s.data[w].store(word, std::memory_order_relaxed);
+		}
+		s.seq.store(seq + 2, std::memory_order_release);
+		s.frames.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// 消息线程(界面定时器): 读出一帧到dB, 没出过帧或一直读到写了一半时返回false
+	// 和分析线程并发, 只有读的一方会重试
+	bool Read(int slot, float* dB) const
+	{
+		if (slot < 0 || slots[slot].frames.load(std::memory_order_relaxed) == 0) return false;
+		const Slot& s = slots[slot];
+		for (int attempt = 0; attempt < MaxReadRetries; ++attempt)
+		{
+			unsigned int before = s.seq.load(std::memory_order_acquire);
+			if (before & 1u) continue;
+			for (int w = 0; w < NumBins / 4; ++w)
+			{
+				uint32_t word = s.data[w].load(std::memory_order_relaxed);
+				for (int k = 0; k < 4; ++k)
+					dB[w * 4 + k] = Decode((uint8_t)(word >> (k * 8)));
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (s.seq.load(std::memory_order_relaxed) == before) return true;
+		}
+		return false;
+	}
+
+	// 已发布的帧数, 界面用来判断有没有新数据
+	unsigned int GetFrameCount(int slot) const
+	{
+		return slot < 0 ? 0u : slots[slot].frames.load(std::memory_order_relaxed);
+	}
+
+	static uint8_t Encode(float dB)
+	{
+		float code = (dB - MinDB) / StepDB + 0.5f;
+		return (uint8_t)juce::jlimit(0.0f, 255.0f, code);
+	}
+
+	static float Decode(uint8_t code)
+	{
+		return MinDB + code * StepDB;
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<unsigned int> seq{ 0 };
+		std::atomic<unsigned int> frames{ 0 };
+		std::atomic<bool> claimed{ false };
+		std::atomic<int> viewers{ 0 };
+		std::atomic<uint32_t> data[NumBins / 4] = {};//每个字4个bin
+	};
+
+	Slot slots[NumSlots];
+	juce::String names[NumSlots];
+	juce::SpinLock nameLock;
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// P²分位数估计(Jain & Chlamtac 1985): 5个标记点跟踪一个分位数, 不保存样本, 内存固定
+// https://www.cse.wustl.edu/~jain/papers/ftp/psqr.pdf
+class P2Quantile
+{
+public:
+	void Reset(float quantile)
+	{
+		p = quantile;
+		count = 0;
+		dn[0] = 0.0f; dn[1] = p * 0.5f; dn[2] = p; dn[3] = (1.0f + p) * 0.5f; dn[4] = 1.0f;
+	}
+
+	void Add(float x)
+	{
+		if (count < 5)
+		{
+			q[count++] = x;
+			if (count == 5)
+			{
+				std::sort(q, q + 5);
+				for (int i = 0; i < 5; ++i)
+				{
+					n[i] = i;
+					np[i] = 4.0f * dn[i];
+				}
+			}
+			return;
+		}
+		++count;
+
+		// 找到x落在哪个区间, 必要时扩展两端
+		int k;
+		if (x < q[0]) { q[0] = x; k = 0; }
+		else if (x >= q[4]) { q[4] = x; k = 3; }
+		else for (k = 0; k < 3 && x >= q[k + 1]; ++k);
+
+		for (int i = k + 1; i < 5; ++i) ++n[i];
+		for (int i = 0; i < 5; ++i) np[i] += dn[i];
+
+		// 中间三个标记偏离期望位置超过1时, 用抛物线(不行就线性)插值挪一格
+		for (int i = 1; i < 4; ++i)
+		{
+			float d = np[i] - n[i];
+			if ((d >= 1.0f && n[i + 1] - n[i] > 1) || (d <= -1.0f && n[i - 1] - n[i] < -1))
+			{
+				int s = d > 0.0f ? 1 : -1;
+				float qp = Parabolic(i, (float)s);
+				if (q[i - 1] < qp && qp < q[i + 1]) q[i] = qp;
+				else q[i] = q[i] + s * (q[i + s] - q[i]) / (float)(n[i + s] - n[i]);
+				n[i] += s;
+			}
+		}
+	}
+
+	// 样本不到5个时直接取排序后的近似位置
+	float Get() const
+	{
+		if (count >= 5) return q[2];
+		if (count == 0) return 0.0f;
+		float tmp[5];
+		std::copy(q, q + count, tmp);
+		std::sort(tmp, tmp + count);
+		return tmp[std::min(count - 1, (int)(p * count))];
+	}
+
+private:
+	float Parabolic(int i, float s) const
+	{
+		float a = (float)(n[i + 1] - n[i - 1]);
+		float b1 = (n[i] - n[i - 1] + s) * (q[i + 1] - q[i]) / (float)(n[i + 1] - n[i]);
+		float b2 = (n[i + 1] - n[i] - s) * (q[i] - q[i - 1]) / (float)(n[i] - n[i - 1]);
+		return q[i] + s / a * (b1 + b2);
+	}
+
+	float p = 0.5f;
+	int count = 0;
+	float q[5] = {};		// 标记高度
+	int n[5] = {};			// 标记的实际位置
+	float np[5] = {};		// 期望位置
+	float dn[5] = {};		// 每来一个样本期望位置的增量
+};
+
+// 整段会话的频谱统计: 每个对数频率点一组流式估计, 不管跑多久内存都不变
+// 均值/方差用Welford(在dB上), 长时平均谱(LTAS)在功率上平均, 另外跟踪10/50/90分位数
+// 分析线程喂数据, 界面或导出时取快照
+class SpectrumStatistics
+{
+public:
+	static constexpr int NumQuantiles = 3;
+	static constexpr float Quantiles[NumQuantiles] = { 0.1f, 0.5f, 0.9f };
+
+	struct Snapshot
+	{
+		juce::int64 frames = 0;
+		std::vector<float> ltas;		// 功率平均, dB
+		std::vector<float> mean;		// dB的平均
+		std::vector<float> stddev;		// dB的标准差
+		std::vector<float> p10, p50, p90;
+	};
+
+	explicit SpectrumStatistics(int numBins = 0) { SetNumBins(numBins); }
+
+	void SetNumBins(int numBins)
+	{
+		juce::ScopedLock lock(statsLock);
+		bins.assign(numBins, Bin());
+		frames = 0;
+		for (auto& b : bins) b.Reset();
+	}
+
+	void Reset()
+	{
+		juce::ScopedLock lock(statsLock);
+		frames = 0;
+		for (auto& b : bins) b.Reset();
+	}
+
+	// 分析线程: 加入一帧dB频谱
+	void AddFrame(const float* dB)
+	{
+		juce::ScopedLock lock(statsLock);
+		++frames;
+		double invN = 1.0 / (double)frames;
+		for (size_t i = 0; i < bins.size(); ++i)
+		{
+			Bin& b = bins[i];
+			double x = dB[i];
+			double delta = x - b.mean;
+			b.mean += delta * invN;
+			b.m2 += delta * (x - b.mean);
+			b.power += (std::pow(10.0, x * 0.1) - b.power) * invN;
+			for (auto& e : b.quantiles) e.Add(dB[i]);
+		}
+	}
+
+	int GetNumBins() const
+	{
+		juce::ScopedLock lock(statsLock);
+		return (int)bins.size();
+	}
+
+	juce::int64 GetNumFrames() const
+	{
+		juce::ScopedLock lock(statsLock);
+		return frames;
+	}
+
+	Snapshot GetSnapshot() const
+	{
+		juce::ScopedLock lock(statsLock);
+		Snapshot s;
+		s.frames = frames;
+		size_t n = bins.size();
+		for (auto* v : { &s.ltas, &s.mean, &s.stddev, &s.p10, &s.p50, &s.p90 })
+			v->resize(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			const Bin& b = bins[i];
+			s.ltas[i] = (float)(10.0 * std::log10(std::max(b.power, 1e-30)));
+			s.mean[i] = (float)b.mean;
+			s.stddev[i] = frames > 1 ? (float)std::sqrt(b.m2 / (double)(frames - 1)) : 0.0f;
+			s.p10[i] = b.quantiles[0].Get();
+			s.p50[i] = b.quantiles[1].Get();
+			s.p90[i] = b.quantiles[2].Get();
+		}
+		return s;
+	}
+
+private:
+	struct Bin
+	{
+		double mean = 0.0, m2 = 0.0, power = 0.0;
+		P2Quantile quantiles[NumQuantiles];
+
+		void Reset()
+		{
+			mean = m2 = power = 0.0;
+			for (int k = 0; k < NumQuantiles; ++k)
+				quantiles[k].Reset(Quantiles[k]);
+		}
+	};
+
+	std::vector<Bin> bins;
+	juce::int64 frames = 0;
+	mutable juce::CriticalSection statsLock;
+};
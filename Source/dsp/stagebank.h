@@ -0,0 +1,898 @@
+#pragma once
+
+//SVF级联展开成一排"级", 运行时按CPU和实测速度选择内核
+//SIMD内核按波前方式处理级联: 第k个lane是第k级, 同一步里处理第n-k个样本
+//声道路由: 每级两个lane各是一条独立的链, 左右段处理L/R, 中侧段在M/S矩阵之后处理M/S
+//https://kokkinizita.linuxaudio.org/papers/digsvfilt.pdf
+
+#include <JuceHeader.h>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <string.h>
+#include "biquad.h"
+#include "svf.h"
+#include "mailbox.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LMEQ_X86 1
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define LMEQ_TARGET(isa) __attribute__((target(isa)))
+#else
+#define LMEQ_TARGET(isa)
+#endif
+#else
+#define LMEQ_X86 0
+#endif
+
+enum StageKernel {
+	KERNEL_SCALAR_CASCADE = 0,	// 逐样本穿过所有级
+	KERNEL_SCALAR_BLOCK,		// 逐级处理整块
+	KERNEL_SCALAR_DIRECT,		// 逐级处理整块, TDF2直接型
+	KERNEL_SSE,					// 波前, 2级x2声道
+	KERNEL_AVX2,				// 波前, 4级x2声道
+	KERNEL_AVX512,				// 波前, 8级x2声道
+	NumStageKernels
+};
+
+// 节点作用的声道; 左/右/中/侧的节点只占一个lane, 同一段里另一个声道的节点可以和它共用一级
+enum ChannelRoute {
+	ROUTE_STEREO = 0,
+	ROUTE_LEFT,
+	ROUTE_RIGHT,
+	ROUTE_MID,
+	ROUTE_SIDE,
+	NumChannelRoutes
+};
+
+// 展开后的一组级联系数, 每级占两个lane(声道0, 声道1)
+// 消息线程构造, 音频线程接管之后状态也存在这里
+// 级联是线性时不变的, 级的顺序可以调换: c1/c2很小的级挪到最后, 用double状态单独处理(宽级)
+// 两个声道是两条互不相关的链, 同一级的两个lane可以是不同节点的级: 每段的级数是两条链里长的那条
+// 左右段在前, 中侧段在后(从msFirst开始, 对齐到LaneAlign, 波前的组不跨段); 立体声节点和什么都可交换, 放在左右段
+struct StageSet
+{
+	static constexpr int LaneAlign = 8;//补齐到8级, 正好是AVX-512的一组
+	static constexpr float DirectFormMinC1 = 0.01f;//c1更小说明极点贴近z=1, float直接型误差太大
+	static constexpr float WideMinC = 1e-3f;//c1或c2更小时float状态的误差超过-130dB
+	static constexpr int NoKey = INT_MAX;//补齐或空着的lane, 直通
+
+	int numStages = 0;//两段的级数之和, 不含补齐
+	int paddedStages = 0;
+	int numLR = 0;//左右段: [0, numLR)
+	int msFirst = 0, numMS = 0;//中侧段: [msFirst, msFirst + numMS)
+	std::vector<int> keys;//每lane: (节点id * 64 + 级序号) * 2 + 声道
+	std::vector<unsigned char> precise;//只能用SVF结构的级
+	std::vector<float> c1, c2, d0, d1, d2;//SVF, 下标为 级 * 2 + 声道
+	std::vector<float> b0, b1, b2, a1, a2;//TDF2
+	std::vector<float> z1, z2;//SVF状态
+	std::vector<float> s1, s2;//TDF2状态
+
+	int numWide = 0;
+	int wideLR = 0;//宽级的左右段: [0, wideLR), 中侧段到numWide
+	std::vector<int> wkeys;
+	std::vector<double> wc1, wc2, wd0, wd1, wd2;//宽级, 下标同上
+	std::vector<double> wz1, wz2;
+
+	// 所有实际占用的lane按key升序, 换系数和搬运状态时按它查找
+	struct LaneRef { int key; int lane; bool wide; };
+	std::vector<LaneRef> index;
+
+	static bool NeedsWide(float nb0, float nb1, float nb2, float na1, float na2)
+	{
+		float nd0, nd1, nd2, nc1, nc2;
+		BiquadToSVF(nb0, nb1, nb2, na1, na2, nd0, nd1, nd2, nc1, nc2);
+		return std::min(nc1, nc2) < WideMinC;
+	}
+
+	static bool IsMidSide(int route) { return route == ROUTE_MID || route == ROUTE_SIDE; }
+	bool HasMidSide() const { return numMS > 0 || numWide > wideLR; }
+
+	// routes为空时全部是立体声
+	void Build(const std::vector<BiquadCoeffs>& coeffs, const std::vector<int>& ids, const std::vector<int>& routes = {})
+	{
+		// 先按段, 声道, 是否宽级分成8条链, 再逐级配对填入
+		struct Stage { int key; float b0, b1, b2, a1, a2; };
+		std::vector<Stage> chains[2][2][2];//[段][声道][宽]
+		for (size_t i = 0; i < coeffs.size(); ++i)
+		{
+			const BiquadCoeffs& c = coeffs[i];
+			int route = i < routes.size() ? routes[i] : ROUTE_STEREO;
+			int seg = IsMidSide(route) ? 1 : 0;
+			bool ch0 = route != ROUTE_RIGHT && route != ROUTE_SIDE;
+			bool ch1 = route != ROUTE_LEFT && route != ROUTE_MID;
+			for (int j = 0; j <= c.numStages; ++j)
+			{
+				Stage st = j == 0 ? Stage{ 0, c.b0, c.b1, c.b2, c.a1, c.a2 } :
+					Stage{ 0, c.b0s[j - 1], c.b1s[j - 1], c.b2s[j - 1], c.a1s[j - 1], c.a2s[j - 1] };
+				int wide = NeedsWide(st.b0, st.b1, st.b2, st.a1, st.a2) ? 1 : 0;
+				st.key = (ids[i] * 64 + j) * 2;
+				if (ch0) chains[seg][0][wide].push_back(st);
+				if (ch1) { st.key += 1; chains[seg][1][wide].push_back(st); }
+			}
+		}
+		auto slots = [&](int seg, int wide) { return (int)std::max(chains[seg][0][wide].size(), chains[seg][1][wide].size()); };
+
+		numLR = slots(0, 0);
+		numMS = slots(1, 0);
+		msFirst = (numLR + LaneAlign - 1) / LaneAlign * LaneAlign;
+		numStages = numLR + numMS;
+		paddedStages = msFirst + (numMS + LaneAlign - 1) / LaneAlign * LaneAlign;
+		wideLR = slots(0, 1);
+		numWide = wideLR + slots(1, 1);
+
+		int lanes = paddedStages * 2;
+		keys.assign(lanes, NoKey);
+		precise.assign(paddedStages, 0);
+		// 补齐的级是直通: d0 = b0 = 1, 其余为0
+		for (auto* v : { &c1, &c2, &d1, &d2, &b1, &b2, &a1, &a2, &z1, &z2, &s1, &s2 }) v->assign(lanes, 0.0f);
+		d0.assign(lanes, 1.0f);
+		b0.assign(lanes, 1.0f);
+
+		wkeys.assign(numWide * 2, NoKey);
+		for (auto* v : { &wc1, &wc2, &wd1, &wd2, &wz1, &wz2 }) v->assign(numWide * 2, 0.0);
+		wd0.assign(numWide * 2, 1.0);
+
+		index.clear();
+		for (int seg = 0; seg < 2; ++seg)
+		{
+			for (int ch = 0; ch < 2; ++ch)
+			{
+				int k = seg == 0 ? 0 : msFirst;
+				for (const auto& st : chains[seg][ch][0])
+				{
+					SetLane(k * 2 + ch, st.key, st.b0, st.b1, st.b2, st.a1, st.a2);
+					index.push_back({ st.key, k * 2 + ch, false });
+					++k;
+				}
+				int w = seg == 0 ? 0 : wideLR;
+				for (const auto& st : chains[seg][ch][1])
+				{
+					SetWideLane(w * 2 + ch, st.key, st.b0, st.b1, st.b2, st.a1, st.a2);
+					index.push_back({ st.key, w * 2 + ch, true });
+					++w;
+				}
+			}
+		}
+		for (int k = 0; k < paddedStages; ++k) UpdatePrecise(k);
+		std::sort(index.begin(), index.end(), [](const LaneRef& a, const LaneRef& b) { return a.key < b.key; });
+	}
+
+	void SetLane(int i, int key, float nb0, float nb1, float nb2, float na1, float na2)
+	{
+		float nd0, nd1, nd2, nc1, nc2;
+		BiquadToSVF(nb0, nb1, nb2, na1, na2, nd0, nd1, nd2, nc1, nc2);
+		keys[i] = key;
+		c1[i] = nc1; c2[i] = nc2; d0[i] = nd0; d1[i] = nd1; d2[i] = nd2;
+		b0[i] = nb0; b1[i] = nb1; b2[i] = nb2; a1[i] = na1; a2[i] = na2;
+	}
+
+	// 直接型内核按级选结构, 两个lane里有一个要SVF就整级走SVF
+	void UpdatePrecise(int k)
+	{
+		bool p = false;
+		for (int i = k * 2; i < k * 2 + 2; ++i)
+			p = p || (keys[i] != NoKey && c1[i] < DirectFormMinC1);
+		precise[k] = p;
+	}
+
+	// 宽级的SVF系数用double换算, 少一次舍入
+	void SetWideLane(int i, int key, double nb0, double nb1, double nb2, double na1, double na2)
+	{
+		wkeys[i] = key;
+		double nc1 = na1 + 2.0;
+		double nc2 = (1.0 + na1 + na2) / nc1;
+		wc1[i] = nc1;
+		wc2[i] = nc2;
+		wd0[i] = nb0;
+		wd1[i] = (2.0 * nb0 + nb1) / nc1;
+		wd2[i] = (nb0 + nb1 + nb2) / (nc1 * nc2);
+	}
+
+	void ClearState()
+	{
+		std::fill(z1.begin(), z1.end(), 0.0f);
+		std::fill(z2.begin(), z2.end(), 0.0f);
+		std::fill(s1.begin(), s1.end(), 0.0f);
+		std::fill(s2.begin(), s2.end(), 0.0f);
+		std::fill(wz1.begin(), wz1.end(), 0.0);
+		std::fill(wz2.begin(), wz2.end(), 0.0);
+	}
+
+	// 取lane i的SVF形式状态; 直接型内核下非precise的级状态在s1/s2里, 要换算
+	// 两种结构零输入响应的前两个点相同, 状态就等价
+	void GetState(int i, bool directKernel, double& rz1, double& rz2) const
+	{
+		if (!directKernel || precise[i / 2])
+		{
+			rz1 = z1[i];
+			rz2 = z2[i];
+			return;
+		}
+		double y0 = s1[i];
+		double y1 = s2[i] - a1[i] * y0;
+		double p = (double)d1[i] - d0[i], q = (double)d2[i] - d0[i];
+		double m10 = p * (1.0 - c1[i]) + q * c2[i], m11 = q - p * c1[i];
+		double det = p * m11 - q * m10;
+		if (fabs(det) < 1e-20)
+		{
+			rz1 = rz2 = 0.0;
+			return;
+		}
+		rz1 = (y0 * m11 - q * y1) / det;
+		rz2 = (p * y1 - m10 * y0) / det;
+	}
+
+	void SetState(int i, bool directKernel, double nz1, double nz2)
+	{
+		z1[i] = (float)nz1;
+		z2[i] = (float)nz2;
+		if (!directKernel || precise[i / 2]) return;
+		double x = -nz1 - nz2;
+		double y0 = d0[i] * x + d1[i] * nz1 + d2[i] * nz2;
+		double tz1 = nz1 + c1[i] * x;
+		double tz2 = nz2 + c2[i] * nz1;
+		x = -tz1 - tz2;
+		double y1 = d0[i] * x + d1[i] * tz1 + d2[i] * tz2;
+		s1[i] = (float)y0;
+		s2[i] = (float)(y1 + a1[i] * y0);
+	}
+
+	// 节点id占用的lane在index里的范围
+	void FindNode(int id, int& lo, int& hi) const
+	{
+		auto less = [](const LaneRef& a, int key) { return a.key < key; };
+		lo = (int)(std::lower_bound(index.begin(), index.end(), id * 128, less) - index.begin());
+		hi = (int)(std::lower_bound(index.begin() + lo, index.end(), (id + 1) * 128, less) - index.begin());
+	}
+
+	// 音频线程: set()换掉float段lane i的系数; 同一级另一个lane的直接型状态可能因为precise翻转要换算, 两个一起过渡
+	template <typename Set>
+	void ReplaceLane(int i, bool directKernel, bool keepState, Set&& set)
+	{
+		int k = i / 2;
+		if (keepState && !directKernel)
+		{
+			set();
+			UpdatePrecise(k);
+			return;
+		}
+		double rz[4];
+		GetState(k * 2, directKernel, rz[0], rz[1]);
+		GetState(k * 2 + 1, directKernel, rz[2], rz[3]);
+		set();
+		UpdatePrecise(k);
+		SetState(k * 2, directKernel, rz[0], rz[1]);
+		SetState(k * 2 + 1, directKernel, rz[2], rz[3]);
+	}
+
+	// 音频线程: 原地改一个节点的系数, 只有级数和每级所在的段都不变时才行
+	bool UpdateNode(int id, const BiquadCoeffs& c, bool directKernel)
+	{
+		int total = 1 + c.numStages;
+		int lo, hi;
+		FindNode(id, lo, hi);
+
+		// 先检查, 不行就整个放弃, 不留改了一半的状态
+		int channels = 0;
+		for (int e = lo; e < hi; ++e)
+		{
+			int j = (index[e].key >> 1) & 63;
+			if (j >= total) return false;
+			bool wide = j == 0 ? NeedsWide(c.b0, c.b1, c.b2, c.a1, c.a2) :
+				NeedsWide(c.b0s[j - 1], c.b1s[j - 1], c.b2s[j - 1], c.a1s[j - 1], c.a2s[j - 1]);
+			if (wide != index[e].wide) return false;
+			if (j == 0) ++channels;
+		}
+		if (channels == 0 || hi - lo != total * channels) return false;
+
+		for (int e = lo; e < hi; ++e)
+		{
+			int j = (index[e].key >> 1) & 63;
+			float nb0 = j == 0 ? c.b0 : c.b0s[j - 1];
+			float nb1 = j == 0 ? c.b1 : c.b1s[j - 1];
+			float nb2 = j == 0 ? c.b2 : c.b2s[j - 1];
+			float na1 = j == 0 ? c.a1 : c.a1s[j - 1];
+			float na2 = j == 0 ? c.a2 : c.a2s[j - 1];
+			const LaneRef& r = index[e];
+			if (r.wide) SetWideLane(r.lane, r.key, nb0, nb1, nb2, na1, na2);
+			else ReplaceLane(r.lane, directKernel, false, [&] { SetLane(r.lane, r.key, nb0, nb1, nb2, na1, na2); });
+		}
+		return true;
+	}
+
+	// 音频线程: 单级节点直接换SVF系数(GainDesign给的), 不经过BiquadToSVF的除法
+	// SVF状态只和极点有关, 只动d0/d1/d2时原样保留; 直接型内核或极点也变了时和UpdateNode一样按SVF形式的状态过渡
+	// 节点不是恰好一级, 或者要在float段和宽级之间换段时返回false
+	bool UpdateNodeSVF(int id, float nd0, float nd1, float nd2, float nc1, float nc2, bool directKernel)
+	{
+		int lo, hi;
+		FindNode(id, lo, hi);
+		if (lo == hi) return false;
+		bool toWide = std::min(nc1, nc2) < WideMinC;
+		for (int e = lo; e < hi; ++e)
+			if (((index[e].key >> 1) & 63) != 0 || index[e].wide != toWide) return false;
+
+		if (toWide)
+		{
+			for (int e = lo; e < hi; ++e)
+			{
+				int i = index[e].lane;
+				wc1[i] = nc1; wc2[i] = nc2; wd0[i] = nd0; wd1[i] = nd1; wd2[i] = nd2;
+			}
+			return true;
+		}
+
+		// TDF2系数从SVF反推, 只有乘法: a1 = c1 - 2, 1 + a1 + a2 = c1c2, b1 = d1c1 - 2d0, b0 + b1 + b2 = d2c1c2
+		float na1 = nc1 - 2.0f;
+		float na2 = nc1 * nc2 - 1.0f - na1;
+		float nb1 = nd1 * nc1 - 2.0f * nd0;
+		float nb2 = nd2 * nc1 * nc2 - nd0 - nb1;
+		for (int e = lo; e < hi; ++e)
+		{
+			int i = index[e].lane;
+			ReplaceLane(i, directKernel, c1[i] == nc1 && c2[i] == nc2, [&]
+				{
+					c1[i] = nc1; c2[i] = nc2; d0[i] = nd0; d1[i] = nd1; d2[i] = nd2;
+					b0[i] = nd0; b1[i] = nb1; b2[i] = nb2; a1[i] = na1; a2[i] = na2;
+				});
+		}
+		return true;
+	}
+
+	// 音频线程: 接管前一组的状态, key相同(同一节点同一级同一声道)的才搬, 级可能换了段
+	void CopyStateFrom(const StageSet& old, bool directKernel)
+	{
+		size_t j = 0;
+		for (const LaneRef& e : index)
+		{
+			while (j < old.index.size() && old.index[j].key < e.key) ++j;
+			if (j == old.index.size()) break;
+			const LaneRef& o = old.index[j];
+			if (o.key != e.key) continue;
+			double rz1, rz2;
+			if (o.wide) { rz1 = old.wz1[o.lane]; rz2 = old.wz2[o.lane]; }
+			else old.GetState(o.lane, directKernel, rz1, rz2);
+			if (e.wide) { wz1[e.lane] = rz1; wz2[e.lane] = rz2; }
+			else SetState(e.lane, directKernel, rz1, rz2);
+		}
+	}
+};
+
+// 内核处理[first, first + count)这些级, 左右段和中侧段分两次调用
+typedef void (*StageKernelFn)(StageSet& set, float* buf, int numSamples, int first, int count);
+
+// ---- 标量内核, buf为交错的两个声道 ----
+
+static void StageKernelScalarCascade(StageSet& set, float* buf, int numSamples, int first, int count)
+{
+	float* z1 = set.z1.data();
+	float* z2 = set.z2.data();
+	const float* c1 = set.c1.data();
+	const float* c2 = set.c2.data();
+	const float* d0 = set.d0.data();
+	const float* d1 = set.d1.data();
+	const float* d2 = set.d2.data();
+	for (int s = 0; s < numSamples; ++s)
+	{
+		float v[2] = { buf[s * 2], buf[s * 2 + 1] };
+		for (int i = first * 2; i < (first + count) * 2; ++i)
+		{
+			float& y = v[i & 1];
+			float x = y - z1[i] - z2[i];
+			y = d0[i] * x + d1[i] * z1[i] + d2[i] * z2[i];
+			z2[i] += c2[i] * z1[i];
+			z1[i] += c1[i] * x;
+		}
+		buf[s * 2] = v[0];
+		buf[s * 2 + 1] = v[1];
+	}
+}
+
+static inline void StageSVFBlock(StageSet& set, int k, float* buf, int numSamples)
+{
+	int i = k * 2;
+	float zl1 = set.z1[i], zl2 = set.z2[i], zr1 = set.z1[i + 1], zr2 = set.z2[i + 1];
+	float cl1 = set.c1[i], cl2 = set.c2[i], dl0 = set.d0[i], dl1 = set.d1[i], dl2 = set.d2[i];
+	float cr1 = set.c1[i + 1], cr2 = set.c2[i + 1], dr0 = set.d0[i + 1], dr1 = set.d1[i + 1], dr2 = set.d2[i + 1];
+	for (int s = 0; s < numSamples; ++s)
+	{
+		float xl = buf[s * 2] - zl1 - zl2;
+		float xr = buf[s * 2 + 1] - zr1 - zr2;
+		buf[s * 2] = dl0 * xl + dl1 * zl1 + dl2 * zl2;
+		buf[s * 2 + 1] = dr0 * xr + dr1 * zr1 + dr2 * zr2;
+		zl2 += cl2 * zl1;
+		zl1 += cl1 * xl;
+		zr2 += cr2 * zr1;
+		zr1 += cr1 * xr;
+	}
+	set.z1[i] = zl1; set.z2[i] = zl2; set.z1[i + 1] = zr1; set.z2[i + 1] = zr2;
+}
+
+static void StageKernelScalarBlock(StageSet& set, float* buf, int numSamples, int first, int count)
+{
+	for (int k = first; k < first + count; ++k)
+		StageSVFBlock(set, k, buf, numSamples);
+}
+
+// 逐级调用Biquad::Tick的TDF2, 低频的级仍走SVF
+static void StageKernelScalarDirect(StageSet& set, float* buf, int numSamples, int first, int count)
+{
+	for (int k = first; k < first + count; ++k)
+	{
+		if (set.precise[k])
+		{
+			StageSVFBlock(set, k, buf, numSamples);
+			continue;
+		}
+		int i = k * 2;
+		float sl1 = set.s1[i], sl2 = set.s2[i], sr1 = set.s1[i + 1], sr2 = set.s2[i + 1];
+		float bl0 = set.b0[i], bl1 = set.b1[i], bl2 = set.b2[i], al1 = set.a1[i], al2 = set.a2[i];
+		float br0 = set.b0[i + 1], br1 = set.b1[i + 1], br2 = set.b2[i + 1], ar1 = set.a1[i + 1], ar2 = set.a2[i + 1];
+		for (int s = 0; s < numSamples; ++s)
+		{
+			buf[s * 2] = Biquad::Tick(buf[s * 2], bl0, bl1, bl2, al1, al2, sl1, sl2);
+			buf[s * 2 + 1] = Biquad::Tick(buf[s * 2 + 1], br0, br1, br2, ar1, ar2, sr1, sr2);
+		}
+		set.s1[i] = sl1; set.s2[i] = sl2; set.s1[i + 1] = sr1; set.s2[i + 1] = sr2;
+	}
+}
+
+// 宽级: 状态和运算都用double, 输入输出可以是float或double
+template <typename T>
+static void StageKernelWide(StageSet& set, T* buf, int numSamples, int first, int count)
+{
+	for (int k = first; k < first + count; ++k)
+	{
+		int i = k * 2;
+		double zl1 = set.wz1[i], zl2 = set.wz2[i], zr1 = set.wz1[i + 1], zr2 = set.wz2[i + 1];
+		double cl1 = set.wc1[i], cl2 = set.wc2[i], dl0 = set.wd0[i], dl1 = set.wd1[i], dl2 = set.wd2[i];
+		double cr1 = set.wc1[i + 1], cr2 = set.wc2[i + 1], dr0 = set.wd0[i + 1], dr1 = set.wd1[i + 1], dr2 = set.wd2[i + 1];
+		for (int s = 0; s < numSamples; ++s)
+		{
+			double xl = buf[s * 2] - zl1 - zl2;
+			double xr = buf[s * 2 + 1] - zr1 - zr2;
+			buf[s * 2] = (T)(dl0 * xl + dl1 * zl1 + dl2 * zl2);
+			buf[s * 2 + 1] = (T)(dr0 * xr + dr1 * zr1 + dr2 * zr2);
+			zl2 += cl2 * zl1;
+			zl1 += cl1 * xl;
+			zr2 += cr2 * zr1;
+			zr1 += cr1 * xr;
+		}
+		set.wz1[i] = zl1; set.wz2[i] = zl2; set.wz1[i + 1] = zr1; set.wz2[i + 1] = zr2;
+	}
+}
+
+// 64位宿主: float段的级也在double里算, 状态每块读写一次float
+// 空着的lane(另一个声道的节点比这边多)直接跳过
+static void StageKernelPromoted(StageSet& set, double* buf, int numSamples, bool directKernel, int first, int count)
+{
+	for (int k = first; k < first + count; ++k)
+	{
+		for (int ch = 0; ch < 2; ++ch)
+		{
+			int i = k * 2 + ch;
+			if (set.keys[i] == StageSet::NoKey) continue;
+			if (directKernel && !set.precise[k])
+			{
+				double s1 = set.s1[i], s2 = set.s2[i];
+				double b0 = set.b0[i], b1 = set.b1[i], b2 = set.b2[i], a1 = set.a1[i], a2 = set.a2[i];
+				for (int s = 0; s < numSamples; ++s)
+				{
+					double x = buf[s * 2 + ch];
+					double y = b0 * x + s1;
+					s1 = b1 * x - a1 * y + s2;
+					s2 = b2 * x - a2 * y;
+					buf[s * 2 + ch] = y;
+				}
+				set.s1[i] = (float)s1; set.s2[i] = (float)s2;
+				continue;
+			}
+			double z1 = set.z1[i], z2 = set.z2[i];
+			double c1 = set.c1[i], c2 = set.c2[i], d0 = set.d0[i], d1 = set.d1[i], d2 = set.d2[i];
+			for (int s = 0; s < numSamples; ++s)
+			{
+				double x = buf[s * 2 + ch] - z1 - z2;
+				buf[s * 2 + ch] = d0 * x + d1 * z1 + d2 * z2;
+				z2 += c2 * z1;
+				z1 += c1 * x;
+			}
+			set.z1[i] = (float)z1; set.z2[i] = (float)z2;
+		}
+	}
+}
+
+// 中侧段前后的矩阵, 每块各一次: M = (L + R) / 2, S = (L - R) / 2, 回去是L = M + S, R = M - S
+template <typename T>
+static void StageToMidSide(T* buf, int numSamples)
+{
+	for (int s = 0; s < numSamples; ++s)
+	{
+		T l = buf[s * 2], r = buf[s * 2 + 1];
+		buf[s * 2] = (l + r) * (T)0.5;
+		buf[s * 2 + 1] = (l - r) * (T)0.5;
+	}
+}
+
+template <typename T>
+static void StageFromMidSide(T* buf, int numSamples)
+{
+	for (int s = 0; s < numSamples; ++s)
+	{
+		T m = buf[s * 2], d = buf[s * 2 + 1];
+		buf[s * 2] = m + d;
+		buf[s * 2 + 1] = m - d;
+	}
+}
+
+// ---- SIMD波前内核 ----
+// 一组W级: 第t步lane k处理样本t-k, 输入是上一步lane k-1的输出, lane 0读入新样本
+// 开头和结尾各W-1步有的lane没有有效样本, 用掩码保持它们的状态不动
+
+#if LMEQ_X86
+LMEQ_TARGET("sse4.1")
+static void StageKernelSSE(StageSet& set, float* buf, int numSamples, int first, int count)
+{
+	const int W = 2;
+	const __m128 stageIdx = _mm_setr_ps(0, 0, 1, 1);
+	int groups = (count + W - 1) / W;
+	for (int g = 0; g < groups; ++g)
+	{
+		int o = (first + g * W) * 2;
+		__m128 c1 = _mm_loadu_ps(&set.c1[o]), c2 = _mm_loadu_ps(&set.c2[o]);
+		__m128 d0 = _mm_loadu_ps(&set.d0[o]), d1 = _mm_loadu_ps(&set.d1[o]), d2 = _mm_loadu_ps(&set.d2[o]);
+		__m128 z1 = _mm_loadu_ps(&set.z1[o]), z2 = _mm_loadu_ps(&set.z2[o]);
+		__m128 y = _mm_setzero_ps();
+		for (int t = 0; t < numSamples + W - 1; ++t)
+		{
+			__m128 in = t < numSamples ? _mm_castpd_ps(_mm_load_sd((const double*)(buf + t * 2))) : _mm_setzero_ps();
+			__m128 x = _mm_sub_ps(_mm_sub_ps(_mm_movelh_ps(in, y), z1), z2);
+			y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0, x), _mm_mul_ps(d1, z1)), _mm_mul_ps(d2, z2));
+			__m128 nz2 = _mm_add_ps(z2, _mm_mul_ps(c2, z1));
+			__m128 nz1 = _mm_add_ps(z1, _mm_mul_ps(c1, x));
+			if (t >= W - 1 && t < numSamples)
+			{
+				z1 = nz1;
+				z2 = nz2;
+			}
+			else
+			{
+				__m128 m = _mm_and_ps(_mm_cmple_ps(stageIdx, _mm_set1_ps((float)t)),
+					_mm_cmpgt_ps(stageIdx, _mm_set1_ps((float)(t - numSamples))));
+				z1 = _mm_blendv_ps(z1, nz1, m);
+				z2 = _mm_blendv_ps(z2, nz2, m);
+			}
+			if (t >= W - 1) _mm_storeh_pi((__m64*)(buf + (t - W + 1) * 2), y);
+		}
+		_mm_storeu_ps(&set.z1[o], z1);
+		_mm_storeu_ps(&set.z2[o], z2);
+	}
+}
+
+LMEQ_TARGET("avx2,fma")
+static void StageKernelAVX2(StageSet& set, float* buf, int numSamples, int first, int count)
+{
+	const int W = 4;
+	const __m256 stageIdx = _mm256_setr_ps(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i shift = _mm256_setr_epi32(0, 1, 0, 1, 2, 3, 4, 5);
+	int groups = (count + W - 1) / W;
+	for (int g = 0; g < groups; ++g)
+	{
+		int o = (first + g * W) * 2;
+		__m256 c1 = _mm256_loadu_ps(&set.c1[o]), c2 = _mm256_loadu_ps(&set.c2[o]);
+		__m256 d0 = _mm256_loadu_ps(&set.d0[o]), d1 = _mm256_loadu_ps(&set.d1[o]), d2 = _mm256_loadu_ps(&set.d2[o]);
+		__m256 z1 = _mm256_loadu_ps(&set.z1[o]), z2 = _mm256_loadu_ps(&set.z2[o]);
+		__m256 y = _mm256_setzero_ps();
+		for (int t = 0; t < numSamples + W - 1; ++t)
+		{
+			__m256 in = t < numSamples ? _mm256_castpd_ps(_mm256_broadcast_sd((const double*)(buf + t * 2))) : _mm256_setzero_ps();
+			__m256 x = _mm256_blend_ps(_mm256_permutevar8x32_ps(y, shift), in, 0x03);
+			x = _mm256_sub_ps(_mm256_sub_ps(x, z1), z2);
+			y = _mm256_fmadd_ps(d0, x, _mm256_fmadd_ps(d1, z1, _mm256_mul_ps(d2, z2)));
+			__m256 nz2 = _mm256_fmadd_ps(c2, z1, z2);
+			__m256 nz1 = _mm256_fmadd_ps(c1, x, z1);
+			if (t >= W - 1 && t < numSamples)
+			{
+				z1 = nz1;
+				z2 = nz2;
+			}
+			else
+			{
+				__m256 m = _mm256_and_ps(_mm256_cmp_ps(stageIdx, _mm256_set1_ps((float)t), _CMP_LE_OQ),
+					_mm256_cmp_ps(stageIdx, _mm256_set1_ps((float)(t - numSamples)), _CMP_GT_OQ));
+				z1 = _mm256_blendv_ps(z1, nz1, m);
+				z2 = _mm256_blendv_ps(z2, nz2, m);
+			}
+			if (t >= W - 1) _mm_storeh_pi((__m64*)(buf + (t - W + 1) * 2), _mm256_extractf128_ps(y, 1));
+		}
+		_mm256_storeu_ps(&set.z1[o], z1);
+		_mm256_storeu_ps(&set.z2[o], z2);
+	}
+}
+
+LMEQ_TARGET("avx512f")
+static void StageKernelAVX512(StageSet& set, float* buf, int numSamples, int first, int count)
+{
+	const int W = 8;
+	const __m512 stageIdx = _mm512_setr_ps(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+	const __m512i shift = _mm512_setr_epi32(0, 1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13);
+	int groups = (count + W - 1) / W;
+	for (int g = 0; g < groups; ++g)
+	{
+		int o = (first + g * W) * 2;
+		__m512 c1 = _mm512_loadu_ps(&set.c1[o]), c2 = _mm512_loadu_ps(&set.c2[o]);
+		__m512 d0 = _mm512_loadu_ps(&set.d0[o]), d1 = _mm512_loadu_ps(&set.d1[o]), d2 = _mm512_loadu_ps(&set.d2[o]);
+		__m512 z1 = _mm512_loadu_ps(&set.z1[o]), z2 = _mm512_loadu_ps(&set.z2[o]);
+		__m512 y = _mm512_setzero_ps();
+		for (int t = 0; t < numSamples + W - 1; ++t)
+		{
+			double pair = 0.0;
+			if (t < numSamples) memcpy(&pair, buf + t * 2, sizeof(pair));
+			__m512 x = _mm512_mask_blend_ps(0x0003, _mm512_permutexvar_ps(shift, y), _mm512_castpd_ps(_mm512_set1_pd(pair)));
+			x = _mm512_sub_ps(_mm512_sub_ps(x, z1), z2);
+			y = _mm512_fmadd_ps(d0, x, _mm512_fmadd_ps(d1, z1, _mm512_mul_ps(d2, z2)));
+			__m512 nz2 = _mm512_fmadd_ps(c2, z1, z2);
+			__m512 nz1 = _mm512_fmadd_ps(c1, x, z1);
+			if (t >= W - 1 && t < numSamples)
+			{
+				z1 = nz1;
+				z2 = nz2;
+			}
+			else
+			{
+				__mmask16 m = _mm512_cmp_ps_mask(stageIdx, _mm512_set1_ps((float)t), _CMP_LE_OQ) &
+					_mm512_cmp_ps_mask(stageIdx, _mm512_set1_ps((float)(t - numSamples)), _CMP_GT_OQ);
+				z1 = _mm512_mask_blend_ps(m, z1, nz1);
+				z2 = _mm512_mask_blend_ps(m, z2, nz2);
+			}
+			if (t >= W - 1) _mm_storeh_pi((__m64*)(buf + (t - W + 1) * 2), _mm512_extractf32x4_ps(y, 3));
+		}
+		_mm512_storeu_ps(&set.z1[o], z1);
+		_mm512_storeu_ps(&set.z2[o], z2);
+	}
+}
+#endif
+
+// 级联滤波器组: 系数从消息线程发布, 内核在prepareToPlay时实测选出
+class StageBank
+{
+private:
+	LatestMailbox<StageSet> sets;
+	StageSet* current = nullptr;//音频线程持有
+	int kernel = KERNEL_SCALAR_BLOCK;
+	float kernelCost[NumStageKernels] = {};//实测, 每样本每级纳秒, 0为未测
+	std::vector<float> work;//交错的L/R
+	std::vector<double> workD;
+	int maxBlock = 0;
+	std::atomic<int> numWide{ 0 };//最近一次发布的宽级数, 给界面看
+
+	template <typename T, typename Fn>
+	void ProcessInterleaved(std::vector<T>& buf, const T* inL, const T* inR, T* outL, T* outR, int numSamples, Fn&& fn)
+	{
+		Adopt();
+		if (current == nullptr || current->numStages + current->numWide == 0 || buf.empty())
+		{
+			if (outL != inL) memcpy(outL, inL, numSamples * sizeof(T));
+			if (outR != inR) memcpy(outR, inR, numSamples * sizeof(T));
+			return;
+		}
+
+		for (int offset = 0; offset < numSamples; offset += maxBlock)
+		{
+			int n = std::min(numSamples - offset, maxBlock);
+			for (int s = 0; s < n; ++s)
+			{
+				buf[s * 2] = inL[offset + s];
+				buf[s * 2 + 1] = inR[offset + s];
+			}
+			fn(buf.data(), n);
+			for (int s = 0; s < n; ++s)
+			{
+				outL[offset + s] = buf[s * 2];
+				outR[offset + s] = buf[s * 2 + 1];
+			}
+		}
+	}
+
+	static StageKernelFn GetKernelFn(int k)
+	{
+		switch (k)
+		{
+		case KERNEL_SCALAR_CASCADE: return StageKernelScalarCascade;
+		case KERNEL_SCALAR_BLOCK: return StageKernelScalarBlock;
+		case KERNEL_SCALAR_DIRECT: return StageKernelScalarDirect;
+#if LMEQ_X86
+		case KERNEL_SSE: return StageKernelSSE;
+		case KERNEL_AVX2: return StageKernelAVX2;
+		case KERNEL_AVX512: return StageKernelAVX512;
+#endif
+		default: return nullptr;
+		}
+	}
+
+	void Adopt()
+	{
+		StageSet* next = sets.Take();
+		if (next == nullptr) return;
+		if (current != nullptr) next->CopyStateFrom(*current, kernel == KERNEL_SCALAR_DIRECT);
+		sets.Retire(current);
+		current = next;
+	}
+
+	// 当前布局(太少时用16级的替身)和块长下逐个内核计时, 取最快的
+	void Tune()
+	{
+		StageSet bench;
+		if (current != nullptr && current->numStages >= 4)
+		{
+			bench = *current;
+		}
+		else
+		{
+			BiquadCoeffs c(0.98f, -1.8f, 0.83f, -1.8f, 0.81f);
+			c.numStages = 15;
+			for (int i = 0; i < c.numStages; ++i)
+			{
+				c.b0s[i] = c.b0; c.b1s[i] = c.b1; c.b2s[i] = c.b2; c.a1s[i] = c.a1; c.a2s[i] = c.a2;
+			}
+			bench.Build({ c }, { 0 });
+		}
+
+		std::vector<float> src(maxBlock * 2), buf(maxBlock * 2);
+		unsigned int seed = 1;
+		for (auto& v : src)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			v = (float)(seed >> 8) / 16777216.0f - 0.5f;
+		}
+		int reps = std::max(1, 4096 / maxBlock);
+
+		float best = 0.0f;
+		for (int k = 0; k < NumStageKernels; ++k)
+		{
+			kernelCost[k] = 0.0f;
+			if (!IsKernelSupported(k)) continue;
+			StageKernelFn fn = GetKernelFn(k);
+			bench.ClearState();
+			double fastest = 1e30;
+			for (int trial = 0; trial < 5; ++trial)
+			{
+				juce::int64 t0 = juce::Time::getHighResolutionTicks();
+				for (int r = 0; r < reps; ++r)
+				{
+					memcpy(buf.data(), src.data(), src.size() * sizeof(float));
+					fn(bench, buf.data(), maxBlock, 0, bench.numLR);
+					fn(bench, buf.data(), maxBlock, bench.msFirst, bench.numMS);
+				}
+				double sec = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - t0);
+				fastest = std::min(fastest, sec);
+			}
+			kernelCost[k] = (float)(fastest * 1e9 / ((double)reps * maxBlock * bench.numStages));
+			if (best == 0.0f || kernelCost[k] < best)
+			{
+				best = kernelCost[k];
+				kernel = k;
+			}
+		}
+	}
+
+public:
+	~StageBank() { delete current; }
+
+	static bool IsKernelSupported(int k)
+	{
+		switch (k)
+		{
+		case KERNEL_SCALAR_CASCADE:
+		case KERNEL_SCALAR_BLOCK:
+		case KERNEL_SCALAR_DIRECT:
+			return true;
+#if LMEQ_X86
+		case KERNEL_SSE: return juce::SystemStats::hasSSE41();
+		case KERNEL_AVX2: return juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3();
+		case KERNEL_AVX512: return juce::SystemStats::hasAVX512F();
+#endif
+		default: return false;
+		}
+	}
+
+	static const char* GetKernelName(int k)
+	{
+		static const char* names[] = {
+			"Scalar Cascade", "Scalar Block", "Scalar Direct Form",
+			"SSE4.1 Wavefront", "AVX2 Wavefront", "AVX-512 Wavefront"
+		};
+		if (k >= 0 && k < NumStageKernels) return names[k];
+		return "Unknown";
+	}
+
+	// 消息线程: 按节点id升序给出所有活动节点的系数和声道路由(为空时全部立体声)
+	void SetStages(const std::vector<BiquadCoeffs>& coeffs, const std::vector<int>& ids, const std::vector<int>& routes = {})
+	{
+		StageSet* set = new StageSet();
+		set->Build(coeffs, ids, routes);
+		numWide = set->numWide;
+		sets.Publish(set);
+	}
+
+	// prepareToPlay调用, 音频线程未运行
+	void Prepare(int maxBlockSize)
+	{
+		maxBlock = std::max(1, maxBlockSize);
+		work.assign(maxBlock * 2, 0.0f);
+		workD.assign(maxBlock * 2, 0.0);
+		Adopt();
+		Tune();
+		if (current != nullptr) current->ClearState();
+	}
+
+	// 音频线程: 子块边界上原地换一个节点的系数, 不分配
+	// 级数或级所在的段变了就返回false, 交给消息线程重新发布
+	bool UpdateNode(int id, const BiquadCoeffs& c)
+	{
+		Adopt();
+		if (current == nullptr) return false;
+		return current->UpdateNode(id, c, kernel == KERNEL_SCALAR_DIRECT);
+	}
+
+	// 音频线程: 快速增益路径, 单级节点直接给SVF系数
+	bool UpdateNodeSVF(int id, float d0, float d1, float d2, float c1, float c2)
+	{
+		Adopt();
+		if (current == nullptr) return false;
+		return current->UpdateNodeSVF(id, d0, d1, d2, c1, c2, kernel == KERNEL_SCALAR_DIRECT);
+	}
+
+	// 音频线程: 当前的级联里有没有这个节点
+	bool HasNode(int id)
+	{
+		Adopt();
+		if (current == nullptr) return false;
+		int lo, hi;
+		current->FindNode(id, lo, hi);
+		return hi > lo;
+	}
+
+	int GetKernel() const { return kernel; }
+	float GetKernelCost(int k) const { return kernelCost[k]; }
+	int GetNumWideStages() const { return numWide; }
+
+	// 音频线程
+	void Reset()
+	{
+		if (current != nullptr) current->ClearState();
+	}
+
+	void Process(const float* inL, const float* inR, float* outL, float* outR, int numSamples)
+	{
+		ProcessInterleaved(work, inL, inR, outL, outR, numSamples, [this](float* buf, int n)
+			{
+				StageSet& s = *current;
+				StageKernelFn fn = GetKernelFn(kernel);
+				fn(s, buf, n, 0, s.numLR);
+				StageKernelWide(s, buf, n, 0, s.wideLR);
+				if (!s.HasMidSide()) return;
+				StageToMidSide(buf, n);
+				fn(s, buf, n, s.msFirst, s.numMS);
+				StageKernelWide(s, buf, n, s.wideLR, s.numWide - s.wideLR);
+				StageFromMidSide(buf, n);
+			});
+	}
+
+	void Process(const double* inL, const double* inR, double* outL, double* outR, int numSamples)
+	{
+		ProcessInterleaved(workD, inL, inR, outL, outR, numSamples, [this](double* buf, int n)
+			{
+				StageSet& s = *current;
+				bool direct = kernel == KERNEL_SCALAR_DIRECT;
+				StageKernelPromoted(s, buf, n, direct, 0, s.numLR);
+				StageKernelWide(s, buf, n, 0, s.wideLR);
+				if (!s.HasMidSide()) return;
+				StageToMidSide(buf, n);
+				StageKernelPromoted(s, buf, n, direct, s.msFirst, s.numMS);
+				StageKernelWide(s, buf, n, s.wideLR, s.numWide - s.wideLR);
+				StageFromMidSide(buf, n);
+			});
+	}
+};
@@ -68,6 +68,17 @@ struct SVFCoeffs
 	}
 };
 
+// 单级biquad系数换算成SVF系数
+static inline void BiquadToSVF(float b0, float b1, float b2, float a1, float a2,
+	float& d0, float& d1, float& d2, float& c1, float& c2)
+{
+	c1 = a1 + 2.0f;
+	c2 = (1.0f + a1 + a2) / c1;
+	d0 = b0;
+	d1 = (2.0f * b0 + b1) / c1;
+	d2 = (b0 + b1 + b2) / (c1 * c2);
+}
+
 class SVF
 {
 private:
@@ -81,32 +92,21 @@ public:
 		memset(z2s, 0, sizeof(z2s));
 	}
 	void SetCoeffs(const SVFCoeffs& c) { coeffs = c; }
+	void Reset()
+	{
+		z1 = z2 = 0.0f;
+		memset(z1s, 0, sizeof(z1s));
+		memset(z2s, 0, sizeof(z2s));
+	}
 
 	void SetBiquadCoeffs(const BiquadCoeffs& bq)
 	{
-		coeffs.c1 = bq.a1 + 2.0f;
-		//if (coeffs.c1 == 0.0f) return;
-		coeffs.c2 = (1.0f + bq.a1 + bq.a2) / coeffs.c1;
-		coeffs.d0 = bq.b0;
-		coeffs.d1 = (2.0f * bq.b0 + bq.b1) / coeffs.c1;
-		float c1c2 = coeffs.c1 * coeffs.c2;
-		//if (c1c2 == 0.0f) return;
-		coeffs.d2 = (bq.b0 + bq.b1 + bq.b2) / c1c2;
+		BiquadToSVF(bq.b0, bq.b1, bq.b2, bq.a1, bq.a2,
+			coeffs.d0, coeffs.d1, coeffs.d2, coeffs.c1, coeffs.c2);
 		for (int i = 0; i < bq.numStages; ++i)
 		{
-			float c1 = bq.a1s[i] + 2.0f;
-			//if (c1 == 0.0f) continue;
-			float c2 = (1.0f + bq.a1s[i] + bq.a2s[i]) / c1;
-			float d0 = bq.b0s[i];
-			float d1 = (2.0f * bq.b0s[i] + bq.b1s[i]) / c1;
-			float c1c2 = c1 * c2;
-			//if (c1c2 == 0.0f) continue;
-			float d2 = (bq.b0s[i] + bq.b1s[i] + bq.b2s[i]) / c1c2;
-			coeffs.c1s[i] = c1;
-			coeffs.c2s[i] = c2;
-			coeffs.d0s[i] = d0;
-			coeffs.d1s[i] = d1;
-			coeffs.d2s[i] = d2;
+			BiquadToSVF(bq.b0s[i], bq.b1s[i], bq.b2s[i], bq.a1s[i], bq.a2s[i],
+				coeffs.d0s[i], coeffs.d1s[i], coeffs.d2s[i], coeffs.c1s[i], coeffs.c2s[i]);
 		}
 		coeffs.numStages = bq.numStages;
 	}
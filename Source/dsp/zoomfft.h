@@ -0,0 +1,257 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include "analysispool.h"
+#include "halfband.h"
+
+// 选中节点附近的放大分析(zoom FFT): 复数混频把中心频率移到0Hz, 半带级联抽取2^stages倍, 再做一个小的复数FFT
+// 抽取6级时48k下约0.7Hz一个bin, 代价只是每个样本一次复数乘法加几级半带滤波
+// 音频线程混频、抽取并把帧放进队列, FFT在共享的AnalysisPool里做; 只在界面选中了节点时运行
+class ZoomAnalyzer : public AnalysisClient
+{
+public:
+	static constexpr int FFTSize = 1024;
+	static constexpr int HopSize = FFTSize / 4;
+	static constexpr int MaxStages = 6;
+	static constexpr int QueueFrames = 4;
+	static constexpr int ChunkSize = 256;//ProcessBlock按这个长度分段混频和抽取
+	static constexpr float UsableBand = 0.4f;//半带通带内的部分, 占抽取后采样率的比例(单边)
+
+	ZoomAnalyzer()
+	{
+		for (int i = 0; i < FFTSize; ++i)
+			window[i] = 0.5f * (1.0f - std::cos(2.0f * juce::MathConstants<float>::pi * i / (FFTSize - 1)));
+	}
+
+	~ZoomAnalyzer() override
+	{
+		if (allocated.load())
+			pool->Unregister(this);
+	}
+
+	// prepareToPlay调用
+	void SetSampleRate(double sr)
+	{
+		sampleRate.store((float)sr);
+	}
+
+	// 消息线程: 设置中心频率和想看的宽度(Hz), 宽度决定抽取级数
+	void SetTarget(float centre, float spanHz)
+	{
+		float sr = sampleRate.load();
+		int stages = 0;
+		while (stages < MaxStages && 2.0f * UsableBand * sr / (float)(1 << (stages + 1)) >= spanHz)
+			++stages;
+		targetCentre.store(juce::jlimit(0.0f, sr * 0.5f, centre));
+		targetStages.store(stages);
+	}
+
+	// 消息线程: 界面选中节点时打开, 取消选中或关闭时关掉
+	void SetActive(bool shouldRun)
+	{
+		if (shouldRun && !allocated.load())
+		{
+			queueRe.assign(QueueFrames * FFTSize, 0.0f);
+			queueIm.assign(QueueFrames * FFTSize, 0.0f);
+			spectrum.assign(FFTSize, -100.0f);
+			allocated.store(true, std::memory_order_release);
+			pool->Register(this);
+		}
+		active.store(shouldRun);
+	}
+
+	bool IsActive() const { return active.load(); }
+
+	template <typename T>
+	void ProcessBlock(const T* inL, const T* inR, int numSamples)
+	{
+		if (!active.load(std::memory_order_relaxed) || !allocated.load(std::memory_order_acquire))
+		{
+			curCentre = -1.0f;//重新打开时强制重置抽取器
+			return;
+		}
+
+		float centre = targetCentre.load(std::memory_order_relaxed);
+		int wantStages = targetStages.load(std::memory_order_relaxed);
+		float sr = sampleRate.load(std::memory_order_relaxed);
+		if (curCentre < 0.0f || wantStages != stages || sr != curRate)
+			Reconfigure(centre, wantStages, sr);
+		else if (centre != curCentre)
+			Retune(centre);
+
+		for (int start = 0; start < numSamples; start += ChunkSize)
+		{
+			int n = std::min(ChunkSize, numSamples - start);
+			for (int i = 0; i < n; ++i)
+			{
+				float x = (float)(inL[start + i] + inR[start + i]) * 0.5f;
+				chunkRe[i] = x * oscRe;
+				chunkIm[i] = x * oscIm;
+				float r = oscRe * stepRe - oscIm * stepIm;
+				oscIm = oscRe * stepIm + oscIm * stepRe;
+				oscRe = r;
+			}
+
+			// 实部虚部的抽取器同相位推进, 一段样本逐级原地抽取
+			for (int s = 0; s < stages; ++s)
+			{
+				int count = decRe[s].Process(chunkRe, n, chunkRe);
+				decIm[s].Process(chunkIm, n, chunkIm);
+				n = count;
+			}
+			for (int i = 0; i < n; ++i)
+				PushBaseband(chunkRe[i], chunkIm[i]);
+		}
+
+		// 每块把振荡器的幅度拉回1, 避免递推误差累积
+		float mag = std::sqrt(oscRe * oscRe + oscIm * oscIm);
+		oscRe /= mag;
+		oscIm /= mag;
+	}
+
+	// 消息线程: 取最新的放大频谱, 下标0对应centre - binHz * FFTSize / 2
+	bool GetSpectrum(std::vector<float>& dB, float& centre, float& binHz) const
+	{
+		juce::ScopedLock lock(spectrumLock);
+		if (spectrumBinHz <= 0.0f) return false;
+		dB = spectrum;
+		centre = spectrumCentre;
+		binHz = spectrumBinHz;
+		return true;
+	}
+
+	// AnalysisClient, 由共享分析线程调用
+	int GetFFTSize() const override { return FFTSize; }
+	int GetPriority() const override { return 2; }
+
+	int GetNumPending() const override
+	{
+		return (int)(queueWrite.load(std::memory_order_acquire) - queueRead.load(std::memory_order_relaxed));
+	}
+
+	void FillFrame(int k, float* re, float* im) override
+	{
+		int slot = (int)((queueRead.load(std::memory_order_relaxed) + k) % QueueFrames);
+		const float* fr = &queueRe[slot * FFTSize];
+		const float* fi = &queueIm[slot * FFTSize];
+		for (int i = 0; i < FFTSize; ++i)
+		{
+			re[i] = fr[i] * window[i];
+			im[i] = fi[i] * window[i];
+		}
+	}
+
+	void ConsumeFrames(int count, float* const* re, float* const* im) override
+	{
+		unsigned int read = queueRead.load(std::memory_order_relaxed);
+		// 只有最后一帧要显示
+		int k = count - 1;
+		int slot = (int)((read + k) % QueueFrames);
+		{
+			juce::ScopedLock lock(spectrumLock);
+			for (int i = 0; i < FFTSize; ++i)
+			{
+				// fft_f32正变换用的是e^(+j), 复数输入的频率轴是反的: 第k个bin是-k
+				int bin = (FFTSize / 2 - i + FFTSize) % FFTSize;
+				float magnitude = std::sqrt(re[k][bin] * re[k][bin] + im[k][bin] * im[k][bin]) / (FFTSize * 0.5f);
+				spectrum[i] = 20.0f * std::log10(std::max(magnitude, 1e-5f));
+			}
+			spectrumCentre = queueCentre[slot];
+			spectrumBinHz = queueBinHz[slot];
+		}
+		queueRead.store(read + count, std::memory_order_release);
+	}
+
+private:
+	void Reconfigure(float centre, int newStages, float sr)
+	{
+		curRate = sr;
+		stages = newStages;
+		for (int s = 0; s < MaxStages; ++s)
+		{
+			decRe[s].Reset();
+			decIm[s].Reset();
+		}
+		oscRe = 1.0f;
+		oscIm = 0.0f;
+		Retune(centre);
+		filled = 0;
+		sinceHop = 0;
+	}
+
+	// 拖动节点时只改混频频率, 不清空抽取器和缓冲区, 频谱跟着平滑移动
+	void Retune(float centre)
+	{
+		curCentre = centre;
+		double w = -2.0 * 3.14159265358979323846 * centre / curRate;
+		stepRe = (float)std::cos(w);
+		stepIm = (float)std::sin(w);
+	}
+
+	void PushBaseband(float re, float im)
+	{
+		ringRe[writePos] = re;
+		ringIm[writePos] = im;
+		writePos = (writePos + 1) % FFTSize;
+		filled = std::min(filled + 1, FFTSize);
+		if (++sinceHop < HopSize || filled < FFTSize) return;
+		sinceHop = 0;
+
+		// 队列满了就丢掉这一帧
+		unsigned int write = queueWrite.load(std::memory_order_relaxed);
+		if (write - queueRead.load(std::memory_order_acquire) >= (unsigned int)QueueFrames) return;
+		int slot = (int)(write % QueueFrames);
+		float* fr = &queueRe[slot * FFTSize];
+		float* fi = &queueIm[slot * FFTSize];
+		for (int i = 0; i < FFTSize; ++i)
+		{
+			int idx = (writePos + i) % FFTSize;
+			fr[i] = ringRe[idx];
+			fi[i] = ringIm[idx];
+		}
+		queueCentre[slot] = curCentre;
+		queueBinHz[slot] = curRate / (float)(1 << stages) / FFTSize;
+		queueWrite.store(write + 1, std::memory_order_release);
+	}
+
+	float window[FFTSize];
+
+	// 消息线程 -> 音频线程
+	std::atomic<float> sampleRate{ 48000.0f };
+	std::atomic<float> targetCentre{ 1000.0f };
+	std::atomic<int> targetStages{ MaxStages };
+	std::atomic<bool> active{ false };
+	std::atomic<bool> allocated{ false };
+
+	// 音频线程
+	float curCentre = -1.0f;
+	float curRate = 0.0f;
+	int stages = 0;
+	float oscRe = 1.0f, oscIm = 0.0f;
+	float stepRe = 1.0f, stepIm = 0.0f;
+	HalfbandDecimator decRe[MaxStages], decIm[MaxStages];
+	float chunkRe[ChunkSize], chunkIm[ChunkSize];
+	float ringRe[FFTSize] = {}, ringIm[FFTSize] = {};
+	int writePos = 0;
+	int filled = 0;
+	int sinceHop = 0;
+
+	// 音频线程 -> 分析线程
+	std::vector<float> queueRe, queueIm;
+	float queueCentre[QueueFrames] = {};
+	float queueBinHz[QueueFrames] = {};
+	std::atomic<unsigned int> queueWrite{ 0 };
+	std::atomic<unsigned int> queueRead{ 0 };
+
+	// 分析线程 -> 界面
+	std::vector<float> spectrum;
+	float spectrumCentre = 0.0f;
+	float spectrumBinHz = 0.0f;
+	mutable juce::CriticalSection spectrumLock;
+
+	juce::SharedResourcePointer<AnalysisPool> pool;
+};
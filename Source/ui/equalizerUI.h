@@ -7,10 +7,12 @@
 #include <JuceHeader.h>
 #include <math.h>
 #include "../dsp/equalizer.h"
+#include "../dsp/zoomfft.h"
+#include "../dsp/bandmeter.h"
 class EqualizerUI : public juce::Component
 {
 public:
-	// 
+	// 常量定义
 	static constexpr float MIN_FREQ = 10.01f;
 	static constexpr float MAX_FREQ = 24000.0f;
 	static constexpr float MIN_DB = -30.0f;
@@ -28,12 +30,26 @@ public:
 	static constexpr float Q_WHEEL_SENSITIVITY = 0.1f;
 	static constexpr float MIN_Q = 0.1f;
 	static constexpr float MAX_Q = 40.0f;
-	// 캯
+	static constexpr juce::uint32 ZOOM_COLOR = 0xccffaa00;
+	static constexpr float ZOOM_MIN_DB = -100.0f;	// 放大频谱单独用一套纵轴
+	static constexpr float ZOOM_MAX_DB = 0.0f;
+	static constexpr float ZOOM_SPAN_BANDWIDTHS = 4.0f;	// 放大范围是节点带宽(cutoff / q)的几倍
+	static constexpr float ZOOM_MIN_SPAN = 20.0f;
+	static constexpr float METER_MIN_DB = -60.0f;
+	static constexpr float METER_HEIGHT = 24.0f;
+	static constexpr float METER_WIDTH = 3.0f;
+	static constexpr float METER_DECAY_DB = 1.5f;	// 每帧回落多少dB
+	static constexpr juce::uint32 METER_PRE_COLOR = 0xff808080;
+	static constexpr juce::uint32 DYNAMIC_COLOR = 0xffffaa00;
+	static constexpr juce::uint32 MOD_COLOR = 0xff00ccff;
+	static constexpr juce::uint32 KEY_COLOR = 0xffcc66ff;
+	static constexpr juce::uint32 CROSSOVER_COLOR = 0xffff6666;
+	// 构造函数
 	EqualizerUI(Equalizer& eq) : equalizer(eq), selectedNodeId(-1), isDragging(false),
 		isEditingLabel(false), editingNodeId(-1), editingLabelType(LABEL_NONE)
 	{
 
-		// ʼı༭
+		// 初始化文本编辑器
 		addChildComponent(labelEditor);
 		labelEditor.setJustification(juce::Justification::centred);
 		labelEditor.setBorder(juce::BorderSize<int>(2));
@@ -46,31 +62,52 @@ public:
 		labelEditor.onFocusLost = [this]() { finishLabelEditing(true); };
 
 	}
-	// дpaint
+	~EqualizerUI() override
+	{
+		if (zoom != nullptr)
+			zoom->SetActive(false);
+		if (meters != nullptr)
+			meters->SetActive(false);
+	}
+	// 选中节点时在它附近做放大分析
+	void setZoomAnalyzer(ZoomAnalyzer* analyzer)
+	{
+		zoom = analyzer;
+	}
+	// 每个节点旁边显示EQ前后的频带电平
+	void setBandMeters(BandMeterBank* bank)
+	{
+		meters = bank;
+	}
+	// 重写paint方法
 	void paint(juce::Graphics& g) override
 	{
 		auto bounds = getLocalBounds();
-		// ڲ򣨼ȥ߿
+		// 计算内部绘制区域（减去边框）
 		auto innerBounds = bounds.toFloat().reduced(BORDER_WIDTH);
-		// ͱǩ
+		// 绘制网格和标签
 		drawGrid(g, innerBounds);
-		// ѡнڵƵӦȻƣᱻӦڵ
+		// 绘制选中节点的频率响应（先绘制，会被整体响应遮挡）
+		updateZoom();
+		updateMeters();
 		if (selectedNodeId >= 0 && equalizer.IsNodeActive(selectedNodeId))
 		{
+			drawZoomSpectrum(g, innerBounds);
 			drawSelectedNodeResponse(g, innerBounds);
 		}
-		// ƵӦ
+		// 绘制频率响应
 		drawFrequencyResponse(g, innerBounds);
-		// ƽڵ
+		drawCrossover(g, innerBounds);
+		// 绘制节点
 		drawNodes(g, innerBounds);
-		// Ʊ߿
+		// 绘制边框
 		g.setColour(juce::Colour(BORDER_COLOR));
 		g.drawRect(bounds.toFloat(), BORDER_WIDTH);
 	}
-	// ¼
+	// 鼠标事件处理
 	void mouseDown(const juce::MouseEvent& event) override
 	{
-		// ڱ༭ǩط༭
+		// 如果正在编辑标签，点击其他地方结束编辑
 		if (isEditingLabel && !labelEditor.getBounds().contains(event.getPosition().toInt()))
 		{
 			finishLabelEditing(true);
@@ -83,7 +120,7 @@ public:
 		}
 		auto bounds = getLocalBounds().toFloat().reduced(BORDER_WIDTH);
 
-		// Ƿ˱ǩ
+		// 检查是否点击了标签
 		int labelNodeId;
 		LabelType labelType;
 		if (getLabelAtPosition(event.position, bounds, labelNodeId, labelType))
@@ -126,13 +163,13 @@ public:
 		int nodeId = getNodeAtPosition(event.position, bounds);
 		if (nodeId >= 0)
 		{
-			// ˫ڵ㣬Ϊ0dB
+			// 双击节点，重置增益为0dB
 			equalizer.ResetNodeGain(nodeId);
 			repaint();
 		}
 		else
 		{
-			// ˫հ½ڵ
+			// 双击空白区域，添加新节点
 			auto freq = positionToFrequency(event.position.x, bounds);
 			auto gain = positionToGain(event.position.y, bounds);
 			int newNodeId = equalizer.AddNode(MODE_PEAKING, freq, 1.0f, gain);
@@ -158,19 +195,19 @@ public:
 			}
 		}
 	}
-	// ѡеĽڵ
+	// 设置选中的节点
 	void setSelectedNode(int nodeId)
 	{
 		selectedNodeId = nodeId;
 		repaint();
 	}
-	// ȡѡеĽڵID
+	// 获取选中的节点ID
 	int getSelectedNode() const
 	{
 		return selectedNodeId;
 	}
 private:
-	// ǩö
+	// 标签类型枚举
 	enum LabelType
 	{
 		LABEL_NONE,
@@ -178,16 +215,22 @@ private:
 		LABEL_GAIN
 	};
 	Equalizer& equalizer;
+	ZoomAnalyzer* zoom = nullptr;
+	std::vector<float> zoomSpectrum;
+	BandMeterBank* meters = nullptr;
+	std::vector<BandMeterBank::Band> meterBands;
+	int meterGeneration = 0;
+	std::vector<float> meterPre, meterPost, shownPre, shownPost;	// 读到的电平和显示的电平(带回落)
 	int selectedNodeId;
 	bool isDragging;
 	juce::Point<float> dragStartPos;
 
-	// ǩ༭سԱ
+	// 标签编辑相关成员变量
 	juce::TextEditor labelEditor;
 	bool isEditingLabel;
 	int editingNodeId;
 	LabelType editingLabelType;
-	// ʼ༭ǩ
+	// 开始编辑标签
 	void startLabelEditing(int nodeId, LabelType labelType)
 	{
 		setWantsKeyboardFocus(true);
@@ -202,15 +245,15 @@ private:
 
 		float nodeX = frequencyToPosition(node.cutoff, bounds);
 		float nodeY = gainToPosition(node.gainDB, bounds);
-		// ñ༭ı - ޸Ƶʵλ
+		// 设置编辑器文本 - 修复频率单位问题
 		juce::String currentText;
 		if (labelType == LABEL_FREQUENCY)
 		{
-			// ʾǩһµĸʽ
+			// 保持与显示标签一致的格式
 			if (node.cutoff >= 1000)
 			{
 				float kFreq = node.cutoff / 1000.0f;
-				currentText = juce::String(kFreq, 2) + "k";  // kλ
+				currentText = juce::String(kFreq, 2) + "k";  // 添加k单位
 			}
 			else
 			{
@@ -223,10 +266,10 @@ private:
 		}
 		labelEditor.setText(currentText);
 
-		// ༭λ - ߴԸƥı
+		// 计算编辑器位置 - 调整尺寸以更好匹配文本
 		juce::Rectangle<int> editorBounds;
-		int editorWidth = 60;  // ӿɸַ
-		int editorHeight = 18; // ΢Ӹ߶
+		int editorWidth = 60;  // 增加宽度以容纳更多字符
+		int editorHeight = 18; // 稍微增加高度
 
 		if (labelType == LABEL_FREQUENCY)
 		{
@@ -249,7 +292,7 @@ private:
 		labelEditor.grabKeyboardFocus();
 		labelEditor.selectAll();
 	}
-	// ޸finishLabelEditingȷƵʵλ
+	// 修改finishLabelEditing函数以正确处理频率单位
 	void finishLabelEditing(bool applyChanges)
 	{
 		setWantsKeyboardFocus(false);
@@ -262,27 +305,27 @@ private:
 
 			if (editingLabelType == LABEL_FREQUENCY)
 			{
-				// Ƶ - Ľλ
+				// 处理频率输入 - 改进单位处理
 				float value;
 
 				if (text.endsWithIgnoreCase("k"))
 				{
-					// Ƴk׺ת
+					// 移除k后缀并转换
 					juce::String numberPart = text.dropLastCharacters(1);
 					value = numberPart.getFloatValue() * 1000.0f;
 				}
 				else if (text.endsWithIgnoreCase("hz"))
 				{
-					// Ƴhz׺
+					// 移除hz后缀
 					juce::String numberPart = text.dropLastCharacters(2);
 					value = numberPart.getFloatValue();
 				}
 				else
 				{
-					// ֣жǷҪת
+					// 纯数字，判断是否需要转换
 					value = text.getFloatValue();
-					// С100֣ûͼkHz
-					// ǰ˼⣬ûʲôʲô
+					// 如果输入的是小于100的数字，可能用户意图输入kHz
+					// 但这里我们按字面意思理解，用户输入什么就是什么
 				}
 
 				value = juce::jlimit(MIN_FREQ, MAX_FREQ, value);
@@ -291,7 +334,7 @@ private:
 			}
 			else if (editingLabelType == LABEL_GAIN)
 			{
-				//  - ƳܵdB׺
+				// 处理增益输入 - 移除可能的dB后缀
 				juce::String cleanText = text;
 				if (text.endsWithIgnoreCase("db"))
 				{
@@ -310,7 +353,7 @@ private:
 		editingLabelType = LABEL_NONE;
 		repaint();
 	}
-	// λǷڱǩ
+	// 检查位置是否在标签上
 	bool getLabelAtPosition(const juce::Point<float>& pos, const juce::Rectangle<float>& bounds,
 		int& nodeId, LabelType& labelType)
 	{
@@ -320,7 +363,7 @@ private:
 			auto node = equalizer.GetNode(id);
 			float nodeX = frequencyToPosition(node.cutoff, bounds);
 			float nodeY = gainToPosition(node.gainDB, bounds);
-			// Ƶʱǩ
+			// 检查频率标签
 			float freqLabelY = (node.gainDB >= 0) ?
 				(nodeY - NODE_RADIUS - 20) :
 				(nodeY + NODE_RADIUS + 5);
@@ -331,7 +374,7 @@ private:
 				labelType = LABEL_FREQUENCY;
 				return true;
 			}
-			// ǩ
+			// 检查增益标签
 			float gainLabelY = (node.gainDB >= 0) ?
 				(nodeY - NODE_RADIUS - 20 - 16) :
 				(nodeY + NODE_RADIUS + 5 + 16);
@@ -347,10 +390,10 @@ private:
 		labelType = LABEL_NONE;
 		return false;
 	}
-	// ˽зֲ...
-	// [֮ǰ˽зλתƺ]
+	// 其余私有方法保持不变...
+	// [这里包含所有之前的私有方法，如位置转换函数、绘制函数等]
 
-	// λת - Ϊ
+	// 位置转换函数 - 改为对数坐标
 	float frequencyToPosition(float freq, const juce::Rectangle<float>& bounds) const
 	{
 		float logMinFreq = std::log10(MIN_FREQ);
@@ -382,22 +425,22 @@ private:
 		ratio = juce::jlimit(0.0f, 1.0f, ratio);
 		return MIN_DB + ratio * (MAX_DB - MIN_DB);
 	}
-	// ͱǩ - ĽĶ̶
+	// 绘制网格和标签 - 改进的对数刻度
 	void drawGrid(juce::Graphics& g, const juce::Rectangle<float>& bounds)
 	{
-		// Ƶߺͱǩ̶ȣ
+		// 绘制频率网格线和标签（对数刻度）
 		drawFrequencyGrid(g, bounds);
-		// ߺͱǩ
+		// 绘制增益网格线和标签
 		drawGainGrid(g, bounds);
 	}
 
 	void drawFrequencyGrid(juce::Graphics& g, const juce::Rectangle<float>& bounds)
 	{
-		// ҪƵʿ̶ (̶)
+		// 主要频率刻度 (大刻度)
 		std::vector<float> majorFreqs = {
 			10,100,1000,10000,100000
 		};
-		// ҪƵʿ̶ (С̶)
+		// 次要频率刻度 (小刻度)
 		std::vector<float> minorFreqs;
 		for (int i = 2; i <= 9; ++i)
 		{
@@ -406,7 +449,7 @@ private:
 			minorFreqs.push_back(i * 1000);
 			minorFreqs.push_back(i * 10000);
 		}
-		// С̶
+		// 绘制小刻度
 		g.setColour(juce::Colour(GRID_COLOR).withAlpha(0.2f));
 		for (float freq : minorFreqs)
 		{
@@ -416,7 +459,7 @@ private:
 				g.drawVerticalLine((int)x, bounds.getY(), bounds.getBottom());
 			}
 		}
-		// ƴ̶Ⱥͱǩ
+		// 绘制大刻度和标签
 		g.setColour(juce::Colour(GRID_COLOR).withAlpha(0.5f));
 		for (float freq : majorFreqs)
 		{
@@ -434,7 +477,7 @@ private:
 			if (freq >= MIN_FREQ && freq <= MAX_FREQ)
 			{
 				float x = frequencyToPosition(freq, bounds);
-				// Ƶʱǩײ
+				// 绘制频率标签（底部）
 				juce::String label = formatFrequencyLabel(freq);
 				g.setColour(juce::Colour(0xffffffff).withAlpha(0.75f));
 				g.drawText(label, x - 20, bounds.getBottom() - 20, 40, 15, juce::Justification::centred);
@@ -445,7 +488,7 @@ private:
 
 	void drawGainGrid(juce::Graphics& g, const juce::Rectangle<float>& bounds)
 	{
-		// ̶
+		// 增益刻度
 		std::vector<float> gains = { -40, -30, -20, -10, 0, 10, 20, 30, 40 };
 		g.setColour(juce::Colour(GRID_COLOR).withAlpha(0.5f));
 		for (float gain : gains)
@@ -454,7 +497,7 @@ private:
 			{
 				float y = gainToPosition(gain, bounds);
 				g.drawHorizontalLine((int)y, bounds.getX(), bounds.getRight());
-				// ǩҲࣩdBλ
+				// 绘制增益标签（右侧），不带dB单位
 				juce::String label = (gain > 0 ? "+" : "") + juce::String((int)gain);
 				g.setColour(juce::Colour(0xffffffff).withAlpha(0.75f));
 				g.drawText(label, bounds.getRight() - 32, y - 8, 30, 16,
@@ -463,7 +506,7 @@ private:
 			}
 		}
 	}
-	// ʽƵʱǩ
+	// 格式化频率标签
 	juce::String formatFrequencyLabel(float freq) const
 	{
 		if (freq >= 1000)
@@ -479,7 +522,7 @@ private:
 			return juce::String((int)freq);
 		}
 	}
-	// ʽڵƵʱǩ (ڽڵʾ)
+	// 格式化节点频率标签 (用于节点显示)
 	juce::String formatNodeFrequencyLabel(float freq) const
 	{
 		if (freq >= 1000)
@@ -497,7 +540,7 @@ private:
 	{
 		return juce::String(dB, 1) + "dB";
 	}
-	// ƵӦ
+	// 绘制频率响应
 	void drawFrequencyResponse(juce::Graphics& g, const juce::Rectangle<float>& bounds)
 	{
 		juce::Path responsePath;
@@ -525,7 +568,7 @@ private:
 		g.setColour(juce::Colour(RESPONSE_COLOR));
 		g.strokePath(responsePath, juce::PathStrokeType(RESPONSE_LINE_WIDTH));
 	}
-	// ѡнڵƵӦ
+	// 绘制选中节点的频率响应
 	void drawSelectedNodeResponse(juce::Graphics& g, const juce::Rectangle<float>& bounds)
 	{
 		juce::Path responsePath;
@@ -551,7 +594,143 @@ private:
 		g.setColour(juce::Colour(SELECTED_COLOR));
 		g.strokePath(responsePath, juce::PathStrokeType(SELECTED_LINE_WIDTH));
 	}
-	// ƽڵ
+	// 放大分析跟着选中的节点走, 没有选中或界面不可见时停掉
+	void updateZoom()
+	{
+		if (zoom == nullptr) return;
+		bool want = selectedNodeId >= 0 && equalizer.IsNodeActive(selectedNodeId) && isShowing();
+		if (want)
+		{
+			auto node = equalizer.GetNode(selectedNodeId);
+			float span = juce::jmax(ZOOM_MIN_SPAN, node.cutoff / juce::jmax(MIN_Q, node.q) * ZOOM_SPAN_BANDWIDTHS);
+			zoom->SetTarget(node.cutoff, span);
+		}
+		if (want != zoom->IsActive())
+			zoom->SetActive(want);
+	}
+	// 绘制选中节点附近的放大频谱, 只画抽取滤波器通带内的部分
+	void drawZoomSpectrum(juce::Graphics& g, const juce::Rectangle<float>& bounds)
+	{
+		float centre = 0.0f, binHz = 0.0f;
+		if (zoom == nullptr || !zoom->IsActive() || !zoom->GetSpectrum(zoomSpectrum, centre, binHz))
+			return;
+		int n = (int)zoomSpectrum.size();
+		int halfUsable = (int)(ZoomAnalyzer::UsableBand * n);
+		juce::Path zoomPath;
+		bool firstPoint = true;
+		for (int i = n / 2 - halfUsable; i <= n / 2 + halfUsable && i < n; ++i)
+		{
+			float freq = centre + (i - n / 2) * binHz;
+			if (freq < MIN_FREQ || freq > MAX_FREQ)
+				continue;
+			float ratio = juce::jlimit(0.0f, 1.0f, (zoomSpectrum[i] - ZOOM_MIN_DB) / (ZOOM_MAX_DB - ZOOM_MIN_DB));
+			float x = frequencyToPosition(freq, bounds);
+			float y = bounds.getBottom() - ratio * bounds.getHeight();
+			if (firstPoint)
+			{
+				zoomPath.startNewSubPath(x, y);
+				firstPoint = false;
+			}
+			else
+			{
+				zoomPath.lineTo(x, y);
+			}
+		}
+		g.setColour(juce::Colour(ZOOM_COLOR));
+		g.strokePath(zoomPath, juce::PathStrokeType(1.0f));
+	}
+	// 把活动节点交给电平表, 读回电平并做回落
+	void updateMeters()
+	{
+		if (meters == nullptr) return;
+		bool showing = isShowing();
+		if (showing != meters->IsActive())
+			meters->SetActive(showing);
+		if (!showing) return;
+
+		meterBands.clear();
+		for (int id : equalizer.GetActiveNodeIds())
+		{
+			auto node = equalizer.GetNode(id);
+			meterBands.push_back({ id, node.cutoff, node.q });
+		}
+		int generation = meters->SetBands(meterBands);
+		if (generation != meterGeneration)
+		{
+			meterGeneration = generation;
+			shownPre.assign(meterBands.size(), METER_MIN_DB);
+			shownPost.assign(meterBands.size(), METER_MIN_DB);
+		}
+		if (!meters->ReadLevels(meterGeneration, meterPre, meterPost))
+			return;
+		for (size_t i = 0; i < shownPre.size() && i < meterPre.size(); ++i)
+		{
+			shownPre[i] = juce::jmax(meterPre[i], shownPre[i] - METER_DECAY_DB);
+			shownPost[i] = juce::jmax(meterPost[i], shownPost[i] - METER_DECAY_DB);
+		}
+	}
+	// 节点右边的两根竖条: 灰色是EQ前, 绿色是EQ后
+	void drawNodeMeter(juce::Graphics& g, int id, float x, float y)
+	{
+		for (size_t i = 0; i < meterBands.size() && i < shownPre.size(); ++i)
+		{
+			if (meterBands[i].id != id) continue;
+			float left = x + NODE_RADIUS + 3.0f;
+			float bottom = y + METER_HEIGHT * 0.5f;
+			auto barHeight = [](float dB) { return juce::jlimit(0.0f, 1.0f, 1.0f - dB / METER_MIN_DB) * METER_HEIGHT; };
+			float hPre = barHeight(shownPre[i]), hPost = barHeight(shownPost[i]);
+			g.setColour(juce::Colour(METER_PRE_COLOR));
+			g.fillRect(left, bottom - hPre, METER_WIDTH, hPre);
+			g.setColour(juce::Colour(NODE_COLOR));
+			g.fillRect(left + METER_WIDTH + 1.0f, bottom - hPost, METER_WIDTH, hPost);
+			return;
+		}
+	}
+	// 动态节点: 从节点画一根线到当前实际的增益, 外面再套一圈表示是动态的
+	void drawDynamicGain(juce::Graphics& g, const juce::Rectangle<float>& bounds, int id, float x, float y, float gainDB)
+	{
+		float yNow = gainToPosition(gainDB + equalizer.GetDynamicGain(id), bounds);
+		g.setColour(juce::Colour(DYNAMIC_COLOR));
+		g.drawEllipse(x - NODE_RADIUS - 3.0f, y - NODE_RADIUS - 3.0f,
+			NODE_RADIUS * 2 + 6.0f, NODE_RADIUS * 2 + 6.0f, 1.0f);
+		g.drawLine(x, y, x, yNow, 2.0f);
+		g.fillEllipse(x - 2.5f, yNow - 2.5f, 5.0f, 5.0f);
+	}
+	// 调制节点: 从节点画一根线到当前调制到的位置
+	void drawModulation(juce::Graphics& g, const juce::Rectangle<float>& bounds, int id, float x, float y)
+	{
+		float cutoff, gainDB;
+		if (!equalizer.GetModulatedValues(id, cutoff, gainDB)) return;
+		float xNow = frequencyToPosition(cutoff, bounds);
+		float yNow = gainToPosition(gainDB, bounds);
+		g.setColour(juce::Colour(MOD_COLOR));
+		g.drawLine(x, y, xNow, yNow, 1.0f);
+		g.fillEllipse(xNow - 3.0f, yNow - 3.0f, 6.0f, 6.0f);
+	}
+	// 跟踪节点: 从节点横着画到当前跟踪到的频率
+	void drawKeyTrack(juce::Graphics& g, const juce::Rectangle<float>& bounds, int id, float x, float y)
+	{
+		float cutoff;
+		if (!equalizer.GetTrackedCutoff(id, cutoff)) return;
+		float xNow = frequencyToPosition(cutoff, bounds);
+		g.setColour(juce::Colour(KEY_COLOR));
+		g.drawLine(x, y, xNow, y, 1.0f);
+		g.fillRect(xNow - 2.5f, y - 2.5f, 5.0f, 5.0f);
+	}
+	// 分频点: 竖线和频率
+	void drawCrossover(juce::Graphics& g, const juce::Rectangle<float>& bounds)
+	{
+		auto xo = equalizer.GetCrossover();
+		for (int j = 0; j < xo.numBands - 1; ++j)
+		{
+			float x = frequencyToPosition(xo.freqs[j], bounds);
+			g.setColour(juce::Colour(CROSSOVER_COLOR).withAlpha(0.6f));
+			g.drawVerticalLine((int)x, bounds.getY(), bounds.getBottom());
+			g.drawText(formatNodeFrequencyLabel(xo.freqs[j]), (int)x + 3, (int)bounds.getY() + 2, 50, 15,
+				juce::Justification::centredLeft);
+		}
+	}
+	// 绘制节点
 	void drawNodes(juce::Graphics& g, const juce::Rectangle<float>& bounds)
 	{
 		auto activeIds = equalizer.GetActiveNodeIds();
@@ -560,25 +739,40 @@ private:
 			auto node = equalizer.GetNode(id);
 			float x = frequencyToPosition(node.cutoff, bounds);
 			float y = gainToPosition(node.gainDB, bounds);
-			// ƽڵԲȦ
+			// 绘制节点圆圈
 			g.setColour(juce::Colour(NODE_COLOR));
 			g.drawEllipse(x - NODE_RADIUS, y - NODE_RADIUS,
 				NODE_RADIUS * 2, NODE_RADIUS * 2, NODE_LINE_WIDTH);
-			// ѡеĽڵ㣬ԲȦ
+			// 如果是选中的节点，填充圆圈
 			if (id == selectedNodeId)
 			{
 				g.setColour(juce::Colour(NODE_COLOR).withAlpha(0.3f));
 				g.fillEllipse(x - NODE_RADIUS, y - NODE_RADIUS,
 					NODE_RADIUS * 2, NODE_RADIUS * 2);
 			}
-			// ڱ༭״̬Ʊǩ
+			drawNodeMeter(g, id, x, y);
+			if (node.dyn.enabled)
+				drawDynamicGain(g, bounds, id, x, y, node.gainDB);
+			if (node.key.enabled)
+				drawKeyTrack(g, bounds, id, x, y);
+			if (node.mod.source != MOD_OFF)
+				drawModulation(g, bounds, id, x, y);
+			// 单声道/中侧节点在圆圈里标出声道
+			if (node.route != ROUTE_STEREO)
+			{
+				g.setColour(juce::Colour(NODE_COLOR));
+				g.drawText(juce::String::charToString(Equalizer::GetRouteName(node.route)[0]),
+					(int)(x - NODE_RADIUS), (int)(y - NODE_RADIUS), (int)(NODE_RADIUS * 2), (int)(NODE_RADIUS * 2),
+					juce::Justification::centred);
+			}
+			// 如果不在编辑状态，绘制标签
 			if (!isEditingLabel || editingNodeId != id)
 			{
 				drawNodeFrequencyLabel(g, bounds, x, y, node.cutoff, node.gainDB);
 			}
 		}
 	}
-	// ƽڵƵʱǩ
+	// 绘制节点频率标签
 	void drawNodeFrequencyLabel(juce::Graphics& g, const juce::Rectangle<float>& bounds,
 		float nodeX, float nodeY, float freq, float gainDB)
 	{
@@ -587,13 +781,13 @@ private:
 		float labelY1, labelY2;
 		if (gainDB >= 0)
 		{
-			// ڽڵϷʾ
+			// 在节点上方显示
 			labelY1 = nodeY - NODE_RADIUS - 20;
 			labelY2 = nodeY - NODE_RADIUS - 20 - 16;
 		}
 		else
 		{
-			// ڽڵ·ʾ
+			// 在节点下方显示
 			labelY1 = nodeY + NODE_RADIUS + 5;
 			labelY2 = nodeY + NODE_RADIUS + 5 + 16;
 		}
@@ -602,7 +796,7 @@ private:
 		g.setColour(juce::Colour(0xFF00FFFF).withAlpha(0.95f));
 		g.drawText(labeldb, nodeX - 25, labelY2, 50, 15, juce::Justification::centred);
 	}
-	// ȡλôĽڵID
+	// 获取位置处的节点ID
 	int getNodeAtPosition(const juce::Point<float>& pos, const juce::Rectangle<float>& bounds)
 	{
 		auto activeIds = equalizer.GetActiveNodeIds();
@@ -612,14 +806,14 @@ private:
 			float x = frequencyToPosition(node.cutoff, bounds);
 			float y = gainToPosition(node.gainDB, bounds);
 			float distance = pos.getDistanceFrom(juce::Point<float>(x, y));
-			if (distance <= NODE_RADIUS + 5) // һЩݲ
+			if (distance <= NODE_RADIUS + 5) // 添加一些容差
 			{
 				return id;
 			}
 		}
 		return -1;
 	}
-	// Ҽ
+	// 处理右键点击
 	void handleRightClick(const juce::MouseEvent& event)
 	{
 		auto bounds = getLocalBounds().toFloat().reduced(BORDER_WIDTH);
@@ -628,12 +822,81 @@ private:
 		{
 			showNodeContextMenu(nodeId, event.getScreenPosition());
 		}
+		else
+		{
+			showGlobalContextMenu(event.getScreenPosition());
+		}
 	}
-	// ʾڵĲ˵
+	// 空白处右键: 全局设置
+	void showGlobalContextMenu(juce::Point<int> screenPos)
+	{
+		juce::PopupMenu menu;
+		menu.addSectionHeader("Phase");
+		menu.addItem(300, "Minimum Phase (IIR)", true, equalizer.GetPhaseMode() == PHASE_MINIMUM);
+		menu.addItem(301, "Linear Phase (FIR)", true, equalizer.GetPhaseMode() == PHASE_LINEAR);
+		menu.addSeparator();
+		menu.addItem(302, "Auto Engine (IIR / FIR)", equalizer.GetPhaseMode() == PHASE_MINIMUM,
+			equalizer.GetAutoEngine());
+		menu.addItem(303, equalizer.GetEngine() == ENGINE_FIR ?
+			"Engine: FIR convolution" : "Engine: IIR cascade", false, false);
+		menu.addItem(304, juce::String("IIR Kernel: ") + StageBank::GetKernelName(equalizer.GetIIRKernel()) +
+			juce::String::formatted(" (%.2f ns/stage, %d double)", equalizer.GetIIRKernelCost(equalizer.GetIIRKernel()),
+				equalizer.GetNumWideStages()),
+			false, false);
+		menu.addSeparator();
+		menu.addSectionHeader("A/B Compare");
+		const char* slotName = equalizer.GetSnapshotSlot() == 0 ? "A" : "B";
+		const char* otherName = equalizer.GetSnapshotSlot() == 0 ? "B" : "A";
+		menu.addItem(305, juce::String("Copy ") + slotName + " to " + otherName);
+		menu.addItem(306, juce::String("Switch to ") + otherName, equalizer.IsComparing(), false);
+		menu.addItem(307, "End Compare", equalizer.IsComparing(), false);
+		menu.addSeparator();
+		menu.addSubMenu("Crossover Outputs", makeCrossoverMenu());
+		menu.addSubMenu("Oversampling", makeOversamplingMenu());
+		menu.showMenuAsync(juce::PopupMenu::Options().withTargetScreenArea(
+			juce::Rectangle<int>(screenPos.x, screenPos.y, 1, 1)),
+			[this](int result)
+			{
+				if (result == 300 || result == 301)
+				{
+					equalizer.SetPhaseMode(result == 301 ? PHASE_LINEAR : PHASE_MINIMUM);
+					repaint();
+				}
+				else if (result == 302)
+				{
+					equalizer.SetAutoEngine(!equalizer.GetAutoEngine());
+				}
+				else if (result == 305)
+				{
+					equalizer.CopySnapshotToOther();
+				}
+				else if (result == 306)
+				{
+					selectedNodeId = -1;
+					equalizer.SwitchSnapshot();
+					repaint();
+				}
+				else if (result == 307)
+				{
+					equalizer.EndCompare();
+				}
+				else if (result >= 700 && result < 900)
+				{
+					applyCrossoverMenu(result);
+					repaint();
+				}
+				else if (result >= 1000 && result < 1100)
+				{
+					applyOversamplingMenu(result);
+					repaint();
+				}
+			});
+	}
+	// 显示节点上下文菜单
 	void showNodeContextMenu(int nodeId, juce::Point<int> screenPos)
 	{
 		juce::PopupMenu menu;
-		// ˲ѡ
+		// 添加滤波器类型选项
 		menu.addSectionHeader("Filter Type");
 		for (int i = 0; i < Equalizer::GetNumFilterModes(); ++i)
 		{
@@ -641,21 +904,54 @@ private:
 				true, equalizer.GetNode(nodeId).mode == i);
 		}
 		menu.addSeparator();
+		menu.addSubMenu("Dynamic", makeDynamicMenu(nodeId));
+		menu.addSubMenu("Modulation", makeModulationMenu(nodeId));
+		menu.addSubMenu("Key Track", makeKeyTrackMenu(nodeId));
+		// 声道路由, 菜单id: 900起
+		juce::PopupMenu routes;
+		for (int r = 0; r < NumChannelRoutes; ++r)
+			routes.addItem(900 + r, Equalizer::GetRouteName(r), true, equalizer.GetNode(nodeId).route == r);
+		menu.addSubMenu("Channel", routes);
+		menu.addSeparator();
 		menu.addItem(200, "Delete Node");
 		menu.showMenuAsync(juce::PopupMenu::Options().withTargetScreenArea(
 			juce::Rectangle<int>(screenPos.x, screenPos.y, 1, 1)),
 			[this, nodeId](int result)
 			{
+				if (result >= 400 && result < 500)
+				{
+					applyDynamicMenu(nodeId, result);
+					repaint();
+					return;
+				}
+				if (result >= 500 && result < 600)
+				{
+					applyModulationMenu(nodeId, result);
+					repaint();
+					return;
+				}
+				if (result >= 600 && result < 700)
+				{
+					applyKeyTrackMenu(nodeId, result);
+					repaint();
+					return;
+				}
+				if (result >= 900 && result < 900 + NumChannelRoutes)
+				{
+					equalizer.SetNodeRoute(nodeId, result - 900);
+					repaint();
+					return;
+				}
 				if (result >= 100 && result < 200)
 				{
-					// ˲
+					// 更改滤波器类型
 					int newMode = result - 100;
 					equalizer.SetNodeMode(nodeId, newMode);
 					repaint();
 				}
 				else if (result == 200)
 				{
-					// ɾڵ
+					// 删除节点
 					if (selectedNodeId == nodeId)
 						selectedNodeId = -1;
 					equalizer.DeleteNode(nodeId);
@@ -663,4 +959,195 @@ private:
 				}
 			});
 	}
+	// 动态设置的几档预设, 菜单id: 400开关, 401侧链, 410起阈值, 420起比例, 430起attack, 440起release
+	static constexpr float DYN_THRESHOLDS[] = { -48.0f, -36.0f, -24.0f, -18.0f, -12.0f, -6.0f };
+	static constexpr float DYN_RATIOS[] = { 1.5f, 2.0f, 3.0f, 4.0f, 8.0f };
+	static constexpr float DYN_ATTACKS[] = { 1.0f, 3.0f, 10.0f, 30.0f, 100.0f };
+	static constexpr float DYN_RELEASES[] = { 30.0f, 60.0f, 120.0f, 250.0f, 500.0f, 1000.0f };
+	juce::PopupMenu makeDynamicMenu(int nodeId)
+	{
+		auto dyn = equalizer.GetNode(nodeId).dyn;
+		juce::PopupMenu m;
+		m.addItem(400, "Enabled", Equalizer::CanBeDynamic(nodeId), dyn.enabled);
+		m.addItem(401, "Key from Sidechain", dyn.enabled, dyn.sidechain);
+		auto addChoices = [&](const char* name, const float* values, int count, int baseId, float current, const char* unit)
+		{
+			juce::PopupMenu sub;
+			for (int i = 0; i < count; ++i)
+				sub.addItem(baseId + i, juce::String(values[i], values[i] == (int)values[i] ? 0 : 1) + unit, true, values[i] == current);
+			m.addSubMenu(name, sub, dyn.enabled);
+		};
+		addChoices("Threshold", DYN_THRESHOLDS, (int)std::size(DYN_THRESHOLDS), 410, dyn.thresholdDB, " dB");
+		addChoices("Ratio", DYN_RATIOS, (int)std::size(DYN_RATIOS), 420, dyn.ratio, ":1");
+		addChoices("Attack", DYN_ATTACKS, (int)std::size(DYN_ATTACKS), 430, dyn.attackMs, " ms");
+		addChoices("Release", DYN_RELEASES, (int)std::size(DYN_RELEASES), 440, dyn.releaseMs, " ms");
+		return m;
+	}
+	void applyDynamicMenu(int nodeId, int result)
+	{
+		auto dyn = equalizer.GetNode(nodeId).dyn;
+		if (result == 400) dyn.enabled = !dyn.enabled;
+		else if (result == 401) dyn.sidechain = !dyn.sidechain;
+		else if (result >= 440) dyn.releaseMs = DYN_RELEASES[result - 440];
+		else if (result >= 430) dyn.attackMs = DYN_ATTACKS[result - 430];
+		else if (result >= 420) dyn.ratio = DYN_RATIOS[result - 420];
+		else if (result >= 410) dyn.thresholdDB = DYN_THRESHOLDS[result - 410];
+		equalizer.SetNodeDynamics(nodeId, dyn);
+	}
+	// 调制设置的几档预设, 菜单id: 500起来源, 509侧链, 510起形状, 520起速率, 530起同步拍数,
+	// 540起频率深度, 550起增益深度, 560起attack, 570起release
+	static constexpr float MOD_RATES[] = { 0.1f, 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f };
+	static constexpr float MOD_SYNC_BEATS[] = { 0.0f, 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f, 16.0f };
+	static constexpr float MOD_OCTAVES[] = { -2.0f, -1.0f, -0.5f, 0.0f, 0.5f, 1.0f, 2.0f, 3.0f };
+	static constexpr float MOD_GAINS[] = { -12.0f, -6.0f, -3.0f, 0.0f, 3.0f, 6.0f, 12.0f };
+	juce::PopupMenu makeModulationMenu(int nodeId)
+	{
+		auto mod = equalizer.GetNode(nodeId).mod;
+		bool can = Equalizer::CanBeModulated(nodeId);
+		bool on = mod.source != MOD_OFF;
+		bool lfo = mod.source == MOD_LFO, env = mod.source == MOD_ENVELOPE;
+		juce::PopupMenu m;
+		m.addItem(500, "Off", can, !on);
+		m.addItem(501, "LFO", can, lfo);
+		m.addItem(502, "Envelope", can, env);
+		m.addSeparator();
+		auto addChoices = [&](const char* name, const float* values, int count, int baseId, float current,
+			const char* unit, bool enabled)
+		{
+			juce::PopupMenu sub;
+			for (int i = 0; i < count; ++i)
+				sub.addItem(baseId + i, juce::String(values[i], values[i] == (int)values[i] ? 0 : 2) + unit, true, values[i] == current);
+			m.addSubMenu(name, sub, enabled);
+		};
+		juce::PopupMenu shapes;
+		const char* shapeNames[] = { "Sine", "Triangle", "Saw", "Square" };
+		for (int i = 0; i < 4; ++i) shapes.addItem(510 + i, shapeNames[i], true, mod.shape == i);
+		m.addSubMenu("Shape", shapes, lfo);
+		addChoices("Rate", MOD_RATES, (int)std::size(MOD_RATES), 520, mod.rateHz, " Hz", lfo && mod.syncBeats <= 0.0f);
+		juce::PopupMenu sync;
+		for (int i = 0; i < (int)std::size(MOD_SYNC_BEATS); ++i)
+		{
+			float beats = MOD_SYNC_BEATS[i];
+			sync.addItem(530 + i, beats <= 0.0f ? juce::String("Free") : juce::String(beats, beats == (int)beats ? 0 : 2) + " beats",
+				true, beats == mod.syncBeats);
+		}
+		m.addSubMenu("Sync", sync, lfo);
+		m.addItem(509, "Envelope from Sidechain", env, mod.sidechain);
+		addChoices("Attack", DYN_ATTACKS, (int)std::size(DYN_ATTACKS), 560, mod.attackMs, " ms", env);
+		addChoices("Release", DYN_RELEASES, (int)std::size(DYN_RELEASES), 570, mod.releaseMs, " ms", env);
+		m.addSeparator();
+		addChoices("Frequency Depth", MOD_OCTAVES, (int)std::size(MOD_OCTAVES), 540, mod.depthOctaves, " oct", on);
+		addChoices("Gain Depth", MOD_GAINS, (int)std::size(MOD_GAINS), 550, mod.depthDB, " dB", on);
+		return m;
+	}
+	void applyModulationMenu(int nodeId, int result)
+	{
+		auto mod = equalizer.GetNode(nodeId).mod;
+		if (result >= 500 && result <= 502) mod.source = result - 500;
+		else if (result == 509) mod.sidechain = !mod.sidechain;
+		else if (result >= 570) mod.releaseMs = DYN_RELEASES[result - 570];
+		else if (result >= 560) mod.attackMs = DYN_ATTACKS[result - 560];
+		else if (result >= 550) mod.depthDB = MOD_GAINS[result - 550];
+		else if (result >= 540) mod.depthOctaves = MOD_OCTAVES[result - 540];
+		else if (result >= 530) mod.syncBeats = MOD_SYNC_BEATS[result - 530];
+		else if (result >= 520) mod.rateHz = MOD_RATES[result - 520];
+		else if (result >= 510) mod.shape = result - 510;
+		equalizer.SetNodeModulation(nodeId, mod);
+	}
+	// 音高跟踪的几档预设, 菜单id: 600开关, 610起谐波, 620起滑音时间
+	static constexpr float KEY_HARMONICS[] = { 0.5f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 8.0f };
+	static constexpr float KEY_GLIDES[] = { 0.0f, 10.0f, 30.0f, 100.0f, 300.0f, 1000.0f };
+	juce::PopupMenu makeKeyTrackMenu(int nodeId)
+	{
+		auto key = equalizer.GetNode(nodeId).key;
+		juce::PopupMenu m;
+		m.addItem(600, "Enabled", Equalizer::CanKeyTrack(nodeId), key.enabled);
+		juce::PopupMenu harmonics;
+		for (int i = 0; i < (int)std::size(KEY_HARMONICS); ++i)
+		{
+			float h = KEY_HARMONICS[i];
+			harmonics.addItem(610 + i, "x" + juce::String(h, h == (int)h ? 0 : 1), true, h == key.harmonic);
+		}
+		m.addSubMenu("Harmonic", harmonics, key.enabled);
+		juce::PopupMenu glides;
+		for (int i = 0; i < (int)std::size(KEY_GLIDES); ++i)
+		{
+			float ms = KEY_GLIDES[i];
+			glides.addItem(620 + i, ms <= 0.0f ? juce::String("Off") : juce::String(ms, 0) + " ms", true, ms == key.glideMs);
+		}
+		m.addSubMenu("Glide", glides, key.enabled);
+		return m;
+	}
+	void applyKeyTrackMenu(int nodeId, int result)
+	{
+		auto key = equalizer.GetNode(nodeId).key;
+		if (result == 600) key.enabled = !key.enabled;
+		else if (result >= 620) key.glideMs = KEY_GLIDES[result - 620];
+		else if (result >= 610) key.harmonic = KEY_HARMONICS[result - 610];
+		equalizer.SetNodeKeyTrack(nodeId, key);
+	}
+	// 分频输出, 菜单id: 700起段数(700为关), 710/711阶数, 720 + 分频点 * 30起频率
+	static constexpr float CROSSOVER_FREQS[] = { 60.0f, 80.0f, 100.0f, 120.0f, 150.0f, 200.0f, 250.0f, 300.0f, 400.0f, 500.0f,
+		700.0f, 1000.0f, 1500.0f, 2000.0f, 3000.0f, 4000.0f, 5000.0f, 7000.0f, 10000.0f, 14000.0f };
+	juce::PopupMenu makeCrossoverMenu()
+	{
+		auto xo = equalizer.GetCrossover();
+		juce::PopupMenu m;
+		m.addItem(700, "Off", true, xo.numBands == 1);
+		for (int b = 2; b <= Crossover::MaxBands; ++b)
+			m.addItem(700 + b - 1, juce::String(b) + " Bands", true, xo.numBands == b);
+		m.addSeparator();
+		m.addItem(710, "LR4 (24 dB/oct)", true, xo.order == 4);
+		m.addItem(711, "LR8 (48 dB/oct)", true, xo.order == 8);
+		m.addSeparator();
+		for (int j = 0; j < Crossover::MaxSplits; ++j)
+		{
+			juce::PopupMenu freqs;
+			for (int i = 0; i < (int)std::size(CROSSOVER_FREQS); ++i)
+				freqs.addItem(720 + j * 30 + i, formatNodeFrequencyLabel(CROSSOVER_FREQS[i]), true, CROSSOVER_FREQS[i] == xo.freqs[j]);
+			m.addSubMenu("Split " + juce::String(j + 1) + ": " + formatNodeFrequencyLabel(xo.freqs[j]), freqs, j < xo.numBands - 1);
+		}
+		return m;
+	}
+	void applyCrossoverMenu(int result)
+	{
+		auto xo = equalizer.GetCrossover();
+		if (result < 710) xo.numBands = result - 700 + 1;
+		else if (result < 720) xo.order = result == 711 ? 8 : 4;
+		else xo.freqs[(result - 720) / 30] = CROSSOVER_FREQS[(result - 720) % 30];
+		equalizer.SetCrossover(xo);
+	}
+	// 过采样, 菜单id: 1000起倍数(1000为关), 1010/1011相位, 1020起阈值频率
+	static constexpr float OVERSAMPLING_THRESHOLDS[] = { 2000.0f, 4000.0f, 6000.0f, 8000.0f, 10000.0f, 12000.0f, 16000.0f };
+	juce::PopupMenu makeOversamplingMenu()
+	{
+		int factor = equalizer.GetOversamplingFactor();
+		bool resampled = factor > 1 && equalizer.GetPhaseMode() == PHASE_MINIMUM;//线性相位下不升降采样
+		juce::PopupMenu m;
+		m.addItem(1000, "Off", true, factor == 1);
+		m.addItem(1001, "2x", true, factor == 2);
+		m.addItem(1002, "4x", true, factor == 4);
+		m.addSeparator();
+		m.addItem(1010, "Linear Phase Filters", resampled, equalizer.GetOversamplingPhase() == OVERSAMPLE_LINEAR);
+		m.addItem(1011, "Minimum Phase Filters", resampled, equalizer.GetOversamplingPhase() == OVERSAMPLE_MINIMUM);
+		m.addSeparator();
+		juce::PopupMenu thresholds;
+		for (int i = 0; i < (int)std::size(OVERSAMPLING_THRESHOLDS); ++i)
+			thresholds.addItem(1020 + i, formatNodeFrequencyLabel(OVERSAMPLING_THRESHOLDS[i]), true,
+				OVERSAMPLING_THRESHOLDS[i] == equalizer.GetOversamplingThreshold());
+		m.addSubMenu("Bands Above: " + formatNodeFrequencyLabel(equalizer.GetOversamplingThreshold()), thresholds, factor > 1);
+		m.addSeparator();
+		m.addItem(1090, "Latency: " + juce::String(equalizer.GetLatencySamples()) + " samples", false, false);
+		return m;
+	}
+	void applyOversamplingMenu(int result)
+	{
+		int factor = equalizer.GetOversamplingFactor();
+		int phase = equalizer.GetOversamplingPhase();
+		float threshold = equalizer.GetOversamplingThreshold();
+		if (result < 1010) factor = 1 << (result - 1000);
+		else if (result < 1020) phase = result - 1010;
+		else threshold = OVERSAMPLING_THRESHOLDS[result - 1020];
+		equalizer.SetOversampling(factor, phase, threshold);
+	}
 };
\ No newline at end of file
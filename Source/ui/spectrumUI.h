@@ -7,7 +7,7 @@
 class SpectrumUI : public juce::Component, public juce::Timer
 {
 public:
-	// Ƴ
+	// 绘制常量定义
 	static constexpr float MIN_FREQ = 10.01f;
 	static constexpr float MAX_FREQ = 24000.0f;
 	static constexpr float MIN_DB = -40.0f;
@@ -16,21 +16,34 @@ public:
 	static constexpr float BORDER_WIDTH = 2.0f;
 	const juce::Colour SPECTRUM_LINE_COLOR = juce::Colour(0xffffffff);
 	const juce::Colour SPECTRUM_FILL_COLOR = juce::Colour(0xff555555);
+	const juce::Colour STATS_BAND_COLOR = juce::Colour(0x3000aaff);
+	const juce::Colour STATS_MEDIAN_COLOR = juce::Colour(0xc000aaff);
+	const juce::Colour SIDECHAIN_LINE_COLOR = juce::Colour(0xc0ffaa00);
+	const juce::Colour COLLISION_COLOR = juce::Colour(0x90ff3030);
+	static constexpr float COLLISION_FLOOR_DB = -30.0f; // 两边都高过这个电平才算冲突
 	static constexpr int REFRESH_RATE_HZ = 30;
+	static constexpr int MAX_OVERLAYS = 8;
+	static constexpr int STATS_REFRESH_TICKS = 10; // 统计快照不用每帧取
 	explicit SpectrumUI(std::shared_ptr<Spectrum1d> processor = nullptr)
 		: processor_(processor)
-		, useLogSpectrum_(true) // ĬʹöƵ
+		, useLogSpectrum_(true) // 默认使用对数频谱
 	{
-		startTimerHz(REFRESH_RATE_HZ);
 		setOpaque(false);
 	}
 
+	~SpectrumUI() override
+	{
+		setConsuming(false);
+	}
+
 	void setProcessor(std::shared_ptr<Spectrum1d> processor)
 	{
+		setConsuming(false);
 		processor_ = processor;
+		updateConsuming();
 	}
 
-	// ǷʹöƵ׻ƣƽƣ
+	// 设置是否使用对数频谱绘制（平滑绘制）
 	void setUseLogSpectrum(bool useLog)
 	{
 		useLogSpectrum_ = useLog;
@@ -41,21 +54,126 @@ public:
 		return useLogSpectrum_;
 	}
 
+	// 叠加显示其他实例(轨道)的频谱, slot来自SpectrumBus
+	void addOverlay(int slot)
+	{
+		if (slot < 0 || (int)overlays_.size() >= MAX_OVERLAYS) return;
+		for (auto& o : overlays_)
+			if (o.slot == slot) return;
+		overlays_.push_back({ slot, std::vector<float>(SpectrumBus::NumBins, SpectrumBus::MinDB), false });
+		if (consuming_) bus_->AddViewer(slot);
+	}
+
+	void removeOverlay(int slot)
+	{
+		for (size_t i = 0; i < overlays_.size(); ++i)
+		{
+			if (overlays_[i].slot != slot) continue;
+			if (consuming_) bus_->RemoveViewer(slot);
+			overlays_.erase(overlays_.begin() + i);
+			repaint();
+			return;
+		}
+	}
+
+	void clearOverlays()
+	{
+		while (!overlays_.empty())
+			removeOverlay(overlays_.back().slot);
+	}
+
+	bool hasOverlay(int slot) const
+	{
+		for (auto& o : overlays_)
+			if (o.slot == slot) return true;
+		return false;
+	}
+
+	// 右键选择要叠加的轨道
+	void mouseDown(const juce::MouseEvent& e) override
+	{
+		if (!e.mods.isPopupMenu()) return;
+		auto publishers = bus_->GetPublishers(processor_ ? processor_->getBusSlot() : -1);
+		juce::PopupMenu menu;
+		menu.addSectionHeader("Overlay Tracks");
+		for (auto& p : publishers)
+			menu.addItem(1 + p.slot, p.name, true, hasOverlay(p.slot));
+		menu.addSeparator();
+		menu.addItem(1000, "Clear Overlays", !overlays_.empty());
+		bool collecting = processor_ && processor_->isCollectingStatistics();
+		menu.addSeparator();
+		menu.addSectionHeader("Session Statistics");
+		menu.addItem(1001, "Collect Statistics", processor_ != nullptr, collecting);
+		menu.addItem(1002, "Reset Statistics", collecting);
+		menu.addItem(1003, "Copy Statistics (CSV)", processor_ != nullptr);
+		menu.addSeparator();
+		menu.addItem(1004, "Show Sidechain Collision", processor_ != nullptr, showSidechain_);
+		menu.showMenuAsync(juce::PopupMenu::Options().withTargetScreenArea(
+			juce::Rectangle<int>(e.getScreenX(), e.getScreenY(), 1, 1)),
+			[this](int result)
+			{
+				if (result == 1000) clearOverlays();
+				else if (result == 1001 && processor_)
+				{
+					processor_->setCollectStatistics(!processor_->isCollectingStatistics());
+					stats_ = {};
+					repaint();
+				}
+				else if (result == 1002 && processor_) processor_->resetStatistics();
+				else if (result == 1003 && processor_)
+					juce::SystemClipboard::copyTextToClipboard(processor_->exportStatisticsCSV());
+				else if (result == 1004)
+				{
+					showSidechain_ = !showSidechain_;
+					sidechainData_.clear();
+					repaint();
+				}
+				else if (result > 0 && result <= SpectrumBus::NumSlots)
+				{
+					if (hasOverlay(result - 1)) removeOverlay(result - 1);
+					else addOverlay(result - 1);
+				}
+			});
+	}
+
 	// Component overrides
 	void paint(juce::Graphics& g) override
 	{
 		auto bounds = getLocalBounds().toFloat();
 
-		// Ʊ
+		// 绘制背景
 		g.fillAll(juce::Colours::black);
 
-		// Ʊ߿
+		// 绘制边框
 		g.setColour(BORDER_COLOR);
 		g.drawRect(bounds, BORDER_WIDTH);
 
-		// Ƶ׻ȥ߿
+		// 更新频谱绘制区域（去除边框）
 		spectrumBounds_ = bounds.reduced(BORDER_WIDTH);
 
+		// 其他轨道的频谱画在自己的下面
+		for (size_t i = 0; i < overlays_.size(); ++i)
+		{
+			if (!overlays_[i].valid) continue;
+			g.setColour(juce::Colour::fromHSV((float)i / MAX_OVERLAYS, 0.7f, 1.0f, 0.6f));
+			g.strokePath(makeOverlayPath(overlays_[i].dB), juce::PathStrokeType(1.0f));
+		}
+
+		// 会话统计: 10%~90%分位数的范围和中位数
+		if (stats_.frames > 0)
+		{
+			juce::Path band = makeOverlayPath(stats_.p90);
+			int n = (int)stats_.p10.size();
+			for (int i = n - 1; i >= 0; --i)
+				band.lineTo(spectrumBounds_.getX() + spectrumBounds_.getWidth() * i / (float)(n - 1),
+					dbToPosition(stats_.p10[i], spectrumBounds_));
+			band.closeSubPath();
+			g.setColour(STATS_BAND_COLOR);
+			g.fillPath(band);
+			g.setColour(STATS_MEDIAN_COLOR);
+			g.strokePath(makeOverlayPath(stats_.p50), juce::PathStrokeType(1.0f));
+		}
+
 		if (!spectrumData_.empty())
 		{
 			if (useLogSpectrum_)
@@ -63,7 +181,7 @@ public:
 			else
 				updateLinearSpectrumPath();
 
-			// 
+			// 绘制填充区域
 			g.setColour(SPECTRUM_FILL_COLOR);
 			juce::Path fillPath = spectrumPath_;
 			fillPath.lineTo(spectrumBounds_.getRight(), spectrumBounds_.getBottom());
@@ -71,30 +189,47 @@ public:
 			fillPath.closeSubPath();
 			g.fillPath(fillPath);
 
-			// Ƶ
+			// 绘制频谱线
 			g.setColour(SPECTRUM_LINE_COLOR);
 			g.strokePath(spectrumPath_, juce::PathStrokeType(1.0f));
 		}
 
-		// ƿ̶ȱǩ
+		if (showSidechain_ && useLogSpectrum_ && sidechainData_.size() == spectrumData_.size())
+			drawSidechainCollision(g);
+
+		// 绘制刻度标签
 		drawGridAndLabels(g);
 	}
 
 	void resized() override
 	{
-		// СıʱƵ·
+		// 组件大小改变时更新频谱路径
 		repaint();
 	}
 
+	// 只有真正显示出来时分析器才运行
+	void visibilityChanged() override { updateConsuming(); }
+	void parentHierarchyChanged() override { updateConsuming(); }
+
 	// Timer override
 	void timerCallback() override
 	{
+		for (auto& o : overlays_)
+			o.valid = bus_->Read(o.slot, o.dB.data()) || o.valid;
+
 		if (processor_)
 		{
+			if (processor_->isCollectingStatistics() && ++statsTicks_ >= STATS_REFRESH_TICKS)
+			{
+				statsTicks_ = 0;
+				stats_ = processor_->getStatistics();
+			}
 			if (useLogSpectrum_)
 			{
 				spectrumData_ = processor_->getLogSpectrumData();
 				logFrequencies_ = processor_->getLogFrequencies();
+				if (showSidechain_)
+					sidechainData_ = processor_->getSidechainSpectrumData();
 			}
 			else
 			{
@@ -105,12 +240,38 @@ public:
 	}
 
 private:
+	void updateConsuming()
+	{
+		setConsuming(processor_ != nullptr && isShowing());
+	}
+
+	void setConsuming(bool consume)
+	{
+		if (consume == consuming_) return;
+		consuming_ = consume;
+		if (consume)
+		{
+			processor_->setDisplayRate((float)REFRESH_RATE_HZ);
+			processor_->addConsumer();
+			for (auto& o : overlays_)
+				bus_->AddViewer(o.slot);
+			startTimerHz(REFRESH_RATE_HZ);
+		}
+		else
+		{
+			stopTimer();
+			processor_->removeConsumer();
+			for (auto& o : overlays_)
+				bus_->RemoveViewer(o.slot);
+		}
+	}
+
 	void drawGridAndLabels(juce::Graphics& g)
 	{
 		g.setColour(juce::Colours::grey.withAlpha(0.3f));
 		g.setFont(10.0f);
 
-		// Ƶ
+		// 绘制频率网格线
 		std::vector<float> frequencies = { 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000 };
 		for (float freq : frequencies)
 		{
@@ -119,7 +280,7 @@ private:
 				float x = frequencyToPosition(freq, spectrumBounds_);
 				g.drawVerticalLine((int)x, spectrumBounds_.getY(), spectrumBounds_.getBottom());
 
-				// Ƶʱǩ
+				// 绘制频率标签
 				juce::String label;
 				if (freq >= 1000)
 					label = juce::String(freq / 1000, 1) + "k";
@@ -131,13 +292,13 @@ private:
 			}
 		}
 
-		// dB
+		// 绘制dB网格线
 		for (float db = MIN_DB; db <= MAX_DB; db += 10.0f)
 		{
 			float y = dbToPosition(db, spectrumBounds_);
 			g.drawHorizontalLine((int)y, spectrumBounds_.getX(), spectrumBounds_.getRight());
 
-			// dBǩ
+			// 绘制dB标签
 			g.drawText(juce::String((int)db) + "dB",
 				(int)spectrumBounds_.getX() - 35, (int)y - 6, 30, 12,
 				juce::Justification::centredRight);
@@ -171,11 +332,11 @@ private:
 		float ratio = (db - MIN_DB) / (MAX_DB - MIN_DB);
 		ratio = juce::jlimit(0.0f, 1.0f, ratio);
 
-		// YᷭתdBֵϷ
+		// Y轴翻转：高dB值在上方
 		return bounds.getBottom() - ratio * bounds.getHeight();
 	}
 
-	// ƶƵףƽ
+	// 绘制对数频谱（平滑）
 	void updateLogSpectrumPath()
 	{
 		spectrumPath_.clear();
@@ -209,7 +370,45 @@ private:
 		}
 	}
 
-	// Ƶףԭʼ
+	// 侧链频谱画成一条线, 两边都高过COLLISION_FLOOR_DB的地方按较低的一方填色, 就是互相掩蔽的频段
+	void drawSidechainCollision(juce::Graphics& g)
+	{
+		juce::Path collision;
+		int n = (int)sidechainData_.size();
+		float bottom = spectrumBounds_.getBottom();
+		for (int i = 0; i < n; ++i)
+		{
+			float x = spectrumBounds_.getX() + spectrumBounds_.getWidth() * i / (float)(n - 1);
+			float level = std::min(spectrumData_[i], sidechainData_[i]);
+			float y = level > COLLISION_FLOOR_DB ? dbToPosition(level, spectrumBounds_) : bottom;
+			if (i == 0) collision.startNewSubPath(x, bottom);
+			collision.lineTo(x, y);
+		}
+		collision.lineTo(spectrumBounds_.getRight(), bottom);
+		collision.closeSubPath();
+		g.setColour(COLLISION_COLOR);
+		g.fillPath(collision);
+
+		g.setColour(SIDECHAIN_LINE_COLOR);
+		g.strokePath(makeOverlayPath(sidechainData_), juce::PathStrokeType(1.0f));
+	}
+
+	// 总线上的频谱都在同一组对数频率点上, 按下标均匀铺开
+	juce::Path makeOverlayPath(const std::vector<float>& dB) const
+	{
+		juce::Path path;
+		int n = (int)dB.size();
+		for (int i = 0; i < n; ++i)
+		{
+			float x = spectrumBounds_.getX() + spectrumBounds_.getWidth() * i / (float)(n - 1);
+			float y = dbToPosition(dB[i], spectrumBounds_);
+			if (i == 0) path.startNewSubPath(x, y);
+			else path.lineTo(x, y);
+		}
+		return path;
+	}
+
+	// 绘制线性频谱（原始方法）
 	void updateLinearSpectrumPath()
 	{
 		spectrumPath_.clear();
@@ -218,11 +417,11 @@ private:
 			return;
 
 		double sampleRate = processor_->getSampleRate();
-		double freqPerBin = sampleRate / (Spectrum1d::FFT_SIZE * 2.0);
+		double freqPerBin = sampleRate / Spectrum1d::FFT_SIZE;
 
 		bool firstPoint = true;
 
-		for (size_t bin = 1; bin < spectrumData_.size(); ++bin) // bin 1ʼDC
+		for (size_t bin = 1; bin < spectrumData_.size(); ++bin) // 从bin 1开始，跳过DC分量
 		{
 			float freq = (float)(bin * freqPerBin);
 
@@ -248,9 +447,23 @@ private:
 	std::shared_ptr<Spectrum1d> processor_;
 	std::vector<float> spectrumData_;
 	std::vector<float> logFrequencies_;
+	std::vector<float> sidechainData_;
 	juce::Path spectrumPath_;
 	juce::Rectangle<float> spectrumBounds_;
 	bool useLogSpectrum_;
+	bool consuming_ = false;
+	bool showSidechain_ = true;
+	SpectrumStatistics::Snapshot stats_;
+	int statsTicks_ = 0;
+
+	struct Overlay
+	{
+		int slot;
+		std::vector<float> dB;
+		bool valid;
+	};
+	std::vector<Overlay> overlays_;
+	juce::SharedResourcePointer<SpectrumBus> bus_;
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumUI)
 };
\ No newline at end of file